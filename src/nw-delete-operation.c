@@ -25,20 +25,134 @@
 
 #include "nw-delete-operation.h"
 
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 #include <gsecuredelete.h>
 
+#include "nw-device.h"
+#include "nw-fill-operation.h"
+#include "nw-mount.h"
 #include "nw-operation.h"
+#include "nw-overwrite.h"
+#include "nw-path-list.h"
+#include "nw-scan.h"
+#include "nw-throttle.h"
+#include "nw-walk.h"
 
 
-static void   nw_delete_operation_opeartion_iface_init    (NwOperationInterface *iface);
-static void   nw_delete_operation_real_add_file           (NwOperation *self,
-                                                           const gchar *file);
-static gchar *nw_delete_operation_real_get_progress_step  (NwOperation *self);
+/* maximum number of files wiped concurrently on a non-rotational device */
+#define NW_DELETE_OPERATION_MAX_DEVICE_WORKERS 4
+/* files up to this size are wiped in batches by default */
+#define NW_DELETE_OPERATION_DEFAULT_BATCH_THRESHOLD (64 * 1024)
+/* default and maximum number of files in a batch */
+#define NW_DELETE_OPERATION_DEFAULT_BATCH_SIZE 128
+#define NW_DELETE_OPERATION_MAX_BATCH_SIZE 1024
+/* errors listed in the final message, the others only being counted */
+#define NW_DELETE_OPERATION_MAX_REPORTED_ERRORS 100
 
 
+static void     nw_delete_operation_opeartion_iface_init    (NwOperationInterface *iface);
+static void     nw_delete_operation_finalize                (GObject *object);
+static void     nw_delete_operation_set_property            (GObject      *object,
+                                                             guint         prop_id,
+                                                             const GValue *value,
+                                                             GParamSpec   *pspec);
+static void     nw_delete_operation_get_property            (GObject    *object,
+                                                             guint       prop_id,
+                                                             GValue     *value,
+                                                             GParamSpec *pspec);
+static void     nw_delete_operation_real_add_file           (NwOperation *self,
+                                                             const gchar *file);
+static gchar   *nw_delete_operation_real_get_progress_step  (NwOperation *self);
+static gchar   *nw_delete_operation_real_get_report         (NwOperation *self);
+static gchar   *nw_delete_operation_real_get_warnings       (NwOperation *self);
+static gboolean nw_delete_operation_real_get_byte_progress  (NwOperation *self,
+                                                             guint64     *done,
+                                                             guint64     *total);
+static gboolean nw_delete_operation_real_run                (NwOperation *self,
+                                                             GError     **error);
+static gboolean nw_delete_operation_real_pause              (NwOperation *self);
+static gboolean nw_delete_operation_real_resume             (NwOperation *self);
+static void     nw_delete_operation_real_cancel             (NwOperation *self);
+static guint    get_current_pass                            (NwDeleteOperation *self);
+static guint    get_current_batch                           (NwDeleteOperation *self);
+
+
+struct _NwDeleteOperationPrivate {
+  NwOperationEngine engine;
+  NwOperationSyncPolicy sync_policy;
+  GList            *paths;
+  guint             n_paths;
+  guint64           batch_threshold;
+  guint             batch_size;
+  gboolean          discard;
+  gboolean          direct_io;
+  NwOperationIoClass io_class;
+  NwThrottle       *throttle;
+
+  /* native engine state */
+  GList            *groups;
+  GList            *trim_paths;
+  NwScan           *scan;
+  GPtrArray        *pools;
+  GPtrArray        *workers;
+  GMutex            mutex;
+  GCond             cond;
+  /* protected by the mutex */
+  gboolean          paused;
+  gboolean          canceled;
+  gboolean          cancel_reported;
+  guint             n_running;
+  guint64           bytes_written;
+  /* data of the files the workers found, when not counted beforehand, and
+   * items whose content isn't known yet */
+  guint64           found_bytes;
+  guint             n_unlisted;
+  GString          *messages;
+  guint             n_errors;
+  guint64           zero_offloaded;
+  guint64           zero_written;
+  guint64           cache_released;
+  /* inodes with several links being or already wiped */
+  GHashTable       *inodes;
+  guint             links_unlinked;
+  guint64           links_saved;
+  /* files only deleted, as overwriting them would not reach their data */
+  guint             cow_files;
+  guint64           cow_bytes;
+  GArray           *cow_devices;
+  GList            *cow_paths;
+  /* what to tell about file systems whose unused blocks couldn't be
+   * discarded */
+  GString          *trim_failures;
+
+  guint             n_passes;
+  volatile gint     files_done;
+  volatile gint     progress_pending;
+};
+
+enum
+{
+  PROP_0,
+  PROP_ENGINE,
+  PROP_SYNC_POLICY,
+  PROP_BATCH_THRESHOLD,
+  PROP_BATCH_SIZE,
+  PROP_DISCARD,
+  PROP_DIRECT_IO,
+  PROP_IO_CLASS,
+  PROP_BANDWIDTH_LIMIT,
+  PROP_SCAN
+};
+
 G_DEFINE_TYPE_WITH_CODE (NwDeleteOperation,
                          nw_delete_operation,
                          GSD_TYPE_DELETE_OPERATION,
@@ -51,43 +165,1756 @@ nw_delete_operation_opeartion_iface_init (NwOperationInterface *iface)
 {
   iface->add_file           = nw_delete_operation_real_add_file;
   iface->get_progress_step  = nw_delete_operation_real_get_progress_step;
+  iface->get_report         = nw_delete_operation_real_get_report;
+  iface->get_warnings       = nw_delete_operation_real_get_warnings;
+  iface->get_byte_progress  = nw_delete_operation_real_get_byte_progress;
+  iface->run                = nw_delete_operation_real_run;
+  iface->pause              = nw_delete_operation_real_pause;
+  iface->resume             = nw_delete_operation_real_resume;
+  iface->cancel             = nw_delete_operation_real_cancel;
 }
 
 static void
 nw_delete_operation_class_init (NwDeleteOperationClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize      = nw_delete_operation_finalize;
+  object_class->set_property  = nw_delete_operation_set_property;
+  object_class->get_property  = nw_delete_operation_get_property;
+
+  g_object_class_install_property (object_class, PROP_ENGINE,
+                                   g_param_spec_enum ("engine",
+                                                      "Engine",
+                                                      "The backend performing the wipe",
+                                                      NW_TYPE_OPERATION_ENGINE,
+                                                      NW_OPERATION_ENGINE_SECURE_DELETE,
+                                                      G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_SYNC_POLICY,
+                                   g_param_spec_enum ("sync-policy",
+                                                      "Sync policy",
+                                                      "When the built-in engines synchronize the written data",
+                                                      NW_TYPE_OPERATION_SYNC_POLICY,
+                                                      NW_OPERATION_SYNC_PER_BATCH,
+                                                      G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_BATCH_THRESHOLD,
+                                   g_param_spec_uint64 ("batch-threshold",
+                                                        "Batch threshold",
+                                                        "Size up to which files are wiped in batches",
+                                                        0, G_MAXUINT64,
+                                                        NW_DELETE_OPERATION_DEFAULT_BATCH_THRESHOLD,
+                                                        G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_BATCH_SIZE,
+                                   g_param_spec_uint ("batch-size",
+                                                      "Batch size",
+                                                      "Maximum number of files in a batch, batching is disabled below 2",
+                                                      0, NW_DELETE_OPERATION_MAX_BATCH_SIZE,
+                                                      NW_DELETE_OPERATION_DEFAULT_BATCH_SIZE,
+                                                      G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_DISCARD,
+                                   g_param_spec_boolean ("discard",
+                                                         "Discard",
+                                                         "Whether to discard the freed blocks of devices supporting it, with the built-in engines",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_DIRECT_IO,
+                                   g_param_spec_boolean ("direct-io",
+                                                         "Direct I/O",
+                                                         "Whether the built-in engines bypass the page cache",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_IO_CLASS,
+                                   g_param_spec_enum ("io-class",
+                                                      "I/O class",
+                                                      "The I/O scheduling class of the writes",
+                                                      NW_TYPE_OPERATION_IO_CLASS,
+                                                      NW_OPERATION_IO_CLASS_NORMAL,
+                                                      G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_BANDWIDTH_LIMIT,
+                                   g_param_spec_uint64 ("bandwidth-limit",
+                                                        "Bandwidth limit",
+                                                        "Bytes per second the built-in engines write at most, or 0 for no limit.  It can be changed while running",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_SCAN,
+                                   g_param_spec_pointer ("scan",
+                                                         "Scan",
+                                                         "A #NwScan of the files to wipe started beforehand, which the operation takes over",
+                                                         G_PARAM_WRITABLE));
+
+  g_type_class_add_private (klass, sizeof (NwDeleteOperationPrivate));
 }
 
 static void
 nw_delete_operation_init (NwDeleteOperation *self)
 {
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+                                            NW_TYPE_DELETE_OPERATION,
+                                            NwDeleteOperationPrivate);
+
+  self->priv->engine = NW_OPERATION_ENGINE_SECURE_DELETE;
+  self->priv->sync_policy = NW_OPERATION_SYNC_PER_BATCH;
+  self->priv->paths = NULL;
+  self->priv->n_paths = 0;
+  self->priv->batch_threshold = NW_DELETE_OPERATION_DEFAULT_BATCH_THRESHOLD;
+  self->priv->batch_size = NW_DELETE_OPERATION_DEFAULT_BATCH_SIZE;
+  self->priv->discard = FALSE;
+  self->priv->direct_io = FALSE;
+  self->priv->io_class = NW_OPERATION_IO_CLASS_NORMAL;
+  self->priv->throttle = nw_throttle_new (0);
+  self->priv->groups = NULL;
+  self->priv->trim_paths = NULL;
+  self->priv->scan = NULL;
+  self->priv->pools = NULL;
+  self->priv->workers = NULL;
+  g_mutex_init (&self->priv->mutex);
+  g_cond_init (&self->priv->cond);
+  self->priv->paused = FALSE;
+  self->priv->canceled = FALSE;
+  self->priv->cancel_reported = FALSE;
+  self->priv->n_running = 0;
+  self->priv->bytes_written = 0;
+  self->priv->found_bytes = 0;
+  self->priv->n_unlisted = 0;
+  self->priv->messages = NULL;
+  self->priv->n_errors = 0;
+  self->priv->zero_offloaded = 0;
+  self->priv->zero_written = 0;
+  self->priv->cache_released = 0;
+  self->priv->inodes = NULL;
+  self->priv->links_unlinked = 0;
+  self->priv->links_saved = 0;
+  self->priv->cow_files = 0;
+  self->priv->cow_bytes = 0;
+  self->priv->cow_devices = g_array_new (FALSE, FALSE, sizeof (dev_t));
+  self->priv->cow_paths = NULL;
+  self->priv->trim_failures = NULL;
+  self->priv->n_passes = 1;
+  self->priv->files_done = 0;
+  self->priv->progress_pending = 0;
+}
+
+static void
+nw_delete_operation_finalize (GObject *object)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (object);
+
+  nw_path_list_free (self->priv->paths);
+  self->priv->paths = NULL;
+  if (self->priv->scan) {
+    /* given but never run */
+    nw_scan_free (self->priv->scan);
+    self->priv->scan = NULL;
+  }
+  g_array_free (self->priv->cow_devices, TRUE);
+  nw_path_list_free (self->priv->cow_paths);
+  if (self->priv->trim_failures) {
+    g_string_free (self->priv->trim_failures, TRUE);
+  }
+  g_mutex_clear (&self->priv->mutex);
+  g_cond_clear (&self->priv->cond);
+  nw_throttle_free (self->priv->throttle);
+
+  G_OBJECT_CLASS (nw_delete_operation_parent_class)->finalize (object);
+}
+
+static void
+nw_delete_operation_set_property (GObject      *object,
+                                  guint         prop_id,
+                                  const GValue *value,
+                                  GParamSpec   *pspec)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (object);
+
+  switch (prop_id) {
+    case PROP_ENGINE:
+      self->priv->engine = g_value_get_enum (value);
+      break;
+
+    case PROP_SYNC_POLICY:
+      self->priv->sync_policy = g_value_get_enum (value);
+      break;
+
+    case PROP_BATCH_THRESHOLD:
+      self->priv->batch_threshold = g_value_get_uint64 (value);
+      break;
+
+    case PROP_BATCH_SIZE:
+      self->priv->batch_size = g_value_get_uint (value);
+      break;
+
+    case PROP_DISCARD:
+      self->priv->discard = g_value_get_boolean (value);
+      break;
+
+    case PROP_DIRECT_IO:
+      self->priv->direct_io = g_value_get_boolean (value);
+      break;
+
+    case PROP_IO_CLASS:
+      self->priv->io_class = g_value_get_enum (value);
+      break;
+
+    case PROP_BANDWIDTH_LIMIT:
+      nw_throttle_set_rate (self->priv->throttle, g_value_get_uint64 (value));
+      break;
+
+    case PROP_SCAN:
+      if (self->priv->scan) {
+        nw_scan_free (self->priv->scan);
+      }
+      self->priv->scan = g_value_get_pointer (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+static void
+nw_delete_operation_get_property (GObject    *object,
+                                  guint       prop_id,
+                                  GValue     *value,
+                                  GParamSpec *pspec)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (object);
+
+  switch (prop_id) {
+    case PROP_ENGINE:
+      g_value_set_enum (value, self->priv->engine);
+      break;
+
+    case PROP_SYNC_POLICY:
+      g_value_set_enum (value, self->priv->sync_policy);
+      break;
+
+    case PROP_BATCH_THRESHOLD:
+      g_value_set_uint64 (value, self->priv->batch_threshold);
+      break;
+
+    case PROP_BATCH_SIZE:
+      g_value_set_uint (value, self->priv->batch_size);
+      break;
+
+    case PROP_DISCARD:
+      g_value_set_boolean (value, self->priv->discard);
+      break;
+
+    case PROP_DIRECT_IO:
+      g_value_set_boolean (value, self->priv->direct_io);
+      break;
+
+    case PROP_IO_CLASS:
+      g_value_set_enum (value, self->priv->io_class);
+      break;
+
+    case PROP_BANDWIDTH_LIMIT:
+      g_value_set_uint64 (value, nw_throttle_get_rate (self->priv->throttle));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
 }
 
 static void
-nw_delete_operation_real_add_file (NwOperation *self,
+nw_delete_operation_real_add_file (NwOperation *operation,
                                    const gchar *file)
 {
-  gsd_delete_operation_add_path (GSD_DELETE_OPERATION (self), file);
+  NwDeleteOperation *self = NW_DELETE_OPERATION (operation);
+
+  /* paths are only handed to the engine when running, as we don't know yet
+   * which one will be used */
+  self->priv->paths = g_list_append (self->priv->paths, g_strdup (file));
+  self->priv->n_paths ++;
 }
 
 static gchar *
 nw_delete_operation_real_get_progress_step (NwOperation *operation)
 {
-  /* it's a bit ugly here: we rely on the knowledge that
-   * GsdSecureDeleteOperation's get_max_progress() returns the individual
-   * pass count, and GsdDeleteOperation overrides it multiplying it by the
-   * file count.  But well, that gives us everything but the file name. */
-  GsdAsyncOperation      *op        = GSD_ASYNC_OPERATION (operation);
-  GsdAsyncOperationClass *delopcls  = g_type_class_peek (GSD_TYPE_SECURE_DELETE_OPERATION);
-  guint                   passes    = delopcls->get_max_progress (op);
-  guint                   n_files   = op->n_passes / passes;
-  guint                   file      = op->passes / passes;
-  guint                   pass      = op->passes % passes;
+  NwDeleteOperation *self = NW_DELETE_OPERATION (operation);
+  guint              passes;
+  guint              n_files;
+  guint              file;
+  guint              pass;
+  guint              batch = 0;
+
+  if (self->priv->engine == NW_OPERATION_ENGINE_SECURE_DELETE) {
+    /* it's a bit ugly here: we rely on the knowledge that
+     * GsdSecureDeleteOperation's get_max_progress() returns the individual
+     * pass count, and GsdDeleteOperation overrides it multiplying it by the
+     * file count.  But well, that gives us everything but the file name. */
+    GsdAsyncOperation      *op        = GSD_ASYNC_OPERATION (operation);
+    GsdAsyncOperationClass *delopcls  = g_type_class_peek (GSD_TYPE_SECURE_DELETE_OPERATION);
+
+    passes  = delopcls->get_max_progress (op);
+    n_files = op->n_passes / passes;
+    file    = op->passes / passes;
+    pass    = op->passes % passes;
+  } else {
+    passes  = self->priv->n_passes;
+    n_files = self->priv->n_paths;
+    file    = MIN ((guint) g_atomic_int_get (&self->priv->files_done),
+                   n_files - 1);
+    pass    = self->priv->workers ? get_current_pass (self) : 0;
+    batch   = self->priv->workers ? get_current_batch (self) : 0;
+  }
   
+  if (batch > 0) {
+    return g_strdup_printf (_("File %u out of %u, batch of %u small files, "
+                              "pass %u out of %u"),
+                            file + 1, n_files, batch, pass + 1, passes);
+  }
   return g_strdup_printf (_("File %u out of %u, pass %u out of %u"),
                           file + 1, n_files, pass + 1, passes);
 }
 
+/* appends a line about how zero passes were written to @report */
+static void
+append_zero_report (NwDeleteOperation *self,
+                    GString           *report)
+{
+  gchar *offloaded;
+  gchar *written;
+
+  if (self->priv->zero_offloaded == 0 && self->priv->zero_written == 0) {
+    return;
+  }
+  offloaded = g_format_size (self->priv->zero_offloaded);
+  written = g_format_size (self->priv->zero_written);
+  if (report->len > 0) {
+    g_string_append_c (report, '\n');
+  }
+  if (self->priv->zero_written == 0) {
+    g_string_append_printf (report, _("Zeros were written by the device itself "
+                                      "(%s)."), offloaded);
+  } else if (self->priv->zero_offloaded == 0) {
+    g_string_append_printf (report, _("Zeros were written as regular data "
+                                      "(%s), the device not supporting "
+                                      "writing them itself."), written);
+  } else {
+    g_string_append_printf (report, _("Zeros were written by the device "
+                                      "itself for %s, and as regular data for "
+                                      "%s."), offloaded, written);
+  }
+  g_free (offloaded);
+  g_free (written);
+}
+
+/* appends a line about the files that were only deleted, as they were on
+ * copy-on-write storage, and where to fill the free space to erase them */
+static void
+append_copy_on_write_report (NwDeleteOperation *self,
+                             GString           *report)
+{
+  GList  *mounts = NULL;
+  GList  *existing = NULL;
+  GList  *item;
+  gchar  *size;
+
+  if (self->priv->cow_files == 0) {
+    return;
+  }
+  size = g_format_size (self->priv->cow_bytes);
+  if (report->len > 0) {
+    g_string_append_c (report, '\n');
+  }
+  g_string_append_printf (report,
+                          g_dngettext (GETTEXT_PACKAGE,
+                                       "%u file (%s) was only deleted, as "
+                                       "overwriting it on copy-on-write "
+                                       "storage would have left its data in "
+                                       "place.",
+                                       "%u files (%s) were only deleted, as "
+                                       "overwriting them on copy-on-write "
+                                       "storage would have left their data in "
+                                       "place.",
+                                       self->priv->cow_files),
+                          self->priv->cow_files, size);
+  g_free (size);
+  /* the data is now in the free space, which filling does erase.  The
+   * directories might be wiped too, look for their mount from what is left */
+  for (item = self->priv->cow_paths; item; item = item->next) {
+    gchar *path = g_strdup (item->data);
+
+    while (! g_file_test (path, G_FILE_TEST_EXISTS)) {
+      gchar *parent = g_path_get_dirname (path);
+
+      g_free (path);
+      path = parent;
+    }
+    existing = g_list_prepend (existing, path);
+  }
+  existing = g_list_reverse (existing);
+  if (nw_fill_operation_filter_files (existing, NULL, &mounts, NULL)) {
+    for (item = mounts; item; item = item->next) {
+      gchar *name = g_filename_display_name (item->data);
+
+      g_string_append_c (report, '\n');
+      g_string_append_printf (report, _("Wipe the available disk space on "
+                                        "\"%s\" to erase that data."), name);
+      g_free (name);
+    }
+    nw_path_list_free (mounts);
+  }
+  nw_path_list_free (existing);
+}
+
+static gchar *
+nw_delete_operation_real_get_report (NwOperation *operation)
+{
+  NwDeleteOperation  *self = NW_DELETE_OPERATION (operation);
+  GString            *report;
+
+  if (self->priv->engine == NW_OPERATION_ENGINE_SECURE_DELETE) {
+    return NULL;
+  }
+  report = g_string_new (NULL);
+  append_zero_report (self, report);
+  if (self->priv->cache_released > 0) {
+    gchar *released = g_format_size (self->priv->cache_released);
+
+    if (report->len > 0) {
+      g_string_append_c (report, '\n');
+    }
+    g_string_append_printf (report, _("%s of written data was released from "
+                                      "the cache."), released);
+    g_free (released);
+  }
+  if (self->priv->links_unlinked > 0) {
+    gchar *saved = g_format_size (self->priv->links_saved);
+
+    if (report->len > 0) {
+      g_string_append_c (report, '\n');
+    }
+    g_string_append_printf (report,
+                            g_dngettext (GETTEXT_PACKAGE,
+                                         "%u hard link to data already wiped "
+                                         "was only removed, avoiding %s of "
+                                         "redundant writes.",
+                                         "%u hard links to data already wiped "
+                                         "were only removed, avoiding %s of "
+                                         "redundant writes.",
+                                         self->priv->links_unlinked),
+                            self->priv->links_unlinked, saved);
+    g_free (saved);
+  }
+  append_copy_on_write_report (self, report);
+  if (self->priv->trim_failures) {
+    if (report->len > 0) {
+      g_string_append_c (report, '\n');
+    }
+    g_string_append (report, self->priv->trim_failures->str);
+  }
+
+  return g_string_free (report, report->len == 0);
+}
+
+/* appends to @warnings what to know about wiping items on the mount
+ * @mount_point classified as @flags */
+static void
+append_mount_warnings (GString      *warnings,
+                       const gchar  *mount_point,
+                       NwMountFlags  flags)
+{
+  const gchar *formats[6];
+  gchar       *name;
+  guint        n = 0;
+  guint        i;
+
+  if (flags & NW_MOUNT_READ_ONLY) {
+    formats[n++] = _("Items on \"%s\" can't be wiped, it is mounted "
+                     "read-only.");
+  }
+  if (flags & NW_MOUNT_REMOTE) {
+    formats[n++] = _("Items on \"%s\" are stored on another machine, which "
+                     "decides where the overwriting data goes.  Their data may "
+                     "survive.");
+  } else if (flags & NW_MOUNT_FUSE) {
+    formats[n++] = _("\"%s\" is handled by a user-space file system, which "
+                     "may not overwrite data in place.");
+  }
+  if (flags & NW_MOUNT_COMPRESSED) {
+    formats[n++] = _("\"%s\" compresses data: only random passes overwrite "
+                     "anything there, patterns and zeros take next to no "
+                     "room.");
+  }
+  if (flags & NW_MOUNT_DATA_JOURNAL) {
+    formats[n++] = _("\"%s\" journals data, copies of the items may remain "
+                     "in its journal.");
+  }
+  if (flags & NW_MOUNT_ENCRYPTED) {
+    formats[n++] = _("\"%s\" is encrypted, so a single pass is enough there: "
+                     "only encrypted data ever reached the disk.");
+  }
+  name = g_filename_display_name (mount_point);
+  for (i = 0; i < n; i++) {
+    if (warnings->len > 0) {
+      g_string_append_c (warnings, '\n');
+    }
+    g_string_append_printf (warnings, formats[i], name);
+  }
+  g_free (name);
+}
+
+static gchar *
+nw_delete_operation_real_get_warnings (NwOperation *operation)
+{
+  NwDeleteOperation  *self = NW_DELETE_OPERATION (operation);
+  GHashTable         *seen;
+  GString            *warnings;
+  GList              *item;
+
+  /* copy-on-write files are found file by file when counting them */
+  seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  warnings = g_string_new (NULL);
+  for (item = self->priv->paths; item; item = item->next) {
+    gchar        *mount_point = NULL;
+    NwMountFlags  flags;
+
+    flags = nw_mount_probe (item->data, &mount_point);
+    if (mount_point && ! g_hash_table_lookup (seen, mount_point)) {
+      append_mount_warnings (warnings, mount_point, flags);
+      g_hash_table_insert (seen, mount_point, mount_point);
+    } else {
+      g_free (mount_point);
+    }
+  }
+  g_hash_table_destroy (seen);
+
+  return g_string_free (warnings, warnings->len == 0);
+}
+
+static gboolean
+nw_delete_operation_real_get_byte_progress (NwOperation *operation,
+                                            guint64     *done,
+                                            guint64     *total)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (operation);
+  guint64            n_bytes = 0;
+  guint64            cow_bytes = 0;
+  guint64            saved = 0;
+
+  if (! self->priv->workers) {
+    return FALSE;
+  }
+  if (self->priv->scan) {
+    /* counted before starting */
+    nw_scan_get_totals (self->priv->scan, NULL, &n_bytes);
+    g_strfreev (nw_scan_get_copy_on_write (self->priv->scan, NULL,
+                                           &cow_bytes));
+  }
+  g_mutex_lock (&self->priv->mutex);
+  *done = self->priv->bytes_written;
+  if (! self->priv->scan && self->priv->n_unlisted == 0) {
+    /* the workers found everything, hard links to data already wiped and
+     * copy-on-write files included */
+    n_bytes = self->priv->found_bytes;
+    cow_bytes = self->priv->cow_bytes;
+    saved = self->priv->links_saved;
+  }
+  g_mutex_unlock (&self->priv->mutex);
+  /* unknown until the whole selection is listed.  Copy-on-write files are
+   * only deleted, so their data is never written */
+  *total = (n_bytes - MIN (cow_bytes, n_bytes)) * self->priv->n_passes;
+  *total -= MIN (saved, *total);
+
+  return TRUE;
+}
+
+
+/* native engine */
+
+/* scale of Worker::progress */
+#define WORKER_PROGRESS_SCALE 1000000
+
+/* a directory being wiped.  It is removed by whichever worker finishes its
+ * last entry, so trees get removed bottom-up as soon as they are empty */
+typedef struct _DirNode DirNode;
+struct _DirNode {
+  DirNode        *parent;
+  gchar          *path;
+  /* entries not done yet */
+  volatile gint   pending;
+  /* whether an entry couldn't be removed, in which case neither can be the
+   * directory */
+  volatile gint   failed;
+};
+
+/* an item to wipe, either selected or found in a directory */
+typedef struct {
+  gchar        *path;
+  /* the directory holding the item, or %NULL for selected items */
+  DirNode      *parent;
+  /* the item's information, info.mode being 0 if not known yet */
+  NwWalkEntry   info;
+} Task;
+
+/* the workers of a device group, stealing tasks from each other */
+typedef struct {
+  GPtrArray      *workers;
+  /* tasks queued, being wiped or waiting in a batch */
+  volatile gint   pending;
+  /* workers waiting for tasks */
+  volatile gint   n_idle;
+} WorkerPool;
+
+/* a thread wiping the tasks of its queue, and stealing from the other workers
+ * of its pool once it has nothing left to do */
+typedef struct {
+  NwDeleteOperation  *self;
+  WorkerPool         *pool;
+  GThread            *thread;
+  /* the worker's tasks.  The worker takes them from the head, which keeps the
+   * traversal depth-first, and others steal from the tail, which holds the
+   * largest subtrees */
+  GMutex              lock;
+  GQueue              tasks;
+  volatile gint       pass;
+  volatile gint       busy;
+  /* progress on the current file, out of WORKER_PROGRESS_SCALE */
+  volatile gint       progress;
+  guint64             pass_written;
+  /* small files waiting to be wiped together as #Task, all from
+   * batch_device */
+  GPtrArray          *batch;
+  dev_t               batch_device;
+  /* number of files of the batch being wiped, 0 if none */
+  volatile gint       batch_flushing;
+  /* whether the devices seen may copy on write, by device */
+  GHashTable         *cow_devices;
+} Worker;
+
+/* gets the lowest pass any worker is currently writing */
+static guint
+get_current_pass (NwDeleteOperation *self)
+{
+  guint pass = G_MAXUINT;
+  guint i;
+
+  for (i = 0; i < self->priv->workers->len; i++) {
+    Worker *worker = g_ptr_array_index (self->priv->workers, i);
+
+    if (g_atomic_int_get (&worker->busy)) {
+      pass = MIN (pass, (guint) g_atomic_int_get (&worker->pass));
+    }
+  }
+
+  return pass == G_MAXUINT ? 0 : pass;
+}
+
+/* gets the size of the largest batch being wiped, or 0 if none is */
+static guint
+get_current_batch (NwDeleteOperation *self)
+{
+  guint batch = 0;
+  guint i;
+
+  for (i = 0; i < self->priv->workers->len; i++) {
+    Worker *worker = g_ptr_array_index (self->priv->workers, i);
+
+    if (g_atomic_int_get (&worker->busy)) {
+      batch = MAX (batch, (guint) g_atomic_int_get (&worker->batch_flushing));
+    }
+  }
+
+  return batch;
+}
+
+static gboolean
+emit_progress_idle (gpointer data)
+{
+  NwDeleteOperation  *self = data;
+  guint               n_files = MAX (self->priv->n_paths, 1);
+  gdouble             fraction;
+  guint64             done;
+  guint64             total;
+  guint               i;
+
+  g_atomic_int_set (&self->priv->progress_pending, 0);
+  if (! self->priv->workers) {
+    /* already finished */
+    return FALSE;
+  }
+  /* once the selection is counted, progress follows the data so that large
+   * files weigh more than small ones */
+  if (nw_operation_get_byte_progress (NW_OPERATION (self), &done, &total) &&
+      total > 0) {
+    g_signal_emit_by_name (self, "progress",
+                           CLAMP ((gdouble) done / total, 0.0, 1.0));
+    return FALSE;
+  }
+  fraction = g_atomic_int_get (&self->priv->files_done);
+  for (i = 0; i < self->priv->workers->len; i++) {
+    Worker *worker = g_ptr_array_index (self->priv->workers, i);
+
+    if (g_atomic_int_get (&worker->busy)) {
+      fraction += (gdouble) g_atomic_int_get (&worker->progress) /
+                  WORKER_PROGRESS_SCALE;
+    }
+  }
+  g_signal_emit_by_name (self, "progress", CLAMP (fraction / n_files, 0.0, 1.0));
+
+  return FALSE;
+}
+
+/* asks for a progress update from the main thread.  Requests are coalesced so
+ * there is at most one pending at a time */
+static void
+schedule_progress (NwDeleteOperation *self)
+{
+  if (g_atomic_int_compare_and_exchange (&self->priv->progress_pending, 0, 1)) {
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, emit_progress_idle,
+                     g_object_ref (self), g_object_unref);
+  }
+}
+
+/* joins the workers and releases the per-run state, so that it is not
+ * running anymore when emitting "finished" */
+static void
+cleanup_workers (NwDeleteOperation *self)
+{
+  guint i;
+
+  for (i = 0; i < self->priv->workers->len; i++) {
+    Worker *worker = g_ptr_array_index (self->priv->workers, i);
+
+    if (worker->thread) {
+      g_thread_join (worker->thread);
+    }
+    g_mutex_clear (&worker->lock);
+    g_slice_free (Worker, worker);
+  }
+  g_ptr_array_free (self->priv->workers, TRUE);
+  self->priv->workers = NULL;
+  for (i = 0; i < self->priv->pools->len; i++) {
+    WorkerPool *pool = g_ptr_array_index (self->priv->pools, i);
+
+    g_ptr_array_free (pool->workers, TRUE);
+    g_slice_free (WorkerPool, pool);
+  }
+  g_ptr_array_free (self->priv->pools, TRUE);
+  self->priv->pools = NULL;
+  if (self->priv->scan) {
+    nw_scan_free (self->priv->scan);
+    self->priv->scan = NULL;
+  }
+  g_hash_table_destroy (self->priv->inodes);
+  self->priv->inodes = NULL;
+  nw_device_group_list_free (self->priv->groups);
+  self->priv->groups = NULL;
+  nw_path_list_free (self->priv->trim_paths);
+  self->priv->trim_paths = NULL;
+}
+
+static gboolean
+emit_finished_idle (gpointer data)
+{
+  NwDeleteOperation  *self = data;
+  gchar              *message = NULL;
+  gboolean            success;
+
+  cleanup_workers (self);
+  if (self->priv->n_errors > NW_DELETE_OPERATION_MAX_REPORTED_ERRORS) {
+    guint n_more = self->priv->n_errors - NW_DELETE_OPERATION_MAX_REPORTED_ERRORS;
+
+    g_string_append_c (self->priv->messages, '\n');
+    g_string_append_printf (self->priv->messages,
+                            g_dngettext (GETTEXT_PACKAGE,
+                                         "%u more error is not shown.",
+                                         "%u more errors are not shown.",
+                                         n_more),
+                            n_more);
+  }
+  if (self->priv->messages) {
+    message = g_string_free (self->priv->messages, FALSE);
+    self->priv->messages = NULL;
+  }
+  /* the workers are gone, no need for the lock */
+  success = message == NULL && ! self->priv->canceled;
+  g_signal_emit_by_name (self, "finished", success, message);
+  g_free (message);
+
+  return FALSE;
+}
+
+/* records an error to be reported when finished.  Must be called with the
+ * mutex held */
+static void
+add_error_message (NwDeleteOperation *self,
+                   const GError      *error)
+{
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    /* all workers get canceled at once, only report it once */
+    if (self->priv->cancel_reported) {
+      return;
+    }
+    self->priv->cancel_reported = TRUE;
+  }
+  /* a tree may have lots of failing entries, don't make a novel of them */
+  if (++ self->priv->n_errors > NW_DELETE_OPERATION_MAX_REPORTED_ERRORS) {
+    return;
+  }
+  if (! self->priv->messages) {
+    self->priv->messages = g_string_new (error->message);
+  } else {
+    g_string_append_printf (self->priv->messages, "\n%s", error->message);
+  }
+}
+
+/* blocks while paused.  Must be called with the mutex held.
+ * Returns: %FALSE if the operation got canceled */
+static gboolean
+wait_while_paused (NwDeleteOperation *self)
+{
+  while (self->priv->paused && ! self->priv->canceled) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+
+  return ! self->priv->canceled;
+}
+
+/* overwriter callback: reports progress, blocks while paused and aborts if
+ * canceled */
+static gboolean
+overwrite_check_func (guint    pass,
+                      guint64  written,
+                      guint64  size,
+                      gpointer data)
+{
+  Worker             *worker = data;
+  NwDeleteOperation  *self = worker->self;
+  gboolean            keep_going;
+  gdouble             fraction;
+
+  if ((guint) g_atomic_int_get (&worker->pass) != pass) {
+    g_atomic_int_set (&worker->pass, (gint) pass);
+    worker->pass_written = 0;
+  }
+  /* progress follows the bytes actually written, which for sparse files is
+   * less than their apparent size */
+  worker->pass_written += written;
+  fraction = (pass + (gdouble) worker->pass_written / MAX (size, 1)) /
+             self->priv->n_passes;
+  g_atomic_int_set (&worker->progress,
+                    (gint) (CLAMP (fraction, 0.0, 1.0) * WORKER_PROGRESS_SCALE));
+  schedule_progress (self);
+
+  if (! nw_throttle_consume (self->priv->throttle, written)) {
+    return FALSE;
+  }
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->bytes_written += written;
+  keep_going = wait_while_paused (self);
+  g_mutex_unlock (&self->priv->mutex);
+
+  return keep_going;
+}
+
+/* resets @worker's progress before wiping a new file or batch */
+static void
+worker_reset_progress (Worker *worker)
+{
+  g_atomic_int_set (&worker->pass, 0);
+  g_atomic_int_set (&worker->progress, 0);
+  worker->pass_written = 0;
+}
+
+static Task *
+task_new (const gchar        *path,
+          DirNode            *parent,
+          const NwWalkEntry  *info)
+{
+  Task *task = g_slice_new (Task);
+
+  task->path = g_strdup (path);
+  task->parent = parent;
+  if (info) {
+    task->info = *info;
+  } else {
+    memset (&task->info, 0, sizeof task->info);
+  }
+  task->info.name = NULL;
+
+  return task;
+}
+
+static void
+task_free (Task *task)
+{
+  g_free (task->path);
+  g_slice_free (Task, task);
+}
+
+/* records @error, if any, to be reported when finished */
+static void
+worker_add_error (Worker *worker,
+                  GError *error)
+{
+  NwDeleteOperation *self = worker->self;
+
+  if (error) {
+    g_mutex_lock (&self->priv->mutex);
+    add_error_message (self, error);
+    g_mutex_unlock (&self->priv->mutex);
+    g_error_free (error);
+  }
+}
+
+/* adds @task to the head of @worker's queue, where @worker picks its next task
+ * from.  The task must already be counted in the pool's pending tasks */
+static void
+worker_push_task (Worker *worker,
+                  Task   *task)
+{
+  NwDeleteOperation *self = worker->self;
+
+  g_mutex_lock (&worker->lock);
+  g_queue_push_head (&worker->tasks, task);
+  g_mutex_unlock (&worker->lock);
+  if (g_atomic_int_get (&worker->pool->n_idle) > 0) {
+    g_mutex_lock (&self->priv->mutex);
+    g_cond_broadcast (&self->priv->cond);
+    g_mutex_unlock (&self->priv->mutex);
+  }
+}
+
+/* takes a task: the next one of @worker, or else the oldest one of another
+ * worker of the pool */
+static Task *
+worker_steal_task (Worker *worker)
+{
+  GPtrArray  *workers = worker->pool->workers;
+  Task       *task;
+  guint       first = 0;
+  guint       i;
+
+  g_mutex_lock (&worker->lock);
+  task = g_queue_pop_head (&worker->tasks);
+  g_mutex_unlock (&worker->lock);
+  /* start from the next worker so that not all thieves hit the same one */
+  for (i = 0; i < workers->len; i++) {
+    if (g_ptr_array_index (workers, i) == worker) {
+      first = i + 1;
+      break;
+    }
+  }
+  for (i = 0; ! task && i < workers->len; i++) {
+    Worker *victim = g_ptr_array_index (workers, (first + i) % workers->len);
+
+    if (victim != worker) {
+      g_mutex_lock (&victim->lock);
+      task = g_queue_pop_tail (&victim->tasks);
+      g_mutex_unlock (&victim->lock);
+    }
+  }
+
+  return task;
+}
+
+/* frees @task, which is done or was handed over to a #DirNode, and wakes the
+ * idle workers up if it was the last one so they can quit */
+static void
+worker_drop_task (Worker *worker,
+                  Task   *task)
+{
+  NwDeleteOperation *self = worker->self;
+
+  task_free (task);
+  if (g_atomic_int_dec_and_test (&worker->pool->pending)) {
+    g_mutex_lock (&self->priv->mutex);
+    g_cond_broadcast (&self->priv->cond);
+    g_mutex_unlock (&self->priv->mutex);
+  }
+}
+
+/* marks an entry of @node done.  The last entry of a directory removes it,
+ * which is in turn an entry of its parent, and so on.  A %NULL @node stands
+ * for the selection itself */
+static void
+dir_node_release (Worker   *worker,
+                  DirNode  *node,
+                  gboolean  success)
+{
+  NwDeleteOperation *self = worker->self;
+
+  while (node) {
+    DirNode *parent = node->parent;
+    GError  *err = NULL;
+
+    if (! success) {
+      g_atomic_int_set (&node->failed, 1);
+    }
+    if (! g_atomic_int_dec_and_test (&node->pending)) {
+      return;
+    }
+    /* that was the last entry, the directory is empty now */
+    success = ! g_atomic_int_get (&node->failed);
+    if (success && ! nw_overwrite_remove (node->path, &err)) {
+      worker_add_error (worker, err);
+      success = FALSE;
+    }
+    g_free (node->path);
+    g_slice_free (DirNode, node);
+    node = parent;
+  }
+  /* a selected item is done */
+  g_atomic_int_inc (&self->priv->files_done);
+  schedule_progress (self);
+}
+
+/* @task was wiped, or failed to */
+static void
+worker_complete_task (Worker   *worker,
+                      Task     *task,
+                      gboolean  success)
+{
+  dir_node_release (worker, task->parent, success);
+  worker_drop_task (worker, task);
+}
+
+/* wipes the files of @worker's batch at once, completing them */
+static void
+flush_batch (Worker        *worker,
+             NwOverwriter  *overwriter)
+{
+  GError       *err = NULL;
+  const gchar **paths;
+  gboolean      success;
+  guint         i;
+
+  if (worker->batch->len == 0) {
+    return;
+  }
+  paths = g_new (const gchar *, worker->batch->len);
+  for (i = 0; i < worker->batch->len; i++) {
+    paths[i] = ((Task *) g_ptr_array_index (worker->batch, i))->path;
+  }
+  g_atomic_int_set (&worker->busy, 1);
+  worker_reset_progress (worker);
+  g_atomic_int_set (&worker->batch_flushing, (gint) worker->batch->len);
+  success = nw_overwriter_wipe_files (overwriter,
+                                      (const gchar *const *) paths,
+                                      worker->batch->len, &err);
+  g_atomic_int_set (&worker->batch_flushing, 0);
+  worker_reset_progress (worker);
+  g_atomic_int_set (&worker->busy, 0);
+  g_free (paths);
+  worker_add_error (worker, err);
+  for (i = 0; i < worker->batch->len; i++) {
+    worker_complete_task (worker, g_ptr_array_index (worker->batch, i),
+                          success);
+  }
+  g_ptr_array_set_size (worker->batch, 0);
+}
+
+/* queues @task to be wiped with other small files.  The batch is wiped once
+ * full, or before adding a file from another device */
+static void
+batch_task (Worker       *worker,
+            NwOverwriter *overwriter,
+            Task         *task)
+{
+  if (worker->batch->len > 0 && worker->batch_device != task->info.device) {
+    flush_batch (worker, overwriter);
+  }
+  g_ptr_array_add (worker->batch, task);
+  worker->batch_device = task->info.device;
+  if (worker->batch->len >= worker->self->priv->batch_size) {
+    flush_batch (worker, overwriter);
+  }
+}
+
+/* counts @bytes of data found by the workers, and changes the number of items
+ * whose content is still to be found by @n_unlisted */
+static void
+add_found (NwDeleteOperation *self,
+           guint64            bytes,
+           gint               n_unlisted)
+{
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->found_bytes += bytes;
+  self->priv->n_unlisted = (guint) ((gint) self->priv->n_unlisted + n_unlisted);
+  g_mutex_unlock (&self->priv->mutex);
+}
+
+/* walker callback collecting the entries of a directory as tasks */
+static gboolean
+collect_entry (const NwWalkEntry *entry,
+               gpointer           data)
+{
+  gpointer   *args = data;
+  DirNode    *node = args[0];
+  GPtrArray  *tasks = args[1];
+  gchar      *path = g_build_filename (node->path, entry->name, NULL);
+
+  g_ptr_array_add (tasks, task_new (path, node, entry));
+  g_free (path);
+
+  return TRUE;
+}
+
+/* lists the directory of @task and queues its entries.  The whole listing is
+ * read first, as wiping an entry renames it, which could make it listed
+ * again.  The directory itself is removed once all its entries are */
+static void
+queue_directory (Worker *worker,
+                 Task   *task)
+{
+  DirNode    *node = g_slice_new (DirNode);
+  GPtrArray  *tasks = g_ptr_array_new ();
+  GError     *err = NULL;
+  gpointer    args[2];
+  guint64     bytes = 0;
+  gint        n_dirs = 0;
+  guint       i;
+
+  node->parent = task->parent;
+  node->path = g_strdup (task->path);
+  node->failed = 0;
+  args[0] = node;
+  args[1] = tasks;
+  if (! nw_walk_directory (node->path, collect_entry, args, &err)) {
+    g_ptr_array_foreach (tasks, (GFunc) task_free, NULL);
+    g_ptr_array_free (tasks, TRUE);
+    g_free (node->path);
+    g_slice_free (DirNode, node);
+    add_found (worker->self, 0, -1);
+    worker_add_error (worker, err);
+    worker_complete_task (worker, task, FALSE);
+    return;
+  }
+  /* the progress follows the listings when the selection wasn't counted
+   * beforehand */
+  for (i = 0; i < tasks->len; i++) {
+    const NwWalkEntry *info = &((Task *) g_ptr_array_index (tasks, i))->info;
+
+    if (S_ISDIR (info->mode)) {
+      n_dirs ++;
+    } else if (S_ISREG (info->mode)) {
+      bytes += MIN (info->size, info->allocated);
+    }
+  }
+  add_found (worker->self, bytes, n_dirs - 1);
+  /* hold the node while queuing so it can't be removed under our feet */
+  node->pending = (gint) tasks->len + 1;
+  g_atomic_int_add (&worker->pool->pending, (gint) tasks->len);
+  /* pushed in reverse so they are taken in the listing order */
+  for (i = tasks->len; i > 0; i--) {
+    worker_push_task (worker, g_ptr_array_index (tasks, i - 1));
+  }
+  g_ptr_array_free (tasks, TRUE);
+  /* the node took over the directory's place in its parent */
+  worker_drop_task (worker, task);
+  dir_node_release (worker, node, TRUE);
+}
+
+/* checks whether the data of @task is wiped through another path, either a
+ * hard link or the same file selected twice.  Counts it in the report if so */
+static gboolean
+is_wiped_elsewhere (Worker *worker,
+                    Task   *task)
+{
+  NwDeleteOperation  *self = worker->self;
+  gboolean            known;
+
+  if (task->info.n_links <= 1 && task->parent) {
+    /* the only path to its inode, no need to remember it */
+    return FALSE;
+  }
+  g_mutex_lock (&self->priv->mutex);
+  known = ! nw_walk_inode_set_add (self->priv->inodes, &task->info);
+  if (known) {
+    self->priv->links_unlinked ++;
+    self->priv->links_saved += MIN (task->info.size, task->info.allocated) *
+                               self->priv->n_passes;
+  }
+  g_mutex_unlock (&self->priv->mutex);
+
+  return known;
+}
+
+/* checks whether overwriting @task would leave its data in place, see
+ * nw_device_file_is_copy_on_write().  Counts it in the report if so */
+static gboolean
+is_copy_on_write (Worker *worker,
+                  Task   *task)
+{
+  NwDeleteOperation  *self = worker->self;
+  gint64              device = (gint64) task->info.device;
+  gpointer            may_cow;
+  guint               i;
+
+  if (MIN (task->info.size, task->info.allocated) == 0) {
+    /* no data to reach */
+    return FALSE;
+  }
+  /* only files of some file systems need a closer look */
+  if (! g_hash_table_lookup_extended (worker->cow_devices, &device,
+                                      NULL, &may_cow)) {
+    gint64 *key = g_new (gint64, 1);
+
+    *key = device;
+    may_cow = GINT_TO_POINTER (nw_device_may_copy_on_write (AT_FDCWD,
+                                                            task->path));
+    g_hash_table_insert (worker->cow_devices, key, may_cow);
+  }
+  if (! may_cow || ! nw_device_file_is_copy_on_write (AT_FDCWD, task->path)) {
+    return FALSE;
+  }
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->cow_files ++;
+  self->priv->cow_bytes += MIN (task->info.size, task->info.allocated);
+  /* remember a path per device to find what to fill afterwards */
+  for (i = 0; i < self->priv->cow_devices->len; i++) {
+    if (g_array_index (self->priv->cow_devices, dev_t, i) == task->info.device) {
+      break;
+    }
+  }
+  if (i == self->priv->cow_devices->len) {
+    g_array_append_val (self->priv->cow_devices, task->info.device);
+    self->priv->cow_paths = g_list_append (self->priv->cow_paths,
+                                           g_path_get_dirname (task->path));
+  }
+  g_mutex_unlock (&self->priv->mutex);
+
+  return TRUE;
+}
+
+/* wipes @task, or queues its entries if it is a directory */
+static void
+worker_run_task (Worker       *worker,
+                 NwOverwriter *overwriter,
+                 Task         *task)
+{
+  NwDeleteOperation  *self = worker->self;
+  GError             *err = NULL;
+  gboolean            success = TRUE;
+
+  if (task->info.mode == 0) {
+    /* a selected item, only known once stat'ed */
+    if (! nw_walk_stat (AT_FDCWD, task->path, &task->info)) {
+      gint   errsv = errno;
+      gchar *display_name = g_filename_display_name (task->path);
+
+      g_set_error (&err, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   _("Failed to stat \"%s\": %s"),
+                   display_name, g_strerror (errsv));
+      g_free (display_name);
+      add_found (self, 0, -1);
+      worker_add_error (worker, err);
+      worker_complete_task (worker, task, FALSE);
+      return;
+    } else if (S_ISREG (task->info.mode)) {
+      add_found (self, MIN (task->info.size, task->info.allocated), -1);
+    } else if (! S_ISDIR (task->info.mode)) {
+      add_found (self, 0, -1);
+    }
+  }
+  if (S_ISDIR (task->info.mode)) {
+    queue_directory (worker, task);
+    return;
+  } else if (S_ISREG (task->info.mode) && is_wiped_elsewhere (worker, task)) {
+    /* the data is gone already, only this name is left */
+    success = nw_overwrite_remove (task->path, &err);
+  } else if (S_ISREG (task->info.mode) && is_copy_on_write (worker, task)) {
+    /* overwriting would only write new blocks, don't pretend */
+    success = nw_overwrite_remove (task->path, &err);
+  } else if (S_ISREG (task->info.mode)) {
+    if (self->priv->batch_size > 1 &&
+        task->info.size <= self->priv->batch_threshold) {
+      batch_task (worker, overwriter, task);
+      return;
+    }
+    worker_reset_progress (worker);
+    g_atomic_int_set (&worker->busy, 1);
+    success = nw_overwriter_wipe_file (overwriter, task->path, &err);
+    g_atomic_int_set (&worker->busy, 0);
+  } else {
+    /* links and special files have no data of their own */
+    success = nw_overwrite_remove (task->path, &err);
+  }
+  worker_add_error (worker, err);
+  worker_complete_task (worker, task, success);
+}
+
+/* gets the next task for @worker, blocking while paused, or while there is
+ * none right now but other workers of the pool may still find some.
+ * Returns: A task, or %NULL when the pool's work is over or canceled */
+static Task *
+worker_next_task (Worker       *worker,
+                  NwOverwriter *overwriter)
+{
+  NwDeleteOperation  *self = worker->self;
+  WorkerPool         *pool = worker->pool;
+  Task               *task = NULL;
+  gboolean            keep_going;
+
+  g_mutex_lock (&self->priv->mutex);
+  keep_going = wait_while_paused (self);
+  g_mutex_unlock (&self->priv->mutex);
+  if (! keep_going) {
+    return NULL;
+  }
+  task = worker_steal_task (worker);
+  if (task) {
+    return task;
+  }
+  /* nothing to do right now, others may be waiting for our batch */
+  flush_batch (worker, overwriter);
+
+  g_mutex_lock (&self->priv->mutex);
+  g_atomic_int_inc (&pool->n_idle);
+  while (wait_while_paused (self) &&
+         g_atomic_int_get (&pool->pending) > 0 &&
+         ! (task = worker_steal_task (worker))) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+  g_atomic_int_add (&pool->n_idle, -1);
+  g_mutex_unlock (&self->priv->mutex);
+
+  return task;
+}
+
+/* lists a directory on each file system holding paths of @groups stored on a
+ * device supporting discard */
+static GList *
+get_trim_paths (GList *groups)
+{
+  GList  *trim_paths = NULL;
+  GArray *devices = g_array_new (FALSE, FALSE, sizeof (dev_t));
+  GList  *item;
+
+  for (item = groups; item; item = item->next) {
+    NwDeviceGroup  *group = item->data;
+    GList          *path;
+
+    if (! group->discard) {
+      continue;
+    }
+    for (path = group->paths; path; path = path->next) {
+      gchar      *dir = g_path_get_dirname (path->data);
+      struct stat st;
+      guint       i;
+
+      if (g_stat (dir, &st) == 0) {
+        for (i = 0; i < devices->len; i++) {
+          if (g_array_index (devices, dev_t, i) == st.st_dev) {
+            break;
+          }
+        }
+        if (i == devices->len) {
+          g_array_append_val (devices, st.st_dev);
+          trim_paths = g_list_prepend (trim_paths, dir);
+          dir = NULL;
+        }
+      }
+      g_free (dir);
+    }
+  }
+  g_array_free (devices, TRUE);
+
+  return g_list_reverse (trim_paths);
+}
+
+/* discards the unused blocks of the file systems the wiped files were on, so
+ * the devices drop what's left of their data.  Failures end up in the report,
+ * as the user asked for it and the devices may still hold the data */
+static void
+trim_file_systems (NwDeleteOperation *self)
+{
+  GList *item;
+
+  for (item = self->priv->trim_paths; item; item = item->next) {
+    GError *err = NULL;
+
+    if (! nw_device_trim (item->data, &err)) {
+      gchar *name = g_filename_display_name (item->data);
+
+      g_mutex_lock (&self->priv->mutex);
+      if (! self->priv->trim_failures) {
+        self->priv->trim_failures = g_string_new (NULL);
+      } else {
+        g_string_append_c (self->priv->trim_failures, '\n');
+      }
+      g_string_append_printf (self->priv->trim_failures,
+                              _("The unused blocks of \"%s\" were not "
+                                "discarded, its device may still hold the "
+                                "wiped data: %s"), name, err->message);
+      g_mutex_unlock (&self->priv->mutex);
+      g_free (name);
+      g_clear_error (&err);
+    }
+  }
+}
+
+static gpointer
+nw_delete_operation_worker (gpointer data)
+{
+  Worker             *worker = data;
+  NwDeleteOperation  *self = worker->self;
+  NwOverwriter       *overwriter;
+  GError             *err = NULL;
+  Task               *task;
+  gboolean            fast;
+  gboolean            zeroise;
+  gboolean            last;
+  gboolean            canceled;
+  GsdSecureDeleteOperationMode mode;
+
+  g_object_get (self,
+                "fast", &fast,
+                "mode", &mode,
+                "zeroise", &zeroise,
+                NULL);
+  nw_throttle_apply_io_class (self->priv->io_class);
+  overwriter = nw_overwriter_new (mode, fast, zeroise, &err);
+  if (! overwriter) {
+    worker_add_error (worker, err);
+  } else {
+    guint64 zero_offloaded;
+    guint64 zero_written;
+
+    if (self->priv->engine == NW_OPERATION_ENGINE_IO_URING &&
+        ! nw_overwriter_enable_uring (overwriter, &err)) {
+      g_debug ("Falling back to synchronous writes: %s", err->message);
+      g_clear_error (&err);
+    }
+    nw_overwriter_set_check_func (overwriter, overwrite_check_func, worker);
+    nw_overwriter_set_sync_policy (overwriter, self->priv->sync_policy);
+    nw_overwriter_set_direct_io (overwriter, self->priv->direct_io);
+    worker->batch = g_ptr_array_new ();
+    worker->cow_devices = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                                 g_free, NULL);
+    while ((task = worker_next_task (worker, overwriter))) {
+      worker_run_task (worker, overwriter, task);
+    }
+    /* wipe what's left in the batch */
+    flush_batch (worker, overwriter);
+    g_ptr_array_free (worker->batch, TRUE);
+    worker->batch = NULL;
+    g_hash_table_destroy (worker->cow_devices);
+    worker->cow_devices = NULL;
+    nw_overwriter_get_zero_stats (overwriter, &zero_offloaded, &zero_written);
+    g_mutex_lock (&self->priv->mutex);
+    self->priv->zero_offloaded += zero_offloaded;
+    self->priv->zero_written += zero_written;
+    self->priv->cache_released += nw_overwriter_get_cache_released (overwriter);
+    g_mutex_unlock (&self->priv->mutex);
+    nw_overwriter_free (overwriter);
+  }
+  /* give up on what is left in our queue, if we could not wipe anything.
+   * When canceled, also on what is left to the others */
+  g_mutex_lock (&self->priv->mutex);
+  canceled = self->priv->canceled;
+  g_mutex_unlock (&self->priv->mutex);
+  for (;;) {
+    g_mutex_lock (&worker->lock);
+    task = g_queue_pop_head (&worker->tasks);
+    g_mutex_unlock (&worker->lock);
+    if (! task && canceled) {
+      task = worker_steal_task (worker);
+    }
+    if (! task) {
+      break;
+    }
+    worker_complete_task (worker, task, FALSE);
+  }
+
+  g_mutex_lock (&self->priv->mutex);
+  last = -- self->priv->n_running == 0;
+  canceled = self->priv->canceled;
+  if (canceled) {
+    /* workers stopped between files didn't get to report it */
+    GError *cancel_error = g_error_new (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                        _("Operation canceled"));
+
+    add_error_message (self, cancel_error);
+    g_error_free (cancel_error);
+  }
+  g_mutex_unlock (&self->priv->mutex);
+  if (last) {
+    if (! canceled) {
+      trim_file_systems (self);
+    }
+    /* the run's reference is dropped once finished has been emitted */
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, emit_finished_idle,
+                     self, g_object_unref);
+  }
+
+  return NULL;
+}
+
+/* checks whether @group has a directory to wipe, whose content can keep
+ * several workers busy even if it is the only path */
+static gboolean
+group_has_directory (NwDeviceGroup *group)
+{
+  GList *item;
+
+  for (item = group->paths; item; item = item->next) {
+    NwWalkEntry entry;
+
+    if (nw_walk_stat (AT_FDCWD, item->data, &entry) && S_ISDIR (entry.mode)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* starts the workers for @group: a single one on rotational devices not to
+ * make the heads seek back and forth, a few on SSDs and alike.  They share
+ * the group's paths and the content of its directories as it is discovered,
+ * idle ones stealing from the busy ones.  Must be called with the mutex held */
+static gboolean
+start_group_workers (NwDeleteOperation *self,
+                     NwDeviceGroup     *group,
+                     GError           **error)
+{
+  WorkerPool *pool;
+  guint       n_paths = g_list_length (group->paths);
+  guint       n_workers = 1;
+  guint       n_started;
+  GList      *item;
+  guint       i;
+
+  if (n_paths == 0) {
+    return TRUE;
+  }
+  if (! group->rotational) {
+    n_workers = group_has_directory (group)
+              ? NW_DELETE_OPERATION_MAX_DEVICE_WORKERS
+              : MIN (n_paths, NW_DELETE_OPERATION_MAX_DEVICE_WORKERS);
+  }
+  pool = g_slice_new (WorkerPool);
+  pool->workers = g_ptr_array_new ();
+  pool->pending = (gint) n_paths;
+  pool->n_idle = 0;
+  self->priv->n_unlisted += n_paths;
+  g_ptr_array_add (self->priv->pools, pool);
+  for (i = 0; i < n_workers; i++) {
+    Worker *worker = g_slice_new (Worker);
+
+    worker->self = self;
+    worker->pool = pool;
+    worker->thread = NULL;
+    g_mutex_init (&worker->lock);
+    g_queue_init (&worker->tasks);
+    worker->pass = 0;
+    worker->busy = 0;
+    worker->progress = 0;
+    worker->pass_written = 0;
+    worker->batch = NULL;
+    worker->batch_device = 0;
+    worker->batch_flushing = 0;
+    worker->cow_devices = NULL;
+    g_ptr_array_add (pool->workers, worker);
+  }
+  /* deal the paths before starting, the workers quit when there is none */
+  for (item = group->paths, i = 0; item; item = item->next, i++) {
+    Worker *worker = g_ptr_array_index (pool->workers, i % n_workers);
+
+    g_queue_push_tail (&worker->tasks, task_new (item->data, NULL, NULL));
+  }
+  for (n_started = 0; n_started < n_workers; n_started++) {
+    Worker *worker = g_ptr_array_index (pool->workers, n_started);
+
+    worker->thread = g_thread_try_new ("nw-delete", nw_delete_operation_worker,
+                                       worker, n_started > 0 ? NULL : error);
+    if (! worker->thread) {
+      break;
+    }
+    g_ptr_array_add (self->priv->workers, worker);
+    self->priv->n_running ++;
+  }
+  if (n_started == 0) {
+    for (i = 0; i < n_workers; i++) {
+      Worker *worker = g_ptr_array_index (pool->workers, i);
+
+      g_queue_foreach (&worker->tasks, (GFunc) task_free, NULL);
+      g_queue_clear (&worker->tasks);
+      g_mutex_clear (&worker->lock);
+      g_slice_free (Worker, worker);
+    }
+    g_ptr_array_set_size (pool->workers, 0);
+    self->priv->n_unlisted -= n_paths;
+    return FALSE;
+  }
+  /* the others of this group will steal the paths dealt to the ones that
+   * could not start, and free them once done */
+  for (i = n_started; i < n_workers; i++) {
+    g_ptr_array_add (self->priv->workers, g_ptr_array_index (pool->workers, i));
+  }
+
+  return TRUE;
+}
+
+static gboolean
+run_native (NwDeleteOperation *self,
+            GError           **error)
+{
+  GsdSecureDeleteOperationMode mode;
+  GList *item;
+
+  if (self->priv->workers) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                 _("Operation is already running"));
+    return FALSE;
+  }
+  g_object_get (self, "mode", &mode, NULL);
+  self->priv->n_passes = nw_overwrite_count_passes (mode);
+
+  self->priv->paused = FALSE;
+  self->priv->canceled = FALSE;
+  self->priv->cancel_reported = FALSE;
+  self->priv->files_done = 0;
+  self->priv->zero_offloaded = 0;
+  self->priv->zero_written = 0;
+  self->priv->cache_released = 0;
+  self->priv->inodes = nw_walk_inode_set_new ();
+  self->priv->links_unlinked = 0;
+  self->priv->links_saved = 0;
+  self->priv->cow_files = 0;
+  self->priv->cow_bytes = 0;
+  g_array_set_size (self->priv->cow_devices, 0);
+  nw_path_list_free (self->priv->cow_paths);
+  self->priv->cow_paths = NULL;
+  if (self->priv->trim_failures) {
+    g_string_free (self->priv->trim_failures, TRUE);
+    self->priv->trim_failures = NULL;
+  }
+  self->priv->bytes_written = 0;
+  self->priv->found_bytes = 0;
+  self->priv->n_unlisted = 0;
+  nw_throttle_reset (self->priv->throttle);
+  if (self->priv->scan) {
+    /* started while the user confirmed.  Waiting for it to finish would walk
+     * the selection twice before wiping anything, so if it isn't done the
+     * workers count what they find instead */
+    self->priv->groups = nw_scan_steal_device_groups (self->priv->scan);
+    if (! nw_scan_is_done (self->priv->scan)) {
+      nw_scan_free (self->priv->scan);
+      self->priv->scan = NULL;
+    }
+  }
+  if (! self->priv->groups) {
+    self->priv->groups = nw_device_group_paths (self->priv->paths);
+  }
+  if (self->priv->discard) {
+    self->priv->trim_paths = get_trim_paths (self->priv->groups);
+  }
+  self->priv->workers = g_ptr_array_new ();
+  self->priv->pools = g_ptr_array_new ();
+  self->priv->n_running = 0;
+  self->priv->n_errors = 0;
+
+  /* hold the lock until all workers are started so none can think it is the
+   * last one too early */
+  g_mutex_lock (&self->priv->mutex);
+  for (item = self->priv->groups; item; item = item->next) {
+    GError *err = NULL;
+
+    if (! start_group_workers (self, item->data, &err)) {
+      /* report it at the end rather than aborting the other devices */
+      add_error_message (self, err);
+      g_clear_error (&err);
+    }
+  }
+  if (self->priv->n_running == 0) {
+    g_mutex_unlock (&self->priv->mutex);
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
+                 self->priv->messages ? self->priv->messages->str
+                                      : _("Failed to start wiping"));
+    if (self->priv->messages) {
+      g_string_free (self->priv->messages, TRUE);
+      self->priv->messages = NULL;
+    }
+    cleanup_workers (self);
+    return FALSE;
+  }
+  g_object_ref (self);
+  g_mutex_unlock (&self->priv->mutex);
+
+  return TRUE;
+}
+
+static gboolean
+nw_delete_operation_real_run (NwOperation *operation,
+                              GError     **error)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (operation);
+
+  if (self->priv->engine == NW_OPERATION_ENGINE_SECURE_DELETE) {
+    GList    *item;
+    gint      priority;
+    gboolean  success;
+
+    for (item = self->priv->paths; item; item = item->next) {
+      gsd_delete_operation_add_path (GSD_DELETE_OPERATION (self), item->data);
+    }
+
+    /* srm(1) inherits the I/O priority when spawned */
+    priority = nw_throttle_apply_io_class (self->priv->io_class);
+    success = gsd_secure_delete_operation_run (GSD_SECURE_DELETE_OPERATION (self),
+                                               error);
+    nw_throttle_restore_io_priority (priority);
+
+    return success;
+  } else {
+    return run_native (self, error);
+  }
+}
+
+static gboolean
+nw_delete_operation_real_pause (NwOperation *operation)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (operation);
+
+  if (self->priv->engine == NW_OPERATION_ENGINE_SECURE_DELETE) {
+    return gsd_async_operation_pause (GSD_ASYNC_OPERATION (self));
+  }
+
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->paused = self->priv->workers != NULL;
+  g_mutex_unlock (&self->priv->mutex);
+
+  return self->priv->paused;
+}
+
+static gboolean
+nw_delete_operation_real_resume (NwOperation *operation)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (operation);
+
+  if (self->priv->engine == NW_OPERATION_ENGINE_SECURE_DELETE) {
+    return gsd_async_operation_resume (GSD_ASYNC_OPERATION (self));
+  }
+
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->paused = FALSE;
+  g_cond_broadcast (&self->priv->cond);
+  g_mutex_unlock (&self->priv->mutex);
+
+  return TRUE;
+}
+
+static void
+nw_delete_operation_real_cancel (NwOperation *operation)
+{
+  NwDeleteOperation *self = NW_DELETE_OPERATION (operation);
+
+  if (self->priv->engine == NW_OPERATION_ENGINE_SECURE_DELETE) {
+    gsd_async_operation_cancel (GSD_ASYNC_OPERATION (self));
+  } else {
+    g_mutex_lock (&self->priv->mutex);
+    self->priv->canceled = TRUE;
+    g_cond_broadcast (&self->priv->cond);
+    g_mutex_unlock (&self->priv->mutex);
+    nw_throttle_cancel (self->priv->throttle);
+  }
+}
+
 NwOperation *
 nw_delete_operation_new (void)
 {
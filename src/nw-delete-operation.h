@@ -40,9 +40,11 @@ G_BEGIN_DECLS
 
 typedef struct _NwDeleteOperation         NwDeleteOperation;
 typedef struct _NwDeleteOperationClass    NwDeleteOperationClass;
+typedef struct _NwDeleteOperationPrivate  NwDeleteOperationPrivate;
 
 struct _NwDeleteOperation {
   GsdDeleteOperation parent;
+  NwDeleteOperationPrivate *priv;
 };
 
 struct _NwDeleteOperationClass {
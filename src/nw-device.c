@@ -0,0 +1,585 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Block device lookups, used to schedule work per physical disk */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-device.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+#include "nw-path-list.h"
+
+
+/* gets the sysfs directory of the whole disk holding @device, or %NULL if
+ * @device isn't a known block device (e.g. a btrfs subvolume or tmpfs) */
+static gchar *
+get_disk_sysfs_path (dev_t device)
+{
+  gchar *link_path;
+  gchar *path;
+  gchar *partition;
+
+  link_path = g_strdup_printf ("/sys/dev/block/%u:%u",
+                               major (device), minor (device));
+  path = realpath (link_path, NULL);
+  g_free (link_path);
+  if (path) {
+    /* partitions are subdirectories of their disk */
+    partition = g_build_filename (path, "partition", NULL);
+    if (g_file_test (partition, G_FILE_TEST_EXISTS)) {
+      gchar *parent = g_path_get_dirname (path);
+
+      free (path);
+      path = strdup (parent);
+      g_free (parent);
+    }
+    g_free (partition);
+  }
+
+  return path;
+}
+
+static gchar *
+read_sysfs_file (const gchar *dir,
+                 const gchar *name)
+{
+  gchar  *filename = g_build_filename (dir, name, NULL);
+  gchar  *contents = NULL;
+
+  if (g_file_get_contents (filename, &contents, NULL, NULL)) {
+    g_strstrip (contents);
+  }
+  g_free (filename);
+
+  return contents;
+}
+
+/*
+ * nw_device_get_disk:
+ * @device: A device number, as found in #stat's st_dev
+ * 
+ * Finds the whole-disk device @device belongs to, so partitions of the same
+ * disk can be told apart from separate disks.
+ * 
+ * Returns: The disk's device number, or @device if it can't be found.
+ */
+dev_t
+nw_device_get_disk (dev_t device)
+{
+  gchar  *path = get_disk_sysfs_path (device);
+  dev_t   disk = device;
+
+  if (path) {
+    gchar  *dev = read_sysfs_file (path, "dev");
+    guint   maj;
+    guint   min;
+
+    if (dev && sscanf (dev, "%u:%u", &maj, &min) == 2) {
+      disk = makedev (maj, min);
+    }
+    g_free (dev);
+    free (path);
+  }
+
+  return disk;
+}
+
+/*
+ * nw_device_get_queue_uint64:
+ * @device: A device number, as found in #stat's st_dev
+ * @attribute: The name of a file in the disk's queue/ sysfs directory
+ * @fallback: Value to return if the attribute can't be read
+ * 
+ * Reads a numeric queue attribute of the disk holding @device, like
+ * "rotational" or "discard_max_bytes".
+ * 
+ * Returns: The attribute's value, or @fallback.
+ */
+guint64
+nw_device_get_queue_uint64 (dev_t        device,
+                            const gchar *attribute,
+                            guint64      fallback)
+{
+  gchar    *path = get_disk_sysfs_path (device);
+  guint64   value = fallback;
+
+  if (path) {
+    gchar  *queue = g_build_filename (path, "queue", NULL);
+    gchar  *contents = read_sysfs_file (queue, attribute);
+
+    if (contents && g_ascii_isdigit (contents[0])) {
+      value = g_ascii_strtoull (contents, NULL, 10);
+    }
+    g_free (contents);
+    g_free (queue);
+    free (path);
+  }
+
+  return value;
+}
+
+/*
+ * nw_device_is_rotational:
+ * @device: A device number, as found in #stat's st_dev
+ * 
+ * Checks whether @device has a seek penalty.  Devices we know nothing about
+ * are assumed to be rotational, as treating a disk as an SSD is what hurts.
+ * 
+ * Returns: %TRUE if @device is or may be rotational, %FALSE otherwise.
+ */
+gboolean
+nw_device_is_rotational (dev_t device)
+{
+  return nw_device_get_queue_uint64 (device, "rotational", 1) != 0;
+}
+
+/*
+ * nw_device_supports_discard:
+ * @device: A device number, as found in #stat's st_dev
+ * 
+ * Checks whether @device can be told that blocks are unused, which is the case
+ * of SSDs and thin-provisioned volumes.
+ * 
+ * Returns: %TRUE if @device supports discarding, %FALSE otherwise.
+ */
+gboolean
+nw_device_supports_discard (dev_t device)
+{
+  return nw_device_get_queue_uint64 (device, "discard_max_bytes", 0) != 0;
+}
+
+/*
+ * nw_device_paths_support_discard:
+ * @paths: A list of paths
+ * 
+ * Checks whether any of @paths is stored on a device supporting discarding.
+ * 
+ * Returns: %TRUE if discarding is useful for some of @paths, %FALSE otherwise.
+ */
+gboolean
+nw_device_paths_support_discard (GList *paths)
+{
+  GList *item;
+
+  for (item = paths; item; item = item->next) {
+    struct stat st;
+
+    if (g_lstat (item->data, &st) == 0 && nw_device_supports_discard (st.st_dev)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/*
+ * nw_device_get_io_stats:
+ * @device: A device number, as found in #stat's st_dev
+ * @stats: return location for the counters
+ * 
+ * Reads the I/O counters of the whole disk holding @device from
+ * /proc/diskstats.  They cover all the I/O of the disk, whoever does it, so
+ * comparing two samples tells whether the disk was used in between.
+ * 
+ * Returns: %TRUE on success, %FALSE if @device has no known counters.
+ */
+gboolean
+nw_device_get_io_stats (dev_t            device,
+                        NwDeviceIoStats *stats)
+{
+  dev_t     disk = nw_device_get_disk (device);
+  gboolean  found = FALSE;
+  gchar    *contents;
+  gchar   **lines;
+  guint     i;
+
+  if (! g_file_get_contents ("/proc/diskstats", &contents, NULL, NULL)) {
+    return FALSE;
+  }
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; ! found && lines[i]; i++) {
+    guint   maj;
+    guint   min;
+    guint64 reads;
+    guint64 writes;
+    guint64 in_flight;
+
+    /* major minor name reads merged sectors ms writes merged sectors ms
+     * in_flight ... */
+    if (sscanf (lines[i], "%u %u %*s %" G_GUINT64_FORMAT " %*s %*s %*s "
+                "%" G_GUINT64_FORMAT " %*s %*s %*s %" G_GUINT64_FORMAT,
+                &maj, &min, &reads, &writes, &in_flight) == 5 &&
+        makedev (maj, min) == disk) {
+      stats->reads = reads;
+      stats->writes = writes;
+      stats->in_flight = in_flight;
+      found = TRUE;
+    }
+  }
+  g_strfreev (lines);
+  g_free (contents);
+
+  return found;
+}
+
+/*
+ * nw_device_can_trim:
+ * 
+ * Checks whether this process is allowed to discard the unused blocks of file
+ * systems with nw_device_trim(), which takes the CAP_SYS_ADMIN capability.
+ * 
+ * Returns: %TRUE if nw_device_trim() may succeed, %FALSE if it would fail.
+ */
+gboolean
+nw_device_can_trim (void)
+{
+#if defined (__linux__) && defined (FITRIM)
+  gboolean  can_trim = FALSE;
+  gchar    *contents;
+  gchar    *line;
+
+  if (! g_file_get_contents ("/proc/self/status", &contents, NULL, NULL)) {
+    return geteuid () == 0;
+  }
+  line = strstr (contents, "\nCapEff:");
+  if (line) {
+    guint64 caps = g_ascii_strtoull (line + strlen ("\nCapEff:"), NULL, 16);
+
+    /* CAP_SYS_ADMIN is capability 21 */
+    can_trim = (caps & (G_GUINT64_CONSTANT (1) << 21)) != 0;
+  }
+  g_free (contents);
+
+  return can_trim;
+#else
+  return FALSE;
+#endif
+}
+
+/*
+ * nw_device_trim:
+ * @path: Path to a file or directory
+ * @error: return location for errors, or %NULL to ignore them
+ * 
+ * Discards all the unused blocks of the file system holding @path, so that the
+ * device drops the data that was stored in them, like fstrim(8) does.  This
+ * generally requires administrator privileges.
+ * 
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+nw_device_trim (const gchar  *path,
+                GError      **error)
+{
+#if defined (__linux__) && defined (FITRIM)
+  struct fstrim_range range;
+  gboolean            success = TRUE;
+  gint                fd;
+
+  fd = g_open (path, O_RDONLY | O_NOCTTY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    gint errsv = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                 _("Failed to open \"%s\": %s"), path, g_strerror (errsv));
+    return FALSE;
+  }
+  memset (&range, 0, sizeof range);
+  range.len = G_MAXUINT64;
+  if (ioctl (fd, FITRIM, &range) != 0) {
+    gint errsv = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                 _("Failed to discard unused blocks: %s"), g_strerror (errsv));
+    success = FALSE;
+  }
+  close (fd);
+
+  return success;
+#else
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+               _("Failed to discard unused blocks: %s"),
+               g_strerror (ENOSYS));
+  return FALSE;
+#endif
+}
+
+#ifdef __linux__
+/* file systems whose writes may not land where the data was, from statfs(2) */
+#define NW_BTRFS_SUPER_MAGIC    0x9123683E
+#define NW_XFS_SUPER_MAGIC      0x58465342
+#define NW_OCFS2_SUPER_MAGIC    0x7461636F
+#define NW_ZFS_SUPER_MAGIC      0x2FC12FC1
+#define NW_BCACHEFS_SUPER_MAGIC 0xCA451A4E
+
+/* number of extents read at once when looking for shared ones */
+#define NW_FIEMAP_EXTENTS 32
+
+/* gets the type of the file system holding @name, relative to @dir_fd */
+static gboolean
+get_fs_type (gint         dir_fd,
+             const gchar *name,
+             guint32     *type)
+{
+  struct statfs st;
+  gint          fd;
+  gint          ret;
+
+  fd = openat (dir_fd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    return FALSE;
+  }
+  ret = fstatfs (fd, &st);
+  close (fd);
+  if (ret != 0) {
+    return FALSE;
+  }
+  *type = (guint32) st.f_type;
+
+  return TRUE;
+}
+
+/* checks whether any extent of the file @fd is shared with another file, as
+ * reflinked copies and snapshots do */
+static gboolean
+has_shared_extents (gint fd)
+{
+  guint64         buffer[(sizeof (struct fiemap) +
+                          NW_FIEMAP_EXTENTS * sizeof (struct fiemap_extent)) /
+                         sizeof (guint64)];
+  struct fiemap  *map = (struct fiemap *) buffer;
+  guint64         start = 0;
+  gboolean        last = FALSE;
+
+  while (! last) {
+    guint i;
+
+    memset (buffer, 0, sizeof buffer);
+    map->fm_start = start;
+    map->fm_length = FIEMAP_MAX_OFFSET - start;
+    map->fm_extent_count = NW_FIEMAP_EXTENTS;
+    if (ioctl (fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0) {
+      break;
+    }
+    for (i = 0; i < map->fm_mapped_extents; i++) {
+      const struct fiemap_extent *extent = &map->fm_extents[i];
+
+      if (extent->fe_flags & FIEMAP_EXTENT_SHARED) {
+        return TRUE;
+      }
+      last = (extent->fe_flags & FIEMAP_EXTENT_LAST) != 0;
+      start = extent->fe_logical + extent->fe_length;
+    }
+  }
+
+  return FALSE;
+}
+#endif
+
+/*
+ * nw_device_may_copy_on_write:
+ * @dir_fd: A directory file descriptor, or AT_FDCWD
+ * @name: Path of a file or directory, relative to @dir_fd
+ *
+ * Checks whether the file system holding @name may write data elsewhere than
+ * where it was, either always or for the files sharing their data.  Cheap
+ * enough to be asked once per directory before checking files with
+ * nw_device_file_is_copy_on_write().
+ *
+ * Returns: %TRUE if the files of that file system need checking.
+ */
+gboolean
+nw_device_may_copy_on_write (gint         dir_fd,
+                             const gchar *name)
+{
+#ifdef __linux__
+  guint32 type;
+
+  if (! get_fs_type (dir_fd, name, &type)) {
+    return FALSE;
+  }
+  switch (type) {
+    case NW_BTRFS_SUPER_MAGIC:
+    case NW_XFS_SUPER_MAGIC:
+    case NW_OCFS2_SUPER_MAGIC:
+    case NW_ZFS_SUPER_MAGIC:
+    case NW_BCACHEFS_SUPER_MAGIC:
+      return TRUE;
+  }
+#endif
+
+  return FALSE;
+}
+
+/*
+ * nw_device_file_is_copy_on_write:
+ * @dir_fd: A directory file descriptor, or AT_FDCWD
+ * @name: Path of a regular file, relative to @dir_fd
+ *
+ * Checks whether overwriting the file @name would write new blocks and leave
+ * its current data untouched.  This is the case of every file on ZFS and
+ * bcachefs, of those not marked "no copy-on-write" on btrfs, and of those
+ * sharing extents with another file (reflinks, snapshots) elsewhere.
+ *
+ * Returns: %TRUE if overwriting @name is useless.
+ */
+gboolean
+nw_device_file_is_copy_on_write (gint         dir_fd,
+                                 const gchar *name)
+{
+#ifdef __linux__
+  struct statfs st;
+  gboolean      cow = FALSE;
+  gint          fd;
+
+  fd = openat (dir_fd, name,
+               O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) {
+    return FALSE;
+  }
+  if (fstatfs (fd, &st) == 0) {
+    switch ((guint32) st.f_type) {
+      case NW_ZFS_SUPER_MAGIC:
+      case NW_BCACHEFS_SUPER_MAGIC:
+        cow = TRUE;
+        break;
+
+      case NW_BTRFS_SUPER_MAGIC: {
+        glong flags = 0;
+
+        if (ioctl (fd, FS_IOC_GETFLAGS, &flags) != 0 ||
+            ! (flags & FS_NOCOW_FL)) {
+          cow = TRUE;
+          break;
+        }
+        /* even "no copy-on-write" files are copied when in a snapshot */
+        cow = has_shared_extents (fd);
+        break;
+      }
+
+      case NW_XFS_SUPER_MAGIC:
+      case NW_OCFS2_SUPER_MAGIC:
+        cow = has_shared_extents (fd);
+        break;
+    }
+  }
+  close (fd);
+
+  return cow;
+#else
+  return FALSE;
+#endif
+}
+
+static gint
+compare_group_device (gconstpointer a,
+                      gconstpointer b)
+{
+  const NwDeviceGroup *group  = a;
+  const dev_t         *device = b;
+
+  return group->device == *device ? 0 : 1;
+}
+
+/*
+ * nw_device_group_paths:
+ * @paths: A list of paths
+ * 
+ * Splits @paths according to the physical device they are stored on.  Paths
+ * that cannot be stat()ed are grouped together on a fake device so the caller
+ * can still report their errors.
+ * 
+ * Returns: A list of #NwDeviceGroup, to be freed with
+ *          nw_device_group_list_free().
+ */
+GList *
+nw_device_group_paths (GList *paths)
+{
+  GList  *groups = NULL;
+  GList  *item;
+
+  for (item = paths; item; item = item->next) {
+    struct stat     st;
+    dev_t           device = 0;
+    GList          *found;
+    NwDeviceGroup  *group;
+
+    if (g_lstat (item->data, &st) == 0) {
+      device = nw_device_get_disk (st.st_dev);
+    }
+    found = g_list_find_custom (groups, &device, compare_group_device);
+    if (found) {
+      group = found->data;
+    } else {
+      group = g_slice_new (NwDeviceGroup);
+      group->device = device;
+      group->rotational = device == 0 || nw_device_is_rotational (device);
+      group->discard = device != 0 && nw_device_supports_discard (device);
+      group->paths = NULL;
+      groups = g_list_prepend (groups, group);
+    }
+    group->paths = g_list_prepend (group->paths, g_strdup (item->data));
+  }
+  for (item = groups; item; item = item->next) {
+    NwDeviceGroup *group = item->data;
+
+    group->paths = g_list_reverse (group->paths);
+  }
+
+  return g_list_reverse (groups);
+}
+
+void
+nw_device_group_free (NwDeviceGroup *group)
+{
+  nw_path_list_free (group->paths);
+  g_slice_free (NwDeviceGroup, group);
+}
+
+void
+nw_device_group_list_free (GList *groups)
+{
+  while (groups) {
+    nw_device_group_free (groups->data);
+    groups = g_list_delete_link (groups, groups);
+  }
+}
@@ -0,0 +1,91 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_DEVICE_H
+#define NW_DEVICE_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _NwDeviceGroup NwDeviceGroup;
+
+/**
+ * NwDeviceGroup:
+ * @device: The whole-disk device backing the paths, or the file system's
+ *          device if the backing disk is unknown
+ * @rotational: Whether the device has a seek penalty
+ * @discard: Whether the device supports discarding unused blocks
+ * @paths: The paths living on @device, in their original order
+ *
+ * A set of paths stored on the same physical device.
+ */
+struct _NwDeviceGroup {
+  dev_t     device;
+  gboolean  rotational;
+  gboolean  discard;
+  GList    *paths;
+};
+
+typedef struct _NwDeviceIoStats NwDeviceIoStats;
+
+/**
+ * NwDeviceIoStats:
+ * @reads: Number of reads completed on the disk
+ * @writes: Number of writes completed on the disk
+ * @in_flight: Number of requests currently in progress
+ *
+ * I/O counters of a disk, as found in /proc/diskstats.
+ */
+struct _NwDeviceIoStats {
+  guint64   reads;
+  guint64   writes;
+  guint64   in_flight;
+};
+
+
+dev_t     nw_device_get_disk                (dev_t        device);
+guint64   nw_device_get_queue_uint64        (dev_t        device,
+                                             const gchar *attribute,
+                                             guint64      fallback);
+gboolean  nw_device_is_rotational           (dev_t        device);
+gboolean  nw_device_supports_discard        (dev_t        device);
+gboolean  nw_device_paths_support_discard   (GList       *paths);
+gboolean  nw_device_get_io_stats            (dev_t            device,
+                                             NwDeviceIoStats *stats);
+gboolean  nw_device_can_trim                (void);
+gboolean  nw_device_trim                    (const gchar *path,
+                                             GError     **error);
+gboolean  nw_device_may_copy_on_write       (gint         dir_fd,
+                                             const gchar *name);
+gboolean  nw_device_file_is_copy_on_write   (gint         dir_fd,
+                                             const gchar *name);
+
+GList    *nw_device_group_paths             (GList         *paths);
+void      nw_device_group_free              (NwDeviceGroup *group);
+void      nw_device_group_list_free         (GList         *groups);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -100,11 +100,16 @@ nw_extension_init (NwExtension *self)
 /* Runs the wipe operation */
 static void
 nw_extension_run_delete_operation (GtkWindow *parent,
-                                   GList     *files)
+                                   GList     *selection)
 {
   gchar  *confirm_primary_text = NULL;
+  gchar  *confirm_secondary_text = NULL;
+  GList  *files;
+  guint   n_dropped;
   guint   n_items;
 
+  /* items inside a selected folder would be wiped twice */
+  files = nw_path_list_normalize (selection, &n_dropped);
   n_items = g_list_length (files);
   if (n_items > 1) {
     confirm_primary_text = g_strdup_printf (g_dngettext(GETTEXT_PACKAGE,
@@ -127,12 +132,35 @@ nw_extension_run_delete_operation (GtkWindow *parent,
                                             name);
     g_free (name);
   }
+  if (n_dropped > 0) {
+    confirm_secondary_text = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                                           "If you wipe an item, "
+                                                           "it will not be "
+                                                           "recoverable.\n\n"
+                                                           "%u selected item is "
+                                                           "selected twice or "
+                                                           "inside a selected "
+                                                           "folder, it will "
+                                                           "only be wiped once.",
+                                                           "If you wipe an item, "
+                                                           "it will not be "
+                                                           "recoverable.\n\n"
+                                                           "%u selected items "
+                                                           "are selected twice "
+                                                           "or inside a selected "
+                                                           "folder, they will "
+                                                           "only be wiped once.",
+                                                           n_dropped),
+                                              n_dropped);
+  }
   nw_operation_manager_run (
     parent, files,
     _("Wipe Files"),
     /* confirm dialog */
     confirm_primary_text,
-    _("If you wipe an item, it will not be recoverable."),
+    confirm_secondary_text ? confirm_secondary_text
+                           : _("If you wipe an item, it will not be "
+                               "recoverable."),
     _("_Wipe"),
     gtk_image_new_from_icon_name ("edit-delete", GTK_ICON_SIZE_BUTTON),
     /* progress dialog */
@@ -149,6 +177,8 @@ nw_extension_run_delete_operation (GtkWindow *parent,
                 n_items)
   );
   g_free (confirm_primary_text);
+  g_free (confirm_secondary_text);
+  nw_path_list_free (files);
 }
 
 /* Runs the fill operation */
@@ -25,8 +25,11 @@
 
 #include "nw-fill-operation.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 #include <glib-object.h>
 #include <gio/gio.h>
 #if HAVE_GIO_UNIX
@@ -34,8 +37,22 @@
 #endif
 #include <gsecuredelete.h>
 
+#include "nw-device.h"
+#include "nw-mount.h"
 #include "nw-operation.h"
+#include "nw-overwrite.h"
 #include "nw-path-list.h"
+#include "nw-throttle.h"
+
+
+/* precision of the progress of a native fill, shared as an integer */
+#define CHAIN_PROGRESS_SCALE 10000
+/* how often the disks are sampled in idle-only mode, in seconds */
+#define IDLE_POLL_INTERVAL 1
+/* requests per poll a disk can complete and still be considered unused.  A
+ * fill reads some metadata as it allocates blocks, and desktops keep doing a
+ * trickle of I/O that shouldn't hold the wipe forever */
+#define IDLE_IO_THRESHOLD 16
 
 
 GQuark
@@ -57,25 +74,105 @@ static void     nw_fill_operation_operation_iface_init    (NwOperationInterface
 static void     nw_fill_operation_real_add_file           (NwOperation *op,
                                                            const gchar *path);
 static gchar   *nw_fill_operation_real_get_progress_step  (NwOperation *op);
+static gchar   *nw_fill_operation_real_get_report         (NwOperation *op);
+static gchar   *nw_fill_operation_real_get_warnings       (NwOperation *op);
+static gboolean nw_fill_operation_real_run                (NwOperation *op,
+                                                           GError     **error);
+static gboolean nw_fill_operation_real_pause              (NwOperation *op);
+static gboolean nw_fill_operation_real_resume             (NwOperation *op);
+static void     nw_fill_operation_real_cancel             (NwOperation *op);
 static void     nw_fill_operation_finalize                (GObject *object);
-static void     nw_fill_operation_finished_handler        (GsdFillOperation *operation,
-                                                           gboolean          success,
-                                                           const gchar      *message,
-                                                           NwFillOperation  *self);
-static void     nw_fill_operation_progress_handler        (GsdFillOperation *operation,
-                                                           gdouble           fraction,
-                                                           NwFillOperation  *self);
-
+static void     nw_fill_operation_set_property            (GObject      *object,
+                                                           guint         prop_id,
+                                                           const GValue *value,
+                                                           GParamSpec   *pspec);
+static void     nw_fill_operation_get_property            (GObject    *object,
+                                                           guint       prop_id,
+                                                           GValue     *value,
+                                                           GParamSpec *pspec);
+
+
+/* a sequence of fill operations, run one after the other.  Each directory gets
+ * a fresh operation so the next one can start right from the finished handler
+ * of the previous one, which is still locked at this point.  With the native
+ * engines, each directory is filled by a thread instead */
+typedef struct {
+  NwFillOperation  *self;
+  GsdFillOperation *operation;   /* the operation currently running */
+  GThread          *thread;      /* the native fill running */
+  GList            *directories; /* left to fill, the first one being filled */
+  guint             n_done;
+  gdouble           fraction;    /* progress on the current directory */
+  gboolean          trimming;    /* whether discarding the filled blocks */
+  GError           *trim_error;
+
+  /* native fill state, shared with the thread */
+  volatile gint     pass;
+  volatile gint     progress;    /* scaled by CHAIN_PROGRESS_SCALE */
+  guint64           pass_written;
+  GError           *error;
+
+  /* idle-only scheduling */
+  dev_t             device;      /* the device of the current directory */
+  gboolean          has_stats;   /* whether @stats is a valid sample */
+  NwDeviceIoStats   stats;
+  gboolean          waiting;     /* held until the disk is idle */
+  gint64            wait_start;
+  gint64            quiet_since;
+} FillChain;
 
 struct _NwFillOperationPrivate {
   GList    *directories;
+  gboolean  parallel;
+  gboolean  discard;
+  NwOperationEngine engine;
+  gboolean  direct_io;
+  NwOperationIoClass io_class;
+  NwThrottle *throttle;
+  gboolean  idle_only;
+  guint     idle_interval;
 
   guint     n_op;
-  guint     n_op_done;
   GString  *message;
+  /* mounts of the directories added, and what to tell about them */
+  GHashTable *mounts;
+  GString  *warnings;
+
+  /* running state */
+  GList    *chains;
+  guint     n_chains_running;
+  gboolean  chains_failed;
+  guint     idle_source;
+  gint64    start_time;
+  gint64    end_time;
+  gint64    last_poll;
+  gint64    waited;     /* time all devices were held, in microseconds */
+  /* what to tell about directories whose unused blocks couldn't be
+   * discarded */
+  GString  *trim_failures;
+
+  /* native engine state */
+  GMutex            mutex;
+  GCond             cond;
+  gboolean          paused;
+  gboolean          canceled;
+  gboolean          cancel_reported;
+  guint             n_passes;
+  volatile gint     progress_pending;
+  guint64           cache_released;
+};
 
-  gulong    progress_hid;
-  gulong    finished_hid;
+enum
+{
+  PROP_0,
+  PROP_PARALLEL,
+  PROP_DISCARD,
+  PROP_ENGINE,
+  PROP_DIRECT_IO,
+  PROP_IO_CLASS,
+  PROP_BANDWIDTH_LIMIT,
+  PROP_IDLE_ONLY,
+  PROP_IDLE_INTERVAL
 };
 
 G_DEFINE_TYPE_WITH_CODE (NwFillOperation,
@@ -90,6 +187,12 @@ nw_fill_operation_operation_iface_init (NwOperationInterface *iface)
 {
   iface->add_file           = nw_fill_operation_real_add_file;
   iface->get_progress_step  = nw_fill_operation_real_get_progress_step;
+  iface->get_report         = nw_fill_operation_real_get_report;
+  iface->get_warnings       = nw_fill_operation_real_get_warnings;
+  iface->run                = nw_fill_operation_real_run;
+  iface->pause              = nw_fill_operation_real_pause;
+  iface->resume             = nw_fill_operation_real_resume;
+  iface->cancel             = nw_fill_operation_real_cancel;
 }
 
 static void
@@ -97,7 +200,60 @@ nw_fill_operation_class_init (NwFillOperationClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
-  object_class->finalize = nw_fill_operation_finalize;
+  object_class->finalize     = nw_fill_operation_finalize;
+  object_class->set_property = nw_fill_operation_set_property;
+  object_class->get_property = nw_fill_operation_get_property;
+
+  g_object_class_install_property (object_class, PROP_PARALLEL,
+                                   g_param_spec_boolean ("parallel",
+                                                         "Parallel",
+                                                         "Whether to fill independent devices concurrently",
+                                                         TRUE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_DISCARD,
+                                   g_param_spec_boolean ("discard",
+                                                         "Discard",
+                                                         "Whether to discard the filled blocks of devices supporting it",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_ENGINE,
+                                   g_param_spec_enum ("engine",
+                                                      "Engine",
+                                                      "The backend performing the fill",
+                                                      NW_TYPE_OPERATION_ENGINE,
+                                                      NW_OPERATION_ENGINE_SECURE_DELETE,
+                                                      G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_DIRECT_IO,
+                                   g_param_spec_boolean ("direct-io",
+                                                         "Direct I/O",
+                                                         "Whether the built-in engines bypass the page cache",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_IO_CLASS,
+                                   g_param_spec_enum ("io-class",
+                                                      "I/O class",
+                                                      "The I/O scheduling class of the writes",
+                                                      NW_TYPE_OPERATION_IO_CLASS,
+                                                      NW_OPERATION_IO_CLASS_NORMAL,
+                                                      G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_BANDWIDTH_LIMIT,
+                                   g_param_spec_uint64 ("bandwidth-limit",
+                                                        "Bandwidth limit",
+                                                        "Bytes per second the built-in engines write at most, or 0 for no limit.  It can be changed while running",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_IDLE_ONLY,
+                                   g_param_spec_boolean ("idle-only",
+                                                         "Idle only",
+                                                         "Whether to hold the fill while other I/O happens on its disk",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE));
+  g_object_class_install_property (object_class, PROP_IDLE_INTERVAL,
+                                   g_param_spec_uint ("idle-interval",
+                                                      "Idle interval",
+                                                      "Seconds a disk has to be unused before a held fill resumes",
+                                                      1, 3600, 30,
+                                                      G_PARAM_READWRITE));
 
   g_type_class_add_private (klass, sizeof (NwFillOperationPrivate));
 }
@@ -110,16 +266,36 @@ nw_fill_operation_init (NwFillOperation *self)
                                             NwFillOperationPrivate);
 
   self->priv->directories = NULL;
+  self->priv->parallel = TRUE;
+  self->priv->discard = FALSE;
+  self->priv->engine = NW_OPERATION_ENGINE_SECURE_DELETE;
+  self->priv->direct_io = FALSE;
+  self->priv->io_class = NW_OPERATION_IO_CLASS_NORMAL;
+  self->priv->throttle = nw_throttle_new (0);
+  self->priv->idle_only = FALSE;
+  self->priv->idle_interval = 30;
   self->priv->n_op = 0;
-  self->priv->n_op_done = 0;
   self->priv->message = NULL;
-
-  self->priv->finished_hid = g_signal_connect (self, "finished",
-                                               G_CALLBACK (nw_fill_operation_finished_handler),
-                                               self);
-  self->priv->progress_hid = g_signal_connect (self, "progress",
-                                               G_CALLBACK (nw_fill_operation_progress_handler),
-                                               self);
+  self->priv->mounts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
+  self->priv->warnings = g_string_new (NULL);
+  self->priv->chains = NULL;
+  self->priv->n_chains_running = 0;
+  self->priv->chains_failed = FALSE;
+  self->priv->idle_source = 0;
+  self->priv->start_time = 0;
+  self->priv->end_time = 0;
+  self->priv->last_poll = 0;
+  self->priv->waited = 0;
+  self->priv->trim_failures = NULL;
+  g_mutex_init (&self->priv->mutex);
+  g_cond_init (&self->priv->cond);
+  self->priv->paused = FALSE;
+  self->priv->canceled = FALSE;
+  self->priv->cancel_reported = FALSE;
+  self->priv->n_passes = 1;
+  self->priv->progress_pending = 0;
+  self->priv->cache_released = 0;
 }
 
 static void
@@ -135,57 +311,353 @@ nw_fill_operation_finalize (GObject *object)
     g_string_free (self->priv->message, TRUE);
     self->priv->message = NULL;
   }
+  g_hash_table_destroy (self->priv->mounts);
+  g_string_free (self->priv->warnings, TRUE);
+  if (self->priv->trim_failures) {
+    g_string_free (self->priv->trim_failures, TRUE);
+  }
+  g_mutex_clear (&self->priv->mutex);
+  g_cond_clear (&self->priv->cond);
+  nw_throttle_free (self->priv->throttle);
 
   G_OBJECT_CLASS (nw_fill_operation_parent_class)->finalize (object);
 }
 
+static void
+nw_fill_operation_set_property (GObject      *object,
+                                guint         prop_id,
+                                const GValue *value,
+                                GParamSpec   *pspec)
+{
+  NwFillOperation *self = NW_FILL_OPERATION (object);
+
+  switch (prop_id) {
+    case PROP_PARALLEL:
+      self->priv->parallel = g_value_get_boolean (value);
+      break;
+
+    case PROP_DISCARD:
+      self->priv->discard = g_value_get_boolean (value);
+      break;
+
+    case PROP_ENGINE:
+      self->priv->engine = g_value_get_enum (value);
+      break;
+
+    case PROP_DIRECT_IO:
+      self->priv->direct_io = g_value_get_boolean (value);
+      break;
+
+    case PROP_IO_CLASS:
+      self->priv->io_class = g_value_get_enum (value);
+      break;
+
+    case PROP_BANDWIDTH_LIMIT:
+      nw_throttle_set_rate (self->priv->throttle, g_value_get_uint64 (value));
+      break;
+
+    case PROP_IDLE_ONLY:
+      self->priv->idle_only = g_value_get_boolean (value);
+      break;
+
+    case PROP_IDLE_INTERVAL:
+      self->priv->idle_interval = g_value_get_uint (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+static void
+nw_fill_operation_get_property (GObject    *object,
+                                guint       prop_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  NwFillOperation *self = NW_FILL_OPERATION (object);
+
+  switch (prop_id) {
+    case PROP_PARALLEL:
+      g_value_set_boolean (value, self->priv->parallel);
+      break;
+
+    case PROP_DISCARD:
+      g_value_set_boolean (value, self->priv->discard);
+      break;
+
+    case PROP_ENGINE:
+      g_value_set_enum (value, self->priv->engine);
+      break;
+
+    case PROP_DIRECT_IO:
+      g_value_set_boolean (value, self->priv->direct_io);
+      break;
+
+    case PROP_IO_CLASS:
+      g_value_set_enum (value, self->priv->io_class);
+      break;
+
+    case PROP_BANDWIDTH_LIMIT:
+      g_value_set_uint64 (value, nw_throttle_get_rate (self->priv->throttle));
+      break;
+
+    case PROP_IDLE_ONLY:
+      g_value_set_boolean (value, self->priv->idle_only);
+      break;
+
+    case PROP_IDLE_INTERVAL:
+      g_value_set_uint (value, self->priv->idle_interval);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+/* appends a line to the warnings of @self */
+static void
+add_warning (NwFillOperation *self,
+             const gchar     *format,
+             const gchar     *mount_point)
+{
+  gchar *name = g_filename_display_name (mount_point);
+
+  if (self->priv->warnings->len > 0) {
+    g_string_append_c (self->priv->warnings, '\n');
+  }
+  g_string_append_printf (self->priv->warnings, format, name);
+  g_free (name);
+}
+
+/* checks what filling the mount @mount_point classified as @flags would do,
+ * noting it in the warnings.
+ * Returns: %FALSE if filling it is pointless or impossible */
+static gboolean
+check_mount (NwFillOperation *self,
+             const gchar     *mount_point,
+             NwMountFlags     flags)
+{
+  if (flags & NW_MOUNT_VOLATILE) {
+    add_warning (self, _("\"%s\" is held in memory, filling it would only "
+                         "exhaust the memory.  It is skipped."), mount_point);
+    return FALSE;
+  }
+  if (flags & NW_MOUNT_READ_ONLY) {
+    add_warning (self, _("\"%s\" is mounted read-only, it is skipped."),
+                 mount_point);
+    return FALSE;
+  }
+  if (flags & NW_MOUNT_REMOTE) {
+    add_warning (self, _("\"%s\" is stored on another machine, which may "
+                         "keep data out of the free space it reports."),
+                 mount_point);
+  } else if (flags & NW_MOUNT_FUSE) {
+    add_warning (self, _("\"%s\" is handled by a user-space file system, "
+                         "whose free space may not be backed by the disk "
+                         "itself."), mount_point);
+  }
+  if (flags & NW_MOUNT_COMPRESSED) {
+    add_warning (self, _("\"%s\" compresses data, so zeros would not fill "
+                         "it.  It is only filled with random data."),
+                 mount_point);
+  }
+  if (flags & NW_MOUNT_COPY_ON_WRITE) {
+    add_warning (self, _("Data of \"%s\" still held by snapshots is not free "
+                         "space, it won't be wiped."), mount_point);
+  }
+  if (flags & NW_MOUNT_DATA_JOURNAL) {
+    add_warning (self, _("\"%s\" journals data, copies of it may remain in "
+                         "the journal, out of reach of filling."),
+                 mount_point);
+  }
+  if (flags & NW_MOUNT_ENCRYPTED) {
+    add_warning (self, _("\"%s\" is encrypted, its free space only ever held "
+                         "encrypted data."), mount_point);
+  }
+
+  return TRUE;
+}
+
 static void
 nw_fill_operation_real_add_file (NwOperation *op,
                                  const gchar *path)
 {
   NwFillOperation *self = NW_FILL_OPERATION (op);
-
-  /* FIXME: filter file? */
-  self->priv->directories = g_list_prepend (self->priv->directories,
-                                            g_strdup (path));
+  NwMountFlags     flags;
+  gchar           *mount_point = NULL;
+
+  flags = nw_mount_probe (path, &mount_point);
+  if (mount_point) {
+    gpointer fill;
+
+    /* check each mount once, even if given several of its directories */
+    if (! g_hash_table_lookup_extended (self->priv->mounts, mount_point,
+                                        NULL, &fill)) {
+      fill = GINT_TO_POINTER (check_mount (self, mount_point, flags));
+      g_hash_table_insert (self->priv->mounts, g_strdup (mount_point), fill);
+    }
+    g_free (mount_point);
+    if (! fill) {
+      return;
+    }
+  }
+  self->priv->directories = g_list_append (self->priv->directories,
+                                           g_strdup (path));
   self->priv->n_op ++;
+}
+
+static gchar *
+nw_fill_operation_real_get_warnings (NwOperation *op)
+{
+  NwFillOperation *self = NW_FILL_OPERATION (op);
+
+  if (self->priv->warnings->len == 0) {
+    return NULL;
+  }
+
+  return g_strdup (self->priv->warnings->str);
+}
+
+/* formats a duration in microseconds as H:MM:SS */
+static gchar *
+format_duration (gint64 duration)
+{
+  gint64 seconds = MAX (duration, 0) / G_USEC_PER_SEC;
+
+  return g_strdup_printf ("%u:%02u:%02u", (guint) (seconds / 3600),
+                          (guint) (seconds / 60 % 60), (guint) (seconds % 60));
+}
+
+/* gets the time spent wiping and the one spent waiting for idle disks so far */
+static void
+get_durations (NwFillOperation *self,
+               gchar          **wiping,
+               gchar          **waiting)
+{
+  gint64 end = self->priv->end_time;
 
-  gsd_fill_operation_set_directory (GSD_FILL_OPERATION (self),
-                                    self->priv->directories->data);
+  if (end == 0) {
+    end = g_get_monotonic_time ();
+  }
+  *wiping = format_duration (end - self->priv->start_time - self->priv->waited);
+  *waiting = format_duration (self->priv->waited);
 }
 
 static gchar *
 nw_fill_operation_real_get_progress_step (NwOperation *operation)
 {
-  NwFillOperation    *self  = NW_FILL_OPERATION (operation);
-  GsdAsyncOperation  *op    = GSD_SECURE_DELETE_OPERATION (operation);
+  NwFillOperation  *self = NW_FILL_OPERATION (operation);
+  GString          *step = g_string_new (NULL);
+  guint             n_op_done = 0;
+  guint             n_running = 0;
+  GList            *item;
 
-  if (self->priv->n_op > 1) {
-    return g_strdup_printf (_("Device \"%s\" (%u out of %u), pass %u out of %u"),
-                            (const gchar *) self->priv->directories->data,
-                            self->priv->n_op_done + 1, self->priv->n_op,
-                            op->passes + 1, op->n_passes);
-  } else {
-    return g_strdup_printf (_("Device \"%s\", pass %u out of %u"),
-                            (const gchar *) self->priv->directories->data,
-                            op->passes + 1, op->n_passes);
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain *chain = item->data;
+
+    n_op_done += chain->n_done;
+    n_running += chain->operation || chain->thread || chain->trimming;
   }
+  /* one line per device being filled */
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain *chain = item->data;
+    guint      pass;
+    guint      n_passes;
+
+    if (! chain->operation && ! chain->thread && ! chain->trimming) {
+      continue;
+    }
+    if (step->len > 0) {
+      g_string_append_c (step, '\n');
+    }
+    if (chain->trimming) {
+      g_string_append_printf (step, _("Device \"%s\", discarding unused blocks"),
+                              (const gchar *) chain->directories->data);
+      continue;
+    }
+    if (chain->waiting) {
+      gchar *waited;
+
+      waited = format_duration (g_get_monotonic_time () - chain->wait_start);
+      g_string_append_printf (step,
+                              _("Device \"%s\", waiting for the disk to be idle (%s)"),
+                              (const gchar *) chain->directories->data, waited);
+      g_free (waited);
+      continue;
+    }
+    if (chain->operation) {
+      GsdAsyncOperation *op = GSD_ASYNC_OPERATION (chain->operation);
+
+      pass = op->passes;
+      n_passes = op->n_passes;
+    } else {
+      pass = (guint) g_atomic_int_get (&chain->pass);
+      n_passes = self->priv->n_passes;
+    }
+    if (n_running == 1 && self->priv->n_op > 1) {
+      g_string_append_printf (step,
+                              _("Device \"%s\" (%u out of %u), pass %u out of %u"),
+                              (const gchar *) chain->directories->data,
+                              n_op_done + 1, self->priv->n_op,
+                              pass + 1, n_passes);
+    } else {
+      g_string_append_printf (step, _("Device \"%s\", pass %u out of %u"),
+                              (const gchar *) chain->directories->data,
+                              pass + 1, n_passes);
+    }
+  }
+  if (self->priv->idle_only && self->priv->chains) {
+    gchar *wiping;
+    gchar *waiting;
+
+    get_durations (self, &wiping, &waiting);
+    g_string_append_c (step, '\n');
+    g_string_append_printf (step, _("Wiping for %s, waited %s for idle disks"),
+                            wiping, waiting);
+    g_free (wiping);
+    g_free (waiting);
+  }
+
+  return g_string_free (step, FALSE);
 }
 
-/* wrapper for the progress handler returning the current progression over all
- * operations  */
-static void
-nw_fill_operation_progress_handler (GsdFillOperation *operation,
-                                    gdouble           fraction,
-                                    NwFillOperation  *self)
+static gchar *
+nw_fill_operation_real_get_report (NwOperation *operation)
 {
-  /* abort emission and replace by our overridden one.  Not to do that
-   * recursively, we block our handler during the re-emission */
-  g_signal_stop_emission_by_name (operation, "progress");
-  g_signal_handler_block (operation, self->priv->progress_hid);
-  g_signal_emit_by_name (operation, "progress",
-                         (self->priv->n_op_done + fraction) / self->priv->n_op);
-  g_signal_handler_unblock (operation, self->priv->progress_hid);
+  NwFillOperation  *self = NW_FILL_OPERATION (operation);
+  GString          *report = g_string_new (NULL);
+
+  if (self->priv->engine != NW_OPERATION_ENGINE_SECURE_DELETE &&
+      self->priv->cache_released > 0) {
+    gchar *released = g_format_size (self->priv->cache_released);
+
+    g_string_append_printf (report, _("%s of written data was released from "
+                                      "the cache."), released);
+    g_free (released);
+  }
+  if (self->priv->idle_only && self->priv->start_time > 0) {
+    gchar *wiping;
+    gchar *waiting;
+
+    get_durations (self, &wiping, &waiting);
+    if (report->len > 0) {
+      g_string_append_c (report, '\n');
+    }
+    g_string_append_printf (report, _("Wiping took %s, plus %s waiting for "
+                                      "the disks to be idle."),
+                            wiping, waiting);
+    g_free (wiping);
+    g_free (waiting);
+  }
+  if (self->priv->trim_failures) {
+    if (report->len > 0) {
+      g_string_append_c (report, '\n');
+    }
+    g_string_append (report, self->priv->trim_failures->str);
+  }
+
+  return g_string_free (report, report->len == 0);
 }
 
 static void
@@ -200,107 +672,744 @@ append_error_message (NwFillOperation  *self,
   }
 }
 
+/* operation chains */
+
+static void     fill_chain_finished_handler   (GsdFillOperation *operation,
+                                               gboolean          success,
+                                               const gchar      *message,
+                                               FillChain        *chain);
+static void     fill_chain_progress_handler   (GsdFillOperation *operation,
+                                               gdouble           fraction,
+                                               FillChain        *chain);
+static gpointer fill_chain_native_thread      (gpointer          data);
+
 static void
-emit_final_finished (NwFillOperation *self,
-                     gboolean         success,
-                     const gchar     *message)
+fill_chain_free (FillChain *chain)
 {
-  const gchar *full_message;
+  if (chain->operation) {
+    g_object_unref (chain->operation);
+  }
+  if (chain->error) {
+    g_error_free (chain->error);
+  }
+  if (chain->trim_error) {
+    g_error_free (chain->trim_error);
+  }
+  nw_path_list_free (chain->directories);
+  g_slice_free (FillChain, chain);
+}
 
-  if (! self->priv->message) {
-    full_message = message;
-  } else {
-    append_error_message (self, message);
-    full_message = self->priv->message->str;
+/* starts filling the first directory left in @chain */
+static gboolean
+fill_chain_launch (FillChain *chain,
+                   GError   **error)
+{
+  NwFillOperation              *self = chain->self;
+  GsdSecureDeleteOperationMode  mode;
+  gboolean                      fast;
+  gboolean                      zeroise;
+  gboolean                      success;
+  gint                          priority;
+  struct stat                   st;
+
+  chain->fraction = 0.0;
+  /* each directory may be on another device */
+  chain->device = g_stat (chain->directories->data, &st) == 0 ? st.st_dev : 0;
+  chain->has_stats = FALSE;
+  chain->waiting = FALSE;
+  if (self->priv->engine != NW_OPERATION_ENGINE_SECURE_DELETE) {
+    g_atomic_int_set (&chain->pass, 0);
+    g_atomic_int_set (&chain->progress, 0);
+    chain->pass_written = 0;
+    chain->thread = g_thread_try_new ("nw-fill", fill_chain_native_thread,
+                                      chain, error);
+
+    return chain->thread != NULL;
   }
 
-  g_signal_handler_block (self, self->priv->finished_hid);
-  g_signal_emit_by_name (self, "finished", success, full_message);
-  g_signal_handler_unblock (self, self->priv->finished_hid);
+  g_object_get (self,
+                "fast", &fast,
+                "mode", &mode,
+                "zeroise", &zeroise,
+                NULL);
+  if (zeroise &&
+      nw_mount_probe (chain->directories->data, NULL) & NW_MOUNT_COMPRESSED) {
+    /* zeros would compress to nothing and never fill the disk */
+    zeroise = FALSE;
+  }
+  chain->operation = g_object_new (GSD_TYPE_FILL_OPERATION,
+                                   "fast", fast,
+                                   "mode", mode,
+                                   "zeroise", zeroise,
+                                   NULL);
+  g_signal_connect (chain->operation, "finished",
+                    G_CALLBACK (fill_chain_finished_handler), chain);
+  g_signal_connect (chain->operation, "progress",
+                    G_CALLBACK (fill_chain_progress_handler), chain);
+  /* sfill(1) inherits the I/O priority when spawned */
+  priority = nw_throttle_apply_io_class (self->priv->io_class);
+  success = gsd_fill_operation_run (chain->operation,
+                                    chain->directories->data, error);
+  nw_throttle_restore_io_priority (priority);
+  if (! success) {
+    g_object_unref (chain->operation);
+    chain->operation = NULL;
+  }
+
+  return success;
 }
 
-/* timeout function to launch next operation after finish of the previous
- * operation.
- * we need this kind of hack since operation are locked while running. */
+/* emits the overall progress from the one of the sub-operations */
+static void
+emit_chains_progress (NwFillOperation *self)
+{
+  gdouble fraction = 0.0;
+  GList  *item;
+
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain *chain = item->data;
+
+    fraction += chain->n_done;
+    if (chain->operation || chain->thread || chain->trimming) {
+      fraction += chain->fraction;
+    }
+  }
+
+  g_signal_emit_by_name (self, "progress", fraction / self->priv->n_op);
+}
+
+static void
+fill_chain_progress_handler (GsdFillOperation *operation,
+                             gdouble           fraction,
+                             FillChain        *chain)
+{
+  chain->fraction = fraction;
+  emit_chains_progress (chain->self);
+}
+
+static void
+emit_chains_finished (NwFillOperation *self)
+{
+  const gchar *message = self->priv->message ? self->priv->message->str : NULL;
+
+  if (self->priv->idle_source) {
+    g_source_remove (self->priv->idle_source);
+    self->priv->idle_source = 0;
+  }
+  self->priv->end_time = g_get_monotonic_time ();
+  /* the chains must not be seen anymore during emission */
+  g_list_foreach (self->priv->chains, (GFunc) fill_chain_free, NULL);
+  g_list_free (self->priv->chains);
+  self->priv->chains = NULL;
+
+  g_signal_emit_by_name (self, "finished", ! self->priv->chains_failed, message);
+
+  if (self->priv->message) {
+    g_string_free (self->priv->message, TRUE);
+    self->priv->message = NULL;
+  }
+  g_object_unref (self);
+}
+
+/* goes on with the next directory of @chain, the current one being done */
+static void
+fill_chain_next (FillChain *chain,
+                 gboolean   success)
+{
+  NwFillOperation *self = chain->self;
+  GList           *tmp;
+
+  chain->n_done ++;
+  tmp = chain->directories;
+  chain->directories = tmp->next;
+  g_free (tmp->data);
+  g_list_free_1 (tmp);
+
+  if (! success) {
+    self->priv->chains_failed = TRUE;
+  } else if (chain->directories) {
+    GError *err = NULL;
+
+    if (fill_chain_launch (chain, &err)) {
+      emit_chains_progress (self);
+      return;
+    }
+    append_error_message (self, err->message);
+    g_error_free (err);
+    self->priv->chains_failed = TRUE;
+  }
+
+  /* this chain is over */
+  if (-- self->priv->n_chains_running == 0) {
+    emit_chains_finished (self);
+  } else {
+    emit_chains_progress (self);
+  }
+}
+
+/* the blocks @chain filled were discarded.  Failures end up in the report, as
+ * the user asked for it and the device may still hold the data */
 static gboolean
-launch_next_operation (NwFillOperation *self)
+fill_chain_trimmed_idle (gpointer data)
 {
-  gboolean busy;
+  FillChain        *chain = data;
+  NwFillOperation  *self = chain->self;
 
-  busy = gsd_async_operation_get_busy (GSD_ASYNC_OPERATION (self));
-  if (! busy) {
-    GError   *err = NULL;
-    gboolean  success;
+  chain->trimming = FALSE;
+  if (chain->trim_error) {
+    gchar *name = g_filename_display_name (chain->directories->data);
 
-    success = gsd_fill_operation_run (GSD_FILL_OPERATION (self),
-                                      self->priv->directories->data,
-                                      &err);
-    if (! success) {
-      emit_final_finished (self, success, err->message);
-      g_error_free (err);
+    if (! self->priv->trim_failures) {
+      self->priv->trim_failures = g_string_new (NULL);
     } else {
-      /* as the step changed, report the progress changed */
-      g_signal_emit_by_name (self, "progress", 0.0);
+      g_string_append_c (self->priv->trim_failures, '\n');
     }
+    g_string_append_printf (self->priv->trim_failures,
+                            _("The unused blocks of \"%s\" were not "
+                              "discarded, its device may still hold the "
+                              "wiped data: %s"),
+                            name, chain->trim_error->message);
+    g_free (name);
+    g_clear_error (&chain->trim_error);
   }
+  fill_chain_next (chain, TRUE);
 
-  return busy; /* keeps our timeout function until lock is released */
+  return FALSE;
+}
+
+/* discards the blocks the fill went through, so the device drops what's left
+ * of their data */
+static gpointer
+fill_chain_trim_thread (gpointer data)
+{
+  FillChain *chain = data;
+
+  nw_device_trim (chain->directories->data, &chain->trim_error);
+  g_idle_add (fill_chain_trimmed_idle, chain);
+
+  return NULL;
+}
+
+/* starts discarding the unused blocks of the directory @chain just filled if
+ * its device supports it.
+ * Returns: %TRUE if started, %FALSE if there is nothing to do */
+static gboolean
+fill_chain_trim (FillChain *chain)
+{
+  struct stat st;
+  GThread    *thread;
+
+  if (! chain->self->priv->discard ||
+      g_stat (chain->directories->data, &st) != 0 ||
+      ! nw_device_supports_discard (st.st_dev)) {
+    return FALSE;
+  }
+  chain->trimming = TRUE;
+  thread = g_thread_try_new ("nw-trim", fill_chain_trim_thread, chain, NULL);
+  if (! thread) {
+    chain->trimming = FALSE;
+    return FALSE;
+  }
+  g_thread_unref (thread);
+  emit_chains_progress (chain->self);
+
+  return TRUE;
+}
+
+/* the first directory of @chain was filled, discards its blocks if needed
+ * before going on */
+static void
+fill_chain_filled (FillChain   *chain,
+                   gboolean     success,
+                   const gchar *message)
+{
+  if (message) {
+    append_error_message (chain->self, message);
+  }
+  if (! success || ! fill_chain_trim (chain)) {
+    fill_chain_next (chain, success);
+  }
+}
+
+static gboolean
+unref_idle (gpointer data)
+{
+  g_object_unref (data);
+
+  return G_SOURCE_REMOVE;
 }
 
-/* Removes the current directory to proceed */
 static void
-nw_fill_operation_pop_dir (NwFillOperation *self)
+fill_chain_finished_handler (GsdFillOperation *operation,
+                             gboolean          success,
+                             const gchar      *message,
+                             FillChain        *chain)
+{
+  /* the operation still has to unlock itself after the emission, so only drop
+   * it once idle */
+  g_signal_handlers_disconnect_by_data (operation, chain);
+  g_idle_add (unref_idle, chain->operation);
+  chain->operation = NULL;
+
+  fill_chain_filled (chain, success, message);
+}
+
+/* native engines */
+
+static gboolean
+emit_progress_idle (gpointer data)
 {
-  GList *tmp;
+  NwFillOperation *self = data;
+  GList           *item;
 
-  tmp = self->priv->directories;
-  if (tmp) {
-    self->priv->directories = tmp->next;
-    g_free (tmp->data);
-    g_list_free_1 (tmp);
+  g_atomic_int_set (&self->priv->progress_pending, 0);
+  if (! self->priv->chains) {
+    /* already finished */
+    return FALSE;
   }
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain *chain = item->data;
+
+    if (chain->thread) {
+      chain->fraction = (gdouble) g_atomic_int_get (&chain->progress) /
+                        CHAIN_PROGRESS_SCALE;
+    }
+  }
+  emit_chains_progress (self);
+
+  return FALSE;
 }
 
-/* Wrapper for the finished handler.  It launches the next operation if there
- * is one left. */
+/* asks for a progress update from the main thread.  Requests are coalesced so
+ * there is at most one pending at a time */
 static void
-nw_fill_operation_finished_handler (GsdFillOperation *operation,
-                                    gboolean          success,
-                                    const gchar      *message,
-                                    NwFillOperation  *self)
-{
-  gboolean last = TRUE;
-
-  if (success) {
-    self->priv->n_op_done++;
-    /* remove the directory just proceeded */
-    nw_fill_operation_pop_dir (self);
-
-    /* if we have work left to be done... */
-    if (self->priv->directories) {
-      /* block signal emission, it's not the last one */
-      g_signal_stop_emission_by_name (operation, "finished");
-
-      /* remember any warning for the final signal */
-      if (message) {
-        append_error_message (self, message);
+schedule_progress (NwFillOperation *self)
+{
+  if (g_atomic_int_compare_and_exchange (&self->priv->progress_pending, 0, 1)) {
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, emit_progress_idle,
+                     g_object_ref (self), g_object_unref);
+  }
+}
+
+/* overwriter callback: reports progress, blocks while paused and aborts if
+ * canceled */
+static gboolean
+fill_chain_check_func (guint    pass,
+                       guint64  written,
+                       guint64  size,
+                       gpointer data)
+{
+  FillChain        *chain = data;
+  NwFillOperation  *self = chain->self;
+  gboolean          keep_going;
+  gdouble           fraction;
+
+  if ((guint) g_atomic_int_get (&chain->pass) != pass) {
+    g_atomic_int_set (&chain->pass, (gint) pass);
+    chain->pass_written = 0;
+  }
+  chain->pass_written += written;
+  fraction = (pass + (gdouble) chain->pass_written / MAX (size, 1)) /
+             self->priv->n_passes;
+  g_atomic_int_set (&chain->progress,
+                    (gint) (CLAMP (fraction, 0.0, 1.0) * CHAIN_PROGRESS_SCALE));
+  schedule_progress (self);
+
+  if (! nw_throttle_consume (self->priv->throttle, written)) {
+    return FALSE;
+  }
+  g_mutex_lock (&self->priv->mutex);
+  while ((self->priv->paused || chain->waiting) && ! self->priv->canceled) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+  keep_going = ! self->priv->canceled;
+  g_mutex_unlock (&self->priv->mutex);
+
+  return keep_going;
+}
+
+static gboolean
+fill_chain_native_done_idle (gpointer data)
+{
+  FillChain        *chain = data;
+  NwFillOperation  *self = chain->self;
+  GError           *err = chain->error;
+
+  g_thread_join (chain->thread);
+  chain->thread = NULL;
+  chain->error = NULL;
+  if (err && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    /* all chains get canceled at once, only report it once */
+    if (self->priv->cancel_reported) {
+      g_clear_error (&err);
+      fill_chain_filled (chain, FALSE, NULL);
+      return FALSE;
+    }
+    self->priv->cancel_reported = TRUE;
+  }
+  fill_chain_filled (chain, err == NULL, err ? err->message : NULL);
+  if (err) {
+    g_error_free (err);
+  }
+
+  return FALSE;
+}
+
+/* fills the first directory of @chain with a built-in overwriter, whose written
+ * data is released from the page cache as soon as it reached the disk */
+static gpointer
+fill_chain_native_thread (gpointer data)
+{
+  FillChain        *chain = data;
+  NwFillOperation  *self = chain->self;
+  NwOverwriter     *overwriter;
+  gboolean          fast;
+  gboolean          zeroise;
+  GsdSecureDeleteOperationMode mode;
+
+  g_object_get (self,
+                "fast", &fast,
+                "mode", &mode,
+                "zeroise", &zeroise,
+                NULL);
+  if (zeroise &&
+      nw_mount_probe (chain->directories->data, NULL) & NW_MOUNT_COMPRESSED) {
+    /* zeros would compress to nothing and never fill the disk */
+    zeroise = FALSE;
+  }
+  nw_throttle_apply_io_class (self->priv->io_class);
+  overwriter = nw_overwriter_new (mode, fast, zeroise, &chain->error);
+  if (overwriter) {
+    GError *err = NULL;
+
+    if (self->priv->engine == NW_OPERATION_ENGINE_IO_URING &&
+        ! nw_overwriter_enable_uring (overwriter, &err)) {
+      g_debug ("Falling back to synchronous writes: %s", err->message);
+      g_clear_error (&err);
+    }
+    nw_overwriter_set_check_func (overwriter, fill_chain_check_func, chain);
+    nw_overwriter_set_direct_io (overwriter, self->priv->direct_io);
+    nw_overwriter_fill (overwriter, chain->directories->data, &chain->error);
+    g_mutex_lock (&self->priv->mutex);
+    self->priv->cache_released += nw_overwriter_get_cache_released (overwriter);
+    g_mutex_unlock (&self->priv->mutex);
+    nw_overwriter_free (overwriter);
+  }
+  g_idle_add (fill_chain_native_done_idle, chain);
+
+  return NULL;
+}
+
+/* idle-only scheduling */
+
+/* holds @chain until its disk is idle */
+static void
+fill_chain_hold (FillChain *chain,
+                 gint64     now)
+{
+  NwFillOperation *self = chain->self;
+
+  g_mutex_lock (&self->priv->mutex);
+  chain->waiting = TRUE;
+  g_mutex_unlock (&self->priv->mutex);
+  chain->wait_start = now;
+  chain->quiet_since = now;
+  /* a paused operation is already stopped */
+  if (chain->operation && ! self->priv->paused) {
+    gsd_async_operation_pause (GSD_ASYNC_OPERATION (chain->operation));
+  }
+}
+
+static void
+fill_chain_release (FillChain *chain)
+{
+  NwFillOperation *self = chain->self;
+
+  g_mutex_lock (&self->priv->mutex);
+  chain->waiting = FALSE;
+  g_cond_broadcast (&self->priv->cond);
+  g_mutex_unlock (&self->priv->mutex);
+  if (chain->operation) {
+    gsd_async_operation_resume (GSD_ASYNC_OPERATION (chain->operation));
+  }
+}
+
+/* samples the disk of each running chain, holding chains whose disk gets used
+ * by someone else and releasing the ones whose disk was quiet long enough.
+ * The fill's own writes can't be told apart from others, so only reads tell a
+ * running chain is disturbing someone, while anything tells a held one isn't
+ * alone yet */
+static gboolean
+idle_poll_timeout (gpointer data)
+{
+  NwFillOperation  *self = data;
+  gint64            now = g_get_monotonic_time ();
+  gint64            interval = (gint64) self->priv->idle_interval * G_USEC_PER_SEC;
+  guint             n_running = 0;
+  guint             n_waiting = 0;
+  GList            *item;
+
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain        *chain = item->data;
+    NwDeviceIoStats   stats;
+
+    if ((! chain->operation && ! chain->thread) ||
+        ! nw_device_get_io_stats (chain->device, &stats)) {
+      /* trimming is our own I/O, and unknown devices are never held */
+      chain->has_stats = FALSE;
+      continue;
+    }
+    n_running ++;
+    if (chain->has_stats && ! self->priv->paused) {
+      guint64 reads = stats.reads - chain->stats.reads;
+      guint64 writes = stats.writes - chain->stats.writes;
+
+      if (! chain->waiting) {
+        if (reads > IDLE_IO_THRESHOLD) {
+          fill_chain_hold (chain, now);
+        }
+      } else if (reads + writes > IDLE_IO_THRESHOLD || stats.in_flight > 0) {
+        chain->quiet_since = now;
+      } else if (now - chain->quiet_since >= interval) {
+        fill_chain_release (chain);
       }
+    }
+    chain->stats = stats;
+    chain->has_stats = TRUE;
+    n_waiting += chain->waiting;
+  }
+  if (n_running > 0 && n_waiting == n_running && ! self->priv->paused) {
+    self->priv->waited += now - self->priv->last_poll;
+  }
+  self->priv->last_poll = now;
+  /* refreshes the displayed durations */
+  emit_chains_progress (self);
+
+  return TRUE;
+}
+
+/* drops a sub-operation that was canceled before the run started */
+static void
+release_canceled_operation (GsdFillOperation *operation,
+                            gboolean          success,
+                            const gchar      *message,
+                            gpointer          data)
+{
+  g_idle_add (unref_idle, operation);
+}
+
+static void
+add_chain (NwFillOperation *self,
+           GList           *directories)
+{
+  FillChain *chain = g_slice_new (FillChain);
+
+  chain->self = self;
+  chain->operation = NULL;
+  chain->thread = NULL;
+  chain->directories = directories;
+  chain->n_done = 0;
+  chain->fraction = 0.0;
+  chain->trimming = FALSE;
+  chain->trim_error = NULL;
+  chain->pass = 0;
+  chain->progress = 0;
+  chain->pass_written = 0;
+  chain->error = NULL;
+  chain->device = 0;
+  chain->has_stats = FALSE;
+  chain->waiting = FALSE;
+  chain->wait_start = 0;
+  chain->quiet_since = 0;
+  self->priv->chains = g_list_append (self->priv->chains, chain);
+}
+
+/* fills the directories in a single chain, or in parallel mode in a chain per
+ * device, all devices concurrently.  As the directories of a device are
+ * chained, several partitions of the same disk are still processed one after
+ * the other */
+static gboolean
+run_chains (NwFillOperation  *self,
+            GError          **error)
+{
+  GList  *item;
+  GError *err = NULL;
+
+  if (self->priv->chains) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                 _("Operation is already running"));
+    return FALSE;
+  }
+  if (! self->priv->directories) {
+    g_set_error (error, NW_FILL_OPERATION_ERROR,
+                 NW_FILL_OPERATION_ERROR_FAILED,
+                 _("No directory to fill"));
+    return FALSE;
+  }
+
+  self->priv->chains_failed = FALSE;
+  if (self->priv->trim_failures) {
+    g_string_free (self->priv->trim_failures, TRUE);
+    self->priv->trim_failures = NULL;
+  }
+  if (self->priv->engine != NW_OPERATION_ENGINE_SECURE_DELETE) {
+    GsdSecureDeleteOperationMode mode;
+
+    g_object_get (self, "mode", &mode, NULL);
+    self->priv->n_passes = nw_overwrite_count_passes (mode);
+    self->priv->paused = FALSE;
+    self->priv->canceled = FALSE;
+    self->priv->cancel_reported = FALSE;
+    self->priv->cache_released = 0;
+    nw_throttle_reset (self->priv->throttle);
+  }
+  if (self->priv->parallel) {
+    GList *groups = nw_device_group_paths (self->priv->directories);
+
+    for (item = groups; item; item = item->next) {
+      NwDeviceGroup *group = item->data;
+
+      add_chain (self, group->paths);
+      group->paths = NULL;
+    }
+    nw_device_group_list_free (groups);
+  } else {
+    add_chain (self, nw_path_list_copy (self->priv->directories));
+  }
+
+  for (item = self->priv->chains; ! err && item; item = item->next) {
+    if (fill_chain_launch (item->data, &err)) {
+      self->priv->n_chains_running ++;
+    }
+  }
+  if (err) {
+    /* stop what was already started, the caller gets the error */
+    g_mutex_lock (&self->priv->mutex);
+    self->priv->canceled = TRUE;
+    g_cond_broadcast (&self->priv->cond);
+    g_mutex_unlock (&self->priv->mutex);
+    nw_throttle_cancel (self->priv->throttle);
+    for (item = self->priv->chains; item; item = item->next) {
+      FillChain *chain = item->data;
+
+      if (chain->thread) {
+        g_thread_join (chain->thread);
+        chain->thread = NULL;
+        g_idle_remove_by_data (chain);
+      }
+      if (chain->operation) {
+        g_signal_handlers_disconnect_by_data (chain->operation, chain);
+        g_signal_connect (chain->operation, "finished",
+                          G_CALLBACK (release_canceled_operation), NULL);
+        gsd_async_operation_cancel (GSD_ASYNC_OPERATION (chain->operation));
+        chain->operation = NULL;
+      }
+    }
+    g_list_foreach (self->priv->chains, (GFunc) fill_chain_free, NULL);
+    g_list_free (self->priv->chains);
+    self->priv->chains = NULL;
+    self->priv->n_chains_running = 0;
+    g_propagate_error (error, err);
 
-      /* we can't launch the next operation right here since the previous must
-       * release its lock before, which is done just after return of the current
-       * function.
-       * To work around this, we add a timeout function that will try to launch
-       * the next operation if the current one is not busy, which fixes the
-       * problem. */
-      g_timeout_add (10, (GSourceFunc) launch_next_operation, self);
-      last = FALSE;
+    return FALSE;
+  }
+  self->priv->start_time = g_get_monotonic_time ();
+  self->priv->end_time = 0;
+  self->priv->last_poll = self->priv->start_time;
+  self->priv->waited = 0;
+  if (self->priv->idle_only) {
+    self->priv->idle_source = g_timeout_add_seconds (IDLE_POLL_INTERVAL,
+                                                     idle_poll_timeout, self);
+  }
+  /* released when all chains finished */
+  g_object_ref (self);
+
+  return TRUE;
+}
+
+static gboolean
+nw_fill_operation_real_run (NwOperation *op,
+                            GError     **error)
+{
+  return run_chains (NW_FILL_OPERATION (op), error);
+}
+
+static gboolean
+nw_fill_operation_real_pause (NwOperation *op)
+{
+  NwFillOperation  *self = NW_FILL_OPERATION (op);
+  gboolean          paused = FALSE;
+  GList            *item;
+
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain *chain = item->data;
+
+    if (chain->waiting) {
+      /* already stopped until its disk is idle */
+      paused = TRUE;
+    } else if (chain->operation) {
+      paused |= gsd_async_operation_pause (GSD_ASYNC_OPERATION (chain->operation));
+    } else if (chain->thread) {
+      paused = TRUE;
     }
   }
-  /* if we didn't schedule a new job, check if we have to alter the signal */
-  if (last && self->priv->message) {
-    g_signal_stop_emission_by_name (operation, "finished");
-    emit_final_finished (self, success, message);
+  /* native fills block in their check function */
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->paused = paused;
+  g_mutex_unlock (&self->priv->mutex);
+
+  return paused;
+}
+
+static gboolean
+nw_fill_operation_real_resume (NwOperation *op)
+{
+  NwFillOperation  *self = NW_FILL_OPERATION (op);
+  gboolean          resumed = TRUE;
+  GList            *item;
+
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain *chain = item->data;
+
+    /* held chains go on once their disk is idle */
+    if (chain->operation && ! chain->waiting) {
+      resumed &= gsd_async_operation_resume (GSD_ASYNC_OPERATION (chain->operation));
+    }
   }
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->paused = FALSE;
+  g_cond_broadcast (&self->priv->cond);
+  g_mutex_unlock (&self->priv->mutex);
+
+  return resumed;
+}
+
+static void
+nw_fill_operation_real_cancel (NwOperation *op)
+{
+  NwFillOperation  *self = NW_FILL_OPERATION (op);
+  GList            *item;
+
+  for (item = self->priv->chains; item; item = item->next) {
+    FillChain *chain = item->data;
+
+    if (chain->operation || chain->thread || chain->trimming) {
+      /* don't go on with the next directories */
+      nw_path_list_free (chain->directories->next);
+      chain->directories->next = NULL;
+    }
+    if (chain->waiting) {
+      fill_chain_release (chain);
+    }
+    if (chain->operation) {
+      gsd_async_operation_cancel (GSD_ASYNC_OPERATION (chain->operation));
+    }
+  }
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->canceled = TRUE;
+  g_cond_broadcast (&self->priv->cond);
+  g_mutex_unlock (&self->priv->mutex);
+  nw_throttle_cancel (self->priv->throttle);
 }
 
 
@@ -353,12 +1462,17 @@ static gchar *
 find_mountpoint (const gchar *path,
                  GError     **error)
 {
-  gchar  *mountpoint_path = NULL;
+  gchar  *mountpoint_path;
   GFile  *file;
   GMount *mount;
   GError *err = NULL;
 
-  /* Try with GIO first */
+  /* the cached mount table first, a single lookup */
+  mountpoint_path = nw_mount_get_mount_point (path);
+  if (mountpoint_path) {
+    return mountpoint_path;
+  }
+  /* fallback to GIO where there is no such table */
   file = g_file_new_for_path (path);
   mount = g_file_find_enclosing_mount (file, NULL, &err);
   if (mount) {
@@ -380,7 +1494,7 @@ find_mountpoint (const gchar *path,
   }
   g_object_unref (file);
   #if HAVE_GIO_UNIX
-  /* fallback to find_unix_mount() */
+  /* and to find_unix_mount() */
   if (! mountpoint_path) {
     g_clear_error (&err);
     mountpoint_path = find_mountpoint_unix (path);
@@ -394,6 +1508,8 @@ find_mountpoint (const gchar *path,
   #endif
   if (! mountpoint_path) {
     g_propagate_error (error, err);
+  } else {
+    g_clear_error (&err);
   }
 
   return mountpoint_path;
@@ -407,11 +1523,14 @@ find_mountpoint (const gchar *path,
  * @error: return location for errors, or %NULL to ignore them
  *
  * Tries to get usable paths (local directories) and keep only one per
- * mountpoint.
+ * mountpoint.  Paths are told apart by their device first, so that the
+ * mountpoint of each device is only looked up once, however many of its files
+ * are given.
  *
  * The returned lists (@work_paths_ and @work_mounts_) have the same length, and
  * an index in a list correspond to the same in the other:
  * g_list_index(work_paths_, 0) is the path of g_list_index(work_mounts_, 0).
+ * They keep the order of @paths.
  * Free returned lists with nw_path_list_free().
  *
  * Returns: %TRUE on success, %FALSE otherwise.
@@ -422,30 +1541,53 @@ nw_fill_operation_filter_files (GList    *paths,
                                 GList   **work_mounts_,
                                 GError  **error)
 {
-  GList  *work_paths  = NULL;
-  GError *err         = NULL;
-  GList  *work_mounts = NULL;
+  GList      *work_paths  = NULL;
+  GError     *err         = NULL;
+  GList      *work_mounts = NULL;
+  GHashTable *devices;
+  GHashTable *mounts;
 
   g_return_val_if_fail (paths != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  /* devices and mountpoints already added */
+  devices = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+  mounts = g_hash_table_new (g_str_hash, g_str_equal);
   for (; ! err && paths; paths = g_list_next (paths)) {
     const gchar  *file_path = paths->data;
     gchar        *mountpoint;
+    struct stat   st;
+    gboolean      is_dir;
 
+    if (g_stat (file_path, &st) == 0) {
+      gint64  device = (gint64) st.st_dev;
+      gint64 *key;
+
+      if (g_hash_table_contains (devices, &device)) {
+        /* the device is already added, skip it */
+        continue;
+      }
+      key = g_new (gint64, 1);
+      *key = device;
+      g_hash_table_add (devices, key);
+      is_dir = S_ISDIR (st.st_mode);
+    } else {
+      is_dir = g_file_test (file_path, G_FILE_TEST_IS_DIR);
+    }
     mountpoint = find_mountpoint (file_path, &err);
     if (G_LIKELY (mountpoint)) {
-      if (g_list_find_custom (work_mounts, mountpoint, (GCompareFunc)strcmp)) {
+      if (g_hash_table_contains (mounts, mountpoint)) {
         /* the mountpoint is already added, skip it */
         g_free (mountpoint);
       } else {
         gchar *path;
 
+        g_hash_table_add (mounts, mountpoint);
         work_mounts = g_list_prepend (work_mounts, mountpoint);
         /* if it is not a directory, gets its container directory.
          * no harm since files cannot be mountpoint themselves, then it gets
          * at most the mountpoint itself */
-        if (! g_file_test (file_path, G_FILE_TEST_IS_DIR)) {
+        if (! is_dir) {
           path = g_path_get_dirname (file_path);
         } else {
           path = g_strdup (file_path);
@@ -454,6 +1596,8 @@ nw_fill_operation_filter_files (GList    *paths,
       }
     }
   }
+  g_hash_table_destroy (mounts);
+  g_hash_table_destroy (devices);
   if (err || ! work_paths_) {
     nw_path_list_free (work_paths);
   } else {
@@ -0,0 +1,477 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Classification of mounts by what matters to wiping them: the mount of a path
+ * is looked up in /proc/self/mountinfo, and what its type, options and device
+ * tell is cached per mount so that probing every target of an operation stays
+ * cheap.
+ *
+ * The mount table is only parsed once, into an index by mount point, and kept
+ * open: the kernel flags it as changed on poll() when something gets mounted or
+ * unmounted, which is when it is parsed again.  Finding the mount of a path then
+ * takes a realpath() of it, which resolves symbolic links and thus stats each
+ * of its components, and a hash lookup per parent directory of the result.
+ * Paths have few components, so this walk is kept rather than a longest-prefix
+ * index of the mount points. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-mount.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+#include <glib.h>
+#include <glib/gstdio.h>
+
+
+/* how deep to look for dm-crypt under stacked devices (LVM on LUKS, etc.) */
+#define NW_MOUNT_MAX_DEVICE_DEPTH 4
+
+/* a line of /proc/self/mountinfo */
+typedef struct {
+  gchar        *mount_point;
+  gchar        *options;
+  gchar        *fs_type;
+  gchar        *source;
+  gchar        *super_options;
+  /* classification, done on first probe */
+  gboolean      classified;
+  NwMountFlags  flags;
+} MountEntry;
+
+/* the mount table, by mount point, and the open mountinfo telling when it
+ * changed (-1 if it couldn't be opened, in which case it's read on each use) */
+static GHashTable  *mounts = NULL;
+static gint         mounts_fd = -1;
+static GMutex       mounts_lock;
+
+
+/* checks whether the comma-separated @options hold @option, either alone or
+ * as "@option=value" if @option ends with '=' */
+static gboolean
+has_option (const gchar *options,
+            const gchar *option)
+{
+  gsize         len = strlen (option);
+  const gchar  *p = options;
+
+  while (p && *p) {
+    if (strncmp (p, option, len) == 0 &&
+        (option[len - 1] == '=' || p[len] == ',' || p[len] == 0)) {
+      return TRUE;
+    }
+    p = strchr (p, ',');
+    if (p) {
+      p++;
+    }
+  }
+
+  return FALSE;
+}
+
+/* decodes the octal escapes of mountinfo fields, e.g. "\040" for a space */
+static gchar *
+unescape_field (const gchar *field)
+{
+  gchar *result = g_malloc (strlen (field) + 1);
+  gchar *out = result;
+
+  while (*field) {
+    if (field[0] == '\\' &&
+        field[1] >= '0' && field[1] <= '3' &&
+        field[2] >= '0' && field[2] <= '7' &&
+        field[3] >= '0' && field[3] <= '7') {
+      *out++ = (gchar) ((field[1] - '0') * 64 + (field[2] - '0') * 8 +
+                        (field[3] - '0'));
+      field += 4;
+    } else {
+      *out++ = *field++;
+    }
+  }
+  *out = 0;
+
+  return result;
+}
+
+static void
+mount_entry_free (gpointer data)
+{
+  MountEntry *entry = data;
+
+  g_free (entry->mount_point);
+  g_free (entry->options);
+  g_free (entry->fs_type);
+  g_free (entry->source);
+  g_free (entry->super_options);
+  g_slice_free (MountEntry, entry);
+}
+
+/* parses a mountinfo @line:
+ *   36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+ * Returns: A new entry, or %NULL if @line is invalid */
+static MountEntry *
+parse_mountinfo_line (const gchar *line)
+{
+  gchar      **fields = g_strsplit (line, " ", 0);
+  guint        n_fields = g_strv_length (fields);
+  guint        sep;
+  MountEntry  *entry = NULL;
+
+  /* optional fields end with a lone "-" */
+  for (sep = 6; sep < n_fields && strcmp (fields[sep], "-") != 0; sep++);
+  if (sep + 2 < n_fields) {
+    entry = g_slice_new0 (MountEntry);
+    entry->mount_point = unescape_field (fields[4]);
+    entry->options = g_strdup (fields[5]);
+    entry->fs_type = g_strdup (fields[sep + 1]);
+    entry->source = unescape_field (fields[sep + 2]);
+    entry->super_options = g_strdup (sep + 3 < n_fields ? fields[sep + 3] : "");
+  }
+  g_strfreev (fields);
+
+  return entry;
+}
+
+/* reads the whole mount table from the open @fd */
+static gchar *
+read_mount_table (gint fd)
+{
+  GString *contents;
+  gchar    buf[4096];
+  gssize   n;
+
+  if (lseek (fd, 0, SEEK_SET) < 0) {
+    return NULL;
+  }
+  contents = g_string_new (NULL);
+  while ((n = read (fd, buf, sizeof buf)) != 0) {
+    if (n > 0) {
+      g_string_append_len (contents, buf, n);
+    } else if (errno != EINTR) {
+      g_string_free (contents, TRUE);
+      return NULL;
+    }
+  }
+
+  return g_string_free (contents, FALSE);
+}
+
+/* checks whether the mount table changed since it was last read.  This also
+ * acknowledges the change. */
+static gboolean
+mount_table_changed (void)
+{
+  struct pollfd pfd;
+
+  if (mounts_fd < 0) {
+    return TRUE;
+  }
+  pfd.fd = mounts_fd;
+  pfd.events = POLLPRI;
+  pfd.revents = 0;
+
+  return poll (&pfd, 1, 0) != 0;
+}
+
+/* (re)builds the mount index if the mount table changed.  Must be called with
+ * mounts_lock held. */
+static void
+update_mounts (void)
+{
+  gchar  *contents = NULL;
+  gchar **lines;
+  guint   i;
+
+  if (! mounts) {
+    mounts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                    NULL, mount_entry_free);
+    mounts_fd = g_open ("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC, 0);
+  } else if (! mount_table_changed ()) {
+    return;
+  }
+
+  g_hash_table_remove_all (mounts);
+  if (mounts_fd >= 0) {
+    contents = read_mount_table (mounts_fd);
+  } else {
+    g_file_get_contents ("/proc/self/mountinfo", &contents, NULL, NULL);
+  }
+  if (! contents) {
+    return;
+  }
+  lines = g_strsplit (contents, "\n", 0);
+  for (i = 0; lines[i]; i++) {
+    MountEntry *entry = parse_mountinfo_line (lines[i]);
+
+    /* the last one mounted on a mount point hides the others */
+    if (entry) {
+      g_hash_table_replace (mounts, entry->mount_point, entry);
+    }
+  }
+  g_strfreev (lines);
+  g_free (contents);
+}
+
+/* finds the mount holding the canonical @path, the deepest mount point
+ * containing it.  Must be called with mounts_lock held. */
+static MountEntry *
+lookup_mount (const gchar *path)
+{
+  gchar      *current = g_strdup (path);
+  MountEntry *entry;
+
+  while (! (entry = g_hash_table_lookup (mounts, current))) {
+    gchar *parent = g_path_get_dirname (current);
+
+    if (strcmp (parent, current) == 0) {
+      g_free (parent);
+      break;
+    }
+    g_free (current);
+    current = parent;
+  }
+  g_free (current);
+
+  return entry;
+}
+
+#ifdef __linux__
+/* checks whether the block device @sysfs_path (/sys/dev/block/M:m) is a
+ * dm-crypt mapping, or stacked on one */
+static gboolean
+sysfs_device_is_encrypted (const gchar *sysfs_path,
+                           guint        depth)
+{
+  gchar    *uuid_path;
+  gchar    *uuid = NULL;
+  gchar    *slaves_path;
+  GDir     *slaves;
+  gboolean  encrypted = FALSE;
+
+  uuid_path = g_build_filename (sysfs_path, "dm", "uuid", NULL);
+  if (g_file_get_contents (uuid_path, &uuid, NULL, NULL)) {
+    encrypted = g_str_has_prefix (uuid, "CRYPT-");
+    g_free (uuid);
+  }
+  g_free (uuid_path);
+  if (encrypted || depth >= NW_MOUNT_MAX_DEVICE_DEPTH) {
+    return encrypted;
+  }
+  slaves_path = g_build_filename (sysfs_path, "slaves", NULL);
+  slaves = g_dir_open (slaves_path, 0, NULL);
+  if (slaves) {
+    const gchar *name;
+
+    while (! encrypted && (name = g_dir_read_name (slaves))) {
+      gchar *slave_path = g_build_filename (slaves_path, name, NULL);
+
+      encrypted = sysfs_device_is_encrypted (slave_path, depth + 1);
+      g_free (slave_path);
+    }
+    g_dir_close (slaves);
+  }
+  g_free (slaves_path);
+
+  return encrypted;
+}
+#endif
+
+/* checks whether the device @source is encrypted with dm-crypt */
+static gboolean
+source_is_encrypted (const gchar *source)
+{
+#ifdef __linux__
+  struct stat st;
+
+  if (g_stat (source, &st) == 0 && S_ISBLK (st.st_mode)) {
+    gchar    *sysfs_path;
+    gboolean  encrypted;
+
+    sysfs_path = g_strdup_printf ("/sys/dev/block/%u:%u",
+                                  major (st.st_rdev), minor (st.st_rdev));
+    encrypted = sysfs_device_is_encrypted (sysfs_path, 0);
+    g_free (sysfs_path);
+
+    return encrypted;
+  }
+#endif
+
+  return FALSE;
+}
+
+/* classifies the mount @entry */
+static NwMountFlags
+classify_mount (const MountEntry *entry)
+{
+  static const gchar *const remote_types[] = {
+    "9p", "afs", "ceph", "cifs", "davfs", "fuse.rclone", "fuse.s3fs",
+    "fuse.sshfs", "glusterfs", "lustre", "ncpfs", "nfs", "nfs4", "smb3",
+    "smbfs", NULL
+  };
+  const gchar  *type = entry->fs_type;
+  NwMountFlags  flags = 0;
+  guint         i;
+
+  if (strcmp (type, "tmpfs") == 0 || strcmp (type, "ramfs") == 0 ||
+      g_str_has_prefix (entry->source, "/dev/zram")) {
+    flags |= NW_MOUNT_VOLATILE;
+  }
+  if (strcmp (type, "fuse") == 0 || strcmp (type, "fuseblk") == 0 ||
+      g_str_has_prefix (type, "fuse.")) {
+    flags |= NW_MOUNT_FUSE;
+  }
+  for (i = 0; remote_types[i]; i++) {
+    if (strcmp (type, remote_types[i]) == 0) {
+      flags |= NW_MOUNT_REMOTE;
+    }
+  }
+  if (strcmp (type, "btrfs") == 0 || strcmp (type, "zfs") == 0 ||
+      strcmp (type, "bcachefs") == 0) {
+    flags |= NW_MOUNT_COPY_ON_WRITE;
+  }
+  if (has_option (entry->super_options, "compress=") ||
+      has_option (entry->super_options, "compress-force=") ||
+      has_option (entry->super_options, "compress_algorithm=") ||
+      has_option (entry->super_options, "compression=") ||
+      strcmp (type, "squashfs") == 0 || strcmp (type, "erofs") == 0) {
+    flags |= NW_MOUNT_COMPRESSED;
+  }
+  if (has_option (entry->super_options, "data=journal")) {
+    flags |= NW_MOUNT_DATA_JOURNAL;
+  }
+  if (has_option (entry->options, "ro")) {
+    flags |= NW_MOUNT_READ_ONLY;
+  }
+  if (! (flags & (NW_MOUNT_VOLATILE | NW_MOUNT_REMOTE)) &&
+      source_is_encrypted (entry->source)) {
+    flags |= NW_MOUNT_ENCRYPTED;
+  }
+
+  return flags;
+}
+
+/* gets the canonical form of @path, or of its deepest existing parent if it
+ * doesn't exist (anymore) */
+static gchar *
+canonicalize_existing (const gchar *path)
+{
+  gchar *current = g_strdup (path);
+  gchar *real;
+
+  while (! (real = realpath (current, NULL))) {
+    gchar *parent = g_path_get_dirname (current);
+
+    if (strcmp (parent, current) == 0) {
+      g_free (parent);
+      return current;
+    }
+    g_free (current);
+    current = parent;
+  }
+  g_free (current);
+  current = g_strdup (real);
+  free (real);
+
+  return current;
+}
+
+/* gets the mount point of @path, and if @flags is not %NULL, classifies it */
+static gchar *
+find_mount (const gchar  *path,
+            NwMountFlags *flags)
+{
+  MountEntry *entry;
+  gchar      *canonical;
+  gchar      *mount_point = NULL;
+
+  canonical = canonicalize_existing (path);
+  g_mutex_lock (&mounts_lock);
+  update_mounts ();
+  entry = lookup_mount (canonical);
+  if (entry) {
+    mount_point = g_strdup (entry->mount_point);
+    if (flags) {
+      if (! entry->classified) {
+        entry->flags = classify_mount (entry);
+        entry->classified = TRUE;
+      }
+      *flags = entry->flags;
+    }
+  }
+  g_mutex_unlock (&mounts_lock);
+  g_free (canonical);
+
+  return mount_point;
+}
+
+/*
+ * nw_mount_get_mount_point:
+ * @path: A path
+ *
+ * Finds the mount point of @path, without classifying its mount.
+ *
+ * Returns: The mount point of @path, or %NULL if not found.  Free with
+ *          g_free().
+ */
+gchar *
+nw_mount_get_mount_point (const gchar *path)
+{
+  return find_mount (path, NULL);
+}
+
+/*
+ * nw_mount_probe:
+ * @path: A path
+ * @mount_point: (out) (allow-none): return location for the mount point of
+ *               @path, or %NULL
+ *
+ * Classifies the mount holding @path.  Mounts are only classified once, later
+ * calls for paths on the same mount are cheap.
+ *
+ * Returns: The flags of @path's mount, 0 if unknown.
+ */
+NwMountFlags
+nw_mount_probe (const gchar  *path,
+                gchar       **mount_point)
+{
+  NwMountFlags  flags = 0;
+  gchar        *found;
+
+  found = find_mount (path, &flags);
+  if (mount_point) {
+    *mount_point = found;
+  } else {
+    g_free (found);
+  }
+
+  return flags;
+}
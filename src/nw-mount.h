@@ -0,0 +1,66 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_MOUNT_H
+#define NW_MOUNT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+/**
+ * NwMountFlags:
+ * @NW_MOUNT_VOLATILE: The data lives in memory (tmpfs, ramfs, zram)
+ * @NW_MOUNT_FUSE: The file system is implemented in user space
+ * @NW_MOUNT_REMOTE: The data lives on another machine
+ * @NW_MOUNT_COPY_ON_WRITE: Overwriting writes new blocks, leaving the data in
+ *                          place
+ * @NW_MOUNT_COMPRESSED: Written data is compressed, so repetitive patterns
+ *                       take next to no room
+ * @NW_MOUNT_ENCRYPTED: The underlying device is encrypted with dm-crypt
+ * @NW_MOUNT_DATA_JOURNAL: Data goes through the journal before reaching its
+ *                         place, which may keep copies of it
+ * @NW_MOUNT_READ_ONLY: The mount can't be written to
+ *
+ * What matters to wiping about a mount.
+ */
+typedef enum
+{
+  NW_MOUNT_VOLATILE       = 1 << 0,
+  NW_MOUNT_FUSE           = 1 << 1,
+  NW_MOUNT_REMOTE         = 1 << 2,
+  NW_MOUNT_COPY_ON_WRITE  = 1 << 3,
+  NW_MOUNT_COMPRESSED     = 1 << 4,
+  NW_MOUNT_ENCRYPTED      = 1 << 5,
+  NW_MOUNT_DATA_JOURNAL   = 1 << 6,
+  NW_MOUNT_READ_ONLY      = 1 << 7
+} NwMountFlags;
+
+
+NwMountFlags  nw_mount_probe            (const gchar  *path,
+                                         gchar       **mount_point);
+gchar        *nw_mount_get_mount_point  (const gchar  *path);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -32,7 +32,9 @@
 #include <gtk/gtk.h>
 #include <gsecuredelete.h>
 
+#include "nw-device.h"
 #include "nw-progress-dialog.h"
+#include "nw-scan.h"
 #include "nw-compat.h"
 
 
@@ -152,6 +154,10 @@ struct NwOperationData
   gchar              *failed_primary_text;
   gchar              *success_primary_text;
   gchar              *success_secondary_text;
+  /* throughput estimation */
+  gint64              rate_time;  /* when the last sample was taken, or 0 */
+  guint64             rate_bytes; /* bytes done at that time */
+  gdouble             rate;       /* smoothed bytes per second, 0 if unknown */
 };
 
 /* Frees a NwOperationData structure */
@@ -261,26 +267,123 @@ operation_finished_handler (GsdAsyncOperation  *operation,
   if (! success || error) {
     display_operation_error (opdata, success, error);
   } else {
+    gchar *report = nw_operation_get_report (opdata->operation);
+    gchar *secondary_text = NULL;
+
+    if (report && opdata->success_secondary_text) {
+      secondary_text = g_strdup_printf ("%s\n\n%s",
+                                        opdata->success_secondary_text, report);
+    }
     display_dialog (opdata->window, GTK_MESSAGE_INFO, FALSE, opdata->title,
                     opdata->success_primary_text,
-                    opdata->success_secondary_text,
+                    secondary_text ? secondary_text
+                                   : report ? report
+                                            : opdata->success_secondary_text,
                     "_Close", GTK_RESPONSE_CLOSE,
                     NULL);
+    g_free (secondary_text);
+    g_free (report);
   }
   free_opdata (opdata);
 }
 
+/* minimal delay between two throughput samples, in microseconds */
+#define THROUGHPUT_SAMPLE_INTERVAL  G_USEC_PER_SEC
+/* weight of the last sample in the throughput, the rest being the history */
+#define THROUGHPUT_SMOOTHING        0.3
+
+/* formats a remaining time, rounded to its most significant unit */
+static gchar *
+format_time_left (gdouble seconds)
+{
+  guint n = (guint) MIN (seconds, G_MAXUINT - 1800);
+
+  if (n < 60) {
+    return g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                         "%u second", "%u seconds", n), n);
+  } else if (n < 3600 - 30) {
+    n = (n + 30) / 60;
+    return g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                         "%u minute", "%u minutes", n), n);
+  } else {
+    n = (n + 1800) / 3600;
+    return g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                         "%u hour", "%u hours", n), n);
+  }
+}
+
+/* samples the progress of the operation in bytes to estimate its throughput
+ * and the time left.
+ * Returns: A text describing them, or %NULL if unknown */
+static gchar *
+get_throughput_text (struct NwOperationData *opdata)
+{
+  gint64    now = g_get_monotonic_time ();
+  guint64   done;
+  guint64   total;
+  gchar    *speed;
+  gchar    *text;
+
+  if (! nw_operation_get_byte_progress (opdata->operation, &done, &total)) {
+    return NULL;
+  }
+  if (opdata->rate_time == 0 || done < opdata->rate_bytes ||
+      nw_progress_dialog_get_paused (opdata->progress_dialog)) {
+    /* (re)start sampling */
+    opdata->rate_time = now;
+    opdata->rate_bytes = done;
+  } else if (now - opdata->rate_time >= THROUGHPUT_SAMPLE_INTERVAL) {
+    gdouble rate = (gdouble) (done - opdata->rate_bytes) * G_USEC_PER_SEC /
+                   (now - opdata->rate_time);
+
+    if (opdata->rate > 0) {
+      rate = rate * THROUGHPUT_SMOOTHING +
+             opdata->rate * (1.0 - THROUGHPUT_SMOOTHING);
+    }
+    opdata->rate = rate;
+    opdata->rate_time = now;
+    opdata->rate_bytes = done;
+  }
+  if (opdata->rate < 1.0) {
+    return NULL;
+  }
+
+  speed = g_format_size ((guint64) opdata->rate);
+  if (total > done) {
+    gchar *left = format_time_left ((total - done) / opdata->rate);
+
+    /* TRANSLATORS: the first placeholder is a size like "12.5 MB", the
+     * second a time like "3 minutes" */
+    text = g_strdup_printf (_("%s/s, about %s left"), speed, left);
+    g_free (left);
+  } else {
+    /* TRANSLATORS: the placeholder is a size like "12.5 MB" */
+    text = g_strdup_printf (_("%s/s"), speed);
+  }
+  g_free (speed);
+
+  return text;
+}
+
 static void
 update_operation_progress (struct NwOperationData  *opdata,
                            gdouble                  fraction)
 {
   gchar *step = nw_operation_get_progress_step (opdata->operation);
+  gchar *throughput = get_throughput_text (opdata);
 
   nw_progress_dialog_set_fraction (opdata->progress_dialog, fraction);
-  nw_progress_dialog_set_progress_text (opdata->progress_dialog,
-                                        step ? "%s" : NULL, step);
+  if (step && throughput) {
+    nw_progress_dialog_set_progress_text (opdata->progress_dialog,
+                                          "%s\n%s", step, throughput);
+  } else {
+    nw_progress_dialog_set_progress_text (opdata->progress_dialog,
+                                          step || throughput ? "%s" : NULL,
+                                          step ? step : throughput);
+  }
 
   g_free (step);
+  g_free (throughput);
 }
 
 static void
@@ -313,6 +416,225 @@ pref_enum_combo_changed_handler (GtkComboBox *combo,
   }
 }
 
+/* bandwidth limits offered, in bytes per second.  0 means no limit */
+static const guint64 bandwidth_limits[] = {
+  0,
+  100 * 1000 * 1000,
+  50 * 1000 * 1000,
+  20 * 1000 * 1000,
+  10 * 1000 * 1000,
+  5 * 1000 * 1000,
+  1 * 1000 * 1000
+};
+
+/* creates a combo box listing the bandwidth limits, @limit being selected.  It
+ * is added to the list if it isn't one of the usual ones */
+static GtkWidget *
+bandwidth_combo_new (guint64 limit)
+{
+  GtkWidget        *combo;
+  GtkListStore     *store;
+  GtkCellRenderer  *renderer;
+  gboolean          found = FALSE;
+  guint             i;
+
+  /* store columns: limit             (guint64)
+   *                descriptive text  (string) */
+  store = gtk_list_store_new (2, G_TYPE_UINT64, G_TYPE_STRING);
+  combo = gtk_combo_box_new_with_model (GTK_TREE_MODEL (store));
+  renderer = gtk_cell_renderer_text_new ();
+  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (combo), renderer, TRUE);
+  gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (combo), renderer,
+                                  "text", 1, NULL);
+  for (i = 0; i <= G_N_ELEMENTS (bandwidth_limits); i++) {
+    GtkTreeIter iter;
+    guint64     value;
+    gchar      *text;
+
+    if (i < G_N_ELEMENTS (bandwidth_limits)) {
+      value = bandwidth_limits[i];
+    } else if (! found) {
+      value = limit;
+    } else {
+      break;
+    }
+    if (value == 0) {
+      text = g_strdup (_("Unlimited"));
+    } else {
+      gchar *size = g_format_size (value);
+
+      /* TRANSLATORS: a speed, %s being a size like "10.0 MB" */
+      text = g_strdup_printf (_("%s/s"), size);
+      g_free (size);
+    }
+    gtk_list_store_append (store, &iter);
+    gtk_list_store_set (store, &iter, 0, value, 1, text, -1);
+    if (value == limit && ! found) {
+      gtk_combo_box_set_active_iter (GTK_COMBO_BOX (combo), &iter);
+      found = TRUE;
+    }
+    g_free (text);
+  }
+
+  return combo;
+}
+
+/* Returns: the limit selected in @combo, created with bandwidth_combo_new() */
+static guint64
+bandwidth_combo_get_limit (GtkComboBox *combo)
+{
+  GtkTreeIter iter;
+  guint64     limit = 0;
+
+  if (gtk_combo_box_get_active_iter (combo, &iter)) {
+    GtkTreeModel *model = gtk_combo_box_get_model (combo);
+
+    gtk_tree_model_get (model, &iter, 0, &limit, -1);
+  }
+
+  return limit;
+}
+
+/* sets @pref to the limit selected in the bandwidth combo */
+static void
+pref_bandwidth_combo_changed_handler (GtkComboBox *combo,
+                                      guint64     *pref)
+{
+  *pref = bandwidth_combo_get_limit (combo);
+}
+
+/* applies the limit selected in the progress dialog's bandwidth combo to the
+ * running operation */
+static void
+progress_bandwidth_combo_changed_handler (GtkComboBox *combo,
+                                          NwOperation *operation)
+{
+  g_object_set (operation,
+                "bandwidth-limit", bandwidth_combo_get_limit (combo),
+                NULL);
+}
+
+/* only lets the settings the secure-delete tools ignore be changed with the
+ * built-in engines.  @rows are the widgets of these settings */
+static void
+engine_combo_changed_handler (GtkComboBox *combo,
+                              GPtrArray   *rows)
+{
+  GtkTreeIter iter;
+  gint        engine = NW_OPERATION_ENGINE_SECURE_DELETE;
+  guint       i;
+
+  if (gtk_combo_box_get_active_iter (combo, &iter)) {
+    gtk_tree_model_get (gtk_combo_box_get_model (combo), &iter, 0, &engine, -1);
+  }
+  for (i = 0; i < rows->len; i++) {
+    gtk_widget_set_sensitive (g_ptr_array_index (rows, i),
+                              engine != NW_OPERATION_ENGINE_SECURE_DELETE);
+  }
+}
+
+/* sets @pref to the discard setting of the selected row of the pass combo */
+static void
+pref_discard_combo_changed_handler (GtkComboBox *combo,
+                                    gboolean    *pref)
+{
+  GtkTreeIter   iter;
+
+  if (gtk_combo_box_get_active_iter (combo, &iter)) {
+    GtkTreeModel *model = gtk_combo_box_get_model (combo);
+
+    gtk_tree_model_get (model, &iter, 3, pref, -1);
+  }
+}
+
+/* appends to @text a warning about the copy-on-write files found so far by
+ * @scan, whose data overwriting won't reach */
+static void
+append_copy_on_write_warning (NwScan  *scan,
+                              GString *text)
+{
+  gchar   **paths;
+  GString  *names;
+  guint     n_files;
+  guint64   n_bytes;
+  gchar    *size;
+  guint     i;
+
+  paths = nw_scan_get_copy_on_write (scan, &n_files, &n_bytes);
+  if (n_files == 0) {
+    g_strfreev (paths);
+    return;
+  }
+  names = g_string_new (NULL);
+  for (i = 0; paths[i]; i++) {
+    gchar *name = g_filename_display_name (paths[i]);
+
+    g_string_append_printf (names, "\n    %s", name);
+    g_free (name);
+  }
+  if (n_files > i) {
+    g_string_append (names, "\n    ");
+    g_string_append_printf (names, g_dngettext (GETTEXT_PACKAGE,
+                                                "and %u more",
+                                                "and %u more",
+                                                n_files - i),
+                            n_files - i);
+  }
+  size = g_format_size (n_bytes);
+  g_string_append (text, "\n\n");
+  g_string_append_printf (text, g_dngettext (GETTEXT_PACKAGE,
+                                             "%u file (%s) is on copy-on-write "
+                                             "storage, where overwriting "
+                                             "leaves the data in place.  It "
+                                             "will only be deleted, wipe the "
+                                             "available disk space afterwards "
+                                             "to erase its data:%s",
+                                             "%u files (%s) are on "
+                                             "copy-on-write storage, where "
+                                             "overwriting leaves the data in "
+                                             "place.  They will only be "
+                                             "deleted, wipe the available disk "
+                                             "space afterwards to erase their "
+                                             "data:%s",
+                                             n_files),
+                          n_files, size, names->str);
+  g_free (size);
+  g_string_free (names, TRUE);
+  g_strfreev (paths);
+}
+
+/* displays the totals found so far by @scan in @label */
+static void
+confirm_scan_notify (NwScan   *scan,
+                     gpointer  label)
+{
+  guint    n_files;
+  guint64  n_bytes;
+  gchar   *size;
+  GString *text;
+
+  nw_scan_get_totals (scan, &n_files, &n_bytes);
+  size = g_format_size (n_bytes);
+  text = g_string_new (NULL);
+  if (nw_scan_is_done (scan)) {
+    g_string_printf (text, g_dngettext (GETTEXT_PACKAGE,
+                                        "%u file, %s in total.",
+                                        "%u files, %s in total.",
+                                        n_files),
+                     n_files, size);
+  } else {
+    g_string_printf (text, g_dngettext (GETTEXT_PACKAGE,
+                                        "Counting files: %u file, %s so far...",
+                                        "Counting files: %u files, %s so far...",
+                                        n_files),
+                     n_files, size);
+  }
+  append_copy_on_write_warning (scan, text);
+  gtk_label_set_text (GTK_LABEL (label), text->str);
+  g_string_free (text, TRUE);
+  g_free (size);
+}
+
 /*
  * operation_confirm_dialog:
  * @parent: Parent window, or %NULL for none
@@ -329,6 +651,17 @@ pref_enum_combo_changed_handler (GtkComboBox *combo,
  *               or %NULL
  * @zeroise: return location for the Gsd.ZeroableOperation:zeroise setting, or
  *           %NULL
+ * @engine: return location for the engine setting, or %NULL
+ * @parallel: return location for the parallel setting, or %NULL
+ * @sync_policy: return location for the sync policy setting, or %NULL
+ * @discard: return location for the discard setting, or %NULL.  It is offered
+ *           as a pass setting, so it requires @delete_mode
+ * @direct_io: return location for the direct I/O setting, or %NULL
+ * @io_class: return location for the I/O class setting, or %NULL
+ * @bandwidth_limit: return location for the bandwidth limit setting, or %NULL
+ * @idle_only: return location for the idle-only setting, or %NULL
+ * @scan: A #NwScan of the selection whose totals to display, or %NULL
+ * @warnings: What the operation tells about its targets, or %NULL
  */
 static gboolean
 operation_confirm_dialog (GtkWindow                    *parent,
@@ -339,11 +672,22 @@ operation_confirm_dialog (GtkWindow                    *parent,
                           GtkWidget                    *confirm_button_icon,
                           gboolean                     *fast,
                           GsdSecureDeleteOperationMode *delete_mode,
-                          gboolean                     *zeroise)
+                          gboolean                     *zeroise,
+                          NwOperationEngine            *engine,
+                          gboolean                     *parallel,
+                          NwOperationSyncPolicy        *sync_policy,
+                          gboolean                     *discard,
+                          gboolean                     *direct_io,
+                          NwOperationIoClass           *io_class,
+                          guint64                      *bandwidth_limit,
+                          gboolean                     *idle_only,
+                          NwScan                       *scan,
+                          const gchar                  *warnings)
 {
   GtkResponseType response = GTK_RESPONSE_NONE;
   GtkWidget      *button;
   GtkWidget      *dialog;
+  GtkWidget      *totals_label = NULL;
 
   dialog = gtk_message_dialog_new (parent,
                                    GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -363,11 +707,39 @@ operation_confirm_dialog (GtkWindow                    *parent,
   if (confirm_button_icon) {
     gtk_button_set_image (GTK_BUTTON (button), confirm_button_icon);
   }
+  /* what the user should know about the targets before going on */
+  if (warnings) {
+    GtkWidget *message_area;
+    GtkWidget *label;
+
+    message_area = gtk_message_dialog_get_message_area (GTK_MESSAGE_DIALOG (dialog));
+    label = gtk_label_new (warnings);
+    gtk_label_set_line_wrap (GTK_LABEL (label), TRUE);
+    gtk_widget_set_halign (label, 0.0);
+    gtk_box_pack_start (GTK_BOX (message_area), label, FALSE, TRUE, 0);
+    gtk_widget_show (label);
+  }
+  /* what the selection holds, counted while the user decides */
+  if (scan) {
+    GtkWidget *message_area;
+
+    message_area = gtk_message_dialog_get_message_area (GTK_MESSAGE_DIALOG (dialog));
+    totals_label = gtk_label_new (NULL);
+    gtk_label_set_line_wrap (GTK_LABEL (totals_label), TRUE);
+    gtk_widget_set_halign (totals_label, 0.0);
+    gtk_box_pack_start (GTK_BOX (message_area), totals_label, FALSE, TRUE, 0);
+    gtk_widget_show (totals_label);
+    confirm_scan_notify (scan, totals_label);
+    nw_scan_set_func (scan, confirm_scan_notify, totals_label);
+  }
   /* if we have settings to choose */
-  if (fast || delete_mode || zeroise) {
+  if (fast || delete_mode || zeroise || engine || parallel || sync_policy ||
+      direct_io || io_class || bandwidth_limit || idle_only) {
     GtkWidget *content_area = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
     GtkWidget *expander;
     GtkWidget *box;
+    GtkWidget *engine_combo = NULL;
+    GPtrArray *built_in_rows = g_ptr_array_new ();
 
     expander = gtk_expander_new_with_mnemonic (_("_Options"));
     gtk_container_add (GTK_CONTAINER (content_area), expander);
@@ -375,22 +747,24 @@ operation_confirm_dialog (GtkWindow                    *parent,
     gtk_container_add (GTK_CONTAINER (expander), box);
     /* delete mode option */
     if (delete_mode) {
-      GtkWidget        *box;
+      GtkWidget        *hbox;
       GtkWidget        *label;
       GtkWidget        *combo;
       GtkListStore     *store;
       GtkCellRenderer  *renderer;
 
-      box = gtk_box_new (FALSE, 5);
-      gtk_box_pack_start (GTK_BOX (box), box, FALSE, TRUE, 0);
+      hbox = gtk_box_new (FALSE, 5);
+      gtk_box_pack_start (GTK_BOX (box), hbox, FALSE, TRUE, 0);
       label = gtk_label_new_with_mnemonic (_("Number of _passes:"));
       gtk_widget_set_halign (label, 0.0);
       gtk_widget_set_valign (label, 0.5);
-      gtk_box_pack_start (GTK_BOX (box), label, TRUE, TRUE, 0);
+      gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
       /* store columns: setting value     (enum)
        *                number of passes  (int)
-       *                descriptive text  (string) */
-      store = gtk_list_store_new (3, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING);
+       *                descriptive text  (string)
+       *                discard setting   (boolean) */
+      store = gtk_list_store_new (4, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING,
+                                  G_TYPE_BOOLEAN);
       combo = gtk_combo_box_new_with_model (GTK_TREE_MODEL (store));
       gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
       /* number of passes column */
@@ -406,30 +780,42 @@ operation_confirm_dialog (GtkWindow                    *parent,
       /* Adds an item.
        * @value: the setting to return if selected
        * @n_pass: the number of pass this setting shows
-       * @text: description text for this setting */
-      #define ADD_ITEM(value, n_pass, text)                                    \
+       * @text: description text for this setting
+       * @discard_value: the discard setting to return if selected */
+      #define ADD_ITEM(value, n_pass, text, discard_value)                     \
         G_STMT_START {                                                         \
           GtkTreeIter iter;                                                    \
                                                                                \
           gtk_list_store_append (store, &iter);                                \
-          gtk_list_store_set (store, &iter, 0, value, 1, #n_pass, 2, text, -1);\
-          if (value == *delete_mode) {                                         \
+          gtk_list_store_set (store, &iter, 0, value, 1, #n_pass, 2, text,     \
+                              3, discard_value, -1);                           \
+          if (value == *delete_mode &&                                         \
+              discard_value == (discard ? *discard : FALSE)) {                 \
               gtk_combo_box_set_active_iter (GTK_COMBO_BOX (combo), &iter);    \
           }                                                                    \
         } G_STMT_END
       /* add items */
       ADD_ITEM (GSD_SECURE_DELETE_OPERATION_MODE_NORMAL,
-                38, _("(Gutmann method for old disks)"));
+                38, _("(Gutmann method for old disks)"), FALSE);
       ADD_ITEM (GSD_SECURE_DELETE_OPERATION_MODE_INSECURE,
-                2, _("(advised for modern hard disks)"));
+                2, _("(advised for modern hard disks)"), FALSE);
       ADD_ITEM (GSD_SECURE_DELETE_OPERATION_MODE_VERY_INSECURE,
-                1, _("(only protects against software attacks)"));
+                1, _("(only protects against software attacks)"), FALSE);
+      /* only offered if some of the files are on a device supporting it */
+      if (discard) {
+        ADD_ITEM (GSD_SECURE_DELETE_OPERATION_MODE_VERY_INSECURE,
+                  1, _("(then discard the freed blocks, for SSDs)"), TRUE);
+      }
 
       #undef ADD_ITEM
       /* connect change & pack */
       g_signal_connect (combo, "changed",
                         G_CALLBACK (pref_enum_combo_changed_handler), delete_mode);
-      gtk_box_pack_start (GTK_BOX (box), combo, FALSE, TRUE, 0);
+      if (discard) {
+        g_signal_connect (combo, "changed",
+                          G_CALLBACK (pref_discard_combo_changed_handler), discard);
+      }
+      gtk_box_pack_start (GTK_BOX (hbox), combo, FALSE, TRUE, 0);
     }
     /* fast option */
     if (fast) {
@@ -455,10 +841,237 @@ operation_confirm_dialog (GtkWindow                    *parent,
                         G_CALLBACK (pref_bool_toggle_changed_handler), zeroise);
       gtk_box_pack_start (GTK_BOX (box), check, FALSE, TRUE, 0);
     }
+    /* engine option */
+    if (engine) {
+      GtkWidget        *hbox;
+      GtkWidget        *label;
+      GtkWidget        *combo;
+      GtkListStore     *store;
+      GtkCellRenderer  *renderer;
+
+      hbox = gtk_box_new (FALSE, 5);
+      gtk_box_pack_start (GTK_BOX (box), hbox, FALSE, TRUE, 0);
+      label = gtk_label_new_with_mnemonic (_("Wipe _engine:"));
+      gtk_widget_set_halign (label, 0.0);
+      gtk_widget_set_valign (label, 0.5);
+      gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+      /* store columns: setting value     (enum)
+       *                descriptive text  (string) */
+      store = gtk_list_store_new (2, G_TYPE_INT, G_TYPE_STRING);
+      combo = gtk_combo_box_new_with_model (GTK_TREE_MODEL (store));
+      gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+      renderer = gtk_cell_renderer_text_new ();
+      gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (combo), renderer, TRUE);
+      gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (combo), renderer,
+                                      "text", 1, NULL);
+      /* Adds an item.
+       * @value: the setting to return if selected
+       * @text: description text for this setting */
+      #define ADD_ITEM(value, text)                                            \
+        G_STMT_START {                                                         \
+          GtkTreeIter iter;                                                    \
+                                                                               \
+          gtk_list_store_append (store, &iter);                                \
+          gtk_list_store_set (store, &iter, 0, value, 1, text, -1);            \
+          if (value == *engine) {                                              \
+              gtk_combo_box_set_active_iter (GTK_COMBO_BOX (combo), &iter);    \
+          }                                                                    \
+        } G_STMT_END
+      /* add items */
+      ADD_ITEM (NW_OPERATION_ENGINE_NATIVE,
+                _("Built-in"));
+      #ifdef HAVE_LINUX_IO_URING_H
+      ADD_ITEM (NW_OPERATION_ENGINE_IO_URING,
+                _("Built-in, asynchronous (io_uring)"));
+      #endif
+      ADD_ITEM (NW_OPERATION_ENGINE_SECURE_DELETE,
+                _("External secure-delete tools"));
+
+      #undef ADD_ITEM
+      /* connect change & pack */
+      g_signal_connect (combo, "changed",
+                        G_CALLBACK (pref_enum_combo_changed_handler), engine);
+      gtk_box_pack_start (GTK_BOX (hbox), combo, FALSE, TRUE, 0);
+      engine_combo = combo;
+    }
+    /* sync policy option */
+    if (sync_policy) {
+      GtkWidget        *hbox;
+      GtkWidget        *label;
+      GtkWidget        *combo;
+      GtkListStore     *store;
+      GtkCellRenderer  *renderer;
+
+      hbox = gtk_box_new (FALSE, 5);
+      gtk_box_pack_start (GTK_BOX (box), hbox, FALSE, TRUE, 0);
+      label = gtk_label_new_with_mnemonic (_("S_ynchronize data:"));
+      gtk_widget_set_halign (label, 0.0);
+      gtk_widget_set_valign (label, 0.5);
+      gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+      /* store columns: setting value     (enum)
+       *                descriptive text  (string) */
+      store = gtk_list_store_new (2, G_TYPE_INT, G_TYPE_STRING);
+      combo = gtk_combo_box_new_with_model (GTK_TREE_MODEL (store));
+      gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+      renderer = gtk_cell_renderer_text_new ();
+      gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (combo), renderer, TRUE);
+      gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (combo), renderer,
+                                      "text", 1, NULL);
+      /* Adds an item.
+       * @value: the setting to return if selected
+       * @text: description text for this setting */
+      #define ADD_ITEM(value, text)                                            \
+        G_STMT_START {                                                         \
+          GtkTreeIter iter;                                                    \
+                                                                               \
+          gtk_list_store_append (store, &iter);                                \
+          gtk_list_store_set (store, &iter, 0, value, 1, text, -1);            \
+          if (value == *sync_policy) {                                         \
+              gtk_combo_box_set_active_iter (GTK_COMBO_BOX (combo), &iter);    \
+          }                                                                    \
+        } G_STMT_END
+      /* add items */
+      ADD_ITEM (NW_OPERATION_SYNC_PER_WRITE,
+                _("After each write (slowest)"));
+      ADD_ITEM (NW_OPERATION_SYNC_PER_PASS,
+                _("After each pass"));
+      ADD_ITEM (NW_OPERATION_SYNC_PER_BATCH,
+                _("After each pass, small files together"));
+      ADD_ITEM (NW_OPERATION_SYNC_STREAMING,
+                _("Continuously, and after each pass"));
+
+      #undef ADD_ITEM
+      /* connect change & pack */
+      g_signal_connect (combo, "changed",
+                        G_CALLBACK (pref_enum_combo_changed_handler), sync_policy);
+      gtk_box_pack_start (GTK_BOX (hbox), combo, FALSE, TRUE, 0);
+      g_ptr_array_add (built_in_rows, hbox);
+    }
+    /* direct I/O option */
+    if (direct_io) {
+      GtkWidget *check;
+
+      check = gtk_check_button_new_with_mnemonic (
+        _("_Bypass the system cache (direct I/O)")
+      );
+      gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (check), *direct_io);
+      g_signal_connect (check, "toggled",
+                        G_CALLBACK (pref_bool_toggle_changed_handler), direct_io);
+      gtk_box_pack_start (GTK_BOX (box), check, FALSE, TRUE, 0);
+      g_ptr_array_add (built_in_rows, check);
+    }
+    /* I/O class option */
+    if (io_class) {
+      GtkWidget        *hbox;
+      GtkWidget        *label;
+      GtkWidget        *combo;
+      GtkListStore     *store;
+      GtkCellRenderer  *renderer;
+
+      hbox = gtk_box_new (FALSE, 5);
+      gtk_box_pack_start (GTK_BOX (box), hbox, FALSE, TRUE, 0);
+      label = gtk_label_new_with_mnemonic (_("Disk _priority:"));
+      gtk_widget_set_halign (label, 0.0);
+      gtk_widget_set_valign (label, 0.5);
+      gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+      /* store columns: setting value     (enum)
+       *                descriptive text  (string) */
+      store = gtk_list_store_new (2, G_TYPE_INT, G_TYPE_STRING);
+      combo = gtk_combo_box_new_with_model (GTK_TREE_MODEL (store));
+      gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+      renderer = gtk_cell_renderer_text_new ();
+      gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (combo), renderer, TRUE);
+      gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (combo), renderer,
+                                      "text", 1, NULL);
+      /* Adds an item.
+       * @value: the setting to return if selected
+       * @text: description text for this setting */
+      #define ADD_ITEM(value, text)                                            \
+        G_STMT_START {                                                         \
+          GtkTreeIter iter;                                                    \
+                                                                               \
+          gtk_list_store_append (store, &iter);                                \
+          gtk_list_store_set (store, &iter, 0, value, 1, text, -1);            \
+          if (value == *io_class) {                                            \
+              gtk_combo_box_set_active_iter (GTK_COMBO_BOX (combo), &iter);    \
+          }                                                                    \
+        } G_STMT_END
+      /* add items */
+      ADD_ITEM (NW_OPERATION_IO_CLASS_NORMAL,
+                _("Normal"));
+      ADD_ITEM (NW_OPERATION_IO_CLASS_LOW,
+                _("Low"));
+      ADD_ITEM (NW_OPERATION_IO_CLASS_IDLE,
+                _("Only when the disk is otherwise unused"));
+
+      #undef ADD_ITEM
+      /* connect change & pack */
+      g_signal_connect (combo, "changed",
+                        G_CALLBACK (pref_enum_combo_changed_handler), io_class);
+      gtk_box_pack_start (GTK_BOX (hbox), combo, FALSE, TRUE, 0);
+    }
+    /* bandwidth limit option */
+    if (bandwidth_limit) {
+      GtkWidget *hbox;
+      GtkWidget *label;
+      GtkWidget *combo;
+
+      hbox = gtk_box_new (FALSE, 5);
+      gtk_box_pack_start (GTK_BOX (box), hbox, FALSE, TRUE, 0);
+      label = gtk_label_new_with_mnemonic (_("Speed _limit:"));
+      gtk_widget_set_halign (label, 0.0);
+      gtk_widget_set_valign (label, 0.5);
+      gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+      combo = bandwidth_combo_new (*bandwidth_limit);
+      gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+      g_signal_connect (combo, "changed",
+                        G_CALLBACK (pref_bandwidth_combo_changed_handler),
+                        bandwidth_limit);
+      gtk_box_pack_start (GTK_BOX (hbox), combo, FALSE, TRUE, 0);
+      g_ptr_array_add (built_in_rows, hbox);
+    }
+    /* idle-only option */
+    if (idle_only) {
+      GtkWidget *check;
+
+      check = gtk_check_button_new_with_mnemonic (
+        _("Only wipe while the disk is _idle")
+      );
+      gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (check), *idle_only);
+      g_signal_connect (check, "toggled",
+                        G_CALLBACK (pref_bool_toggle_changed_handler), idle_only);
+      gtk_box_pack_start (GTK_BOX (box), check, FALSE, TRUE, 0);
+    }
+    /* parallel option */
+    if (parallel) {
+      GtkWidget *check;
+
+      check = gtk_check_button_new_with_mnemonic (
+        _("Wipe independent _devices at the same time")
+      );
+      gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (check), *parallel);
+      g_signal_connect (check, "toggled",
+                        G_CALLBACK (pref_bool_toggle_changed_handler), parallel);
+      gtk_box_pack_start (GTK_BOX (box), check, FALSE, TRUE, 0);
+    }
+    if (engine_combo) {
+      /* the array lives as long as the combo */
+      g_object_set_data_full (G_OBJECT (engine_combo), "built-in-rows",
+                              built_in_rows, (GDestroyNotify) g_ptr_array_unref);
+      g_signal_connect (engine_combo, "changed",
+                        G_CALLBACK (engine_combo_changed_handler),
+                        built_in_rows);
+      engine_combo_changed_handler (GTK_COMBO_BOX (engine_combo), built_in_rows);
+    } else {
+      g_ptr_array_unref (built_in_rows);
+    }
     gtk_widget_show_all (expander);
   }
   /* run the dialog */
   response = gtk_dialog_run (GTK_DIALOG (dialog));
+  if (scan) {
+    nw_scan_set_func (scan, NULL, NULL);
+  }
   gtk_widget_destroy (dialog);
 
   return response == GTK_RESPONSE_ACCEPT;
@@ -479,7 +1092,7 @@ progress_dialog_response_handler (GtkDialog *dialog,
       if (! was_paused) {
         /* we pause the operation while the user things on whether to really
          * cancel or not, so the  */
-        gsd_async_operation_pause (GSD_ASYNC_OPERATION (opdata->operation));
+        nw_operation_pause (opdata->operation);
       }
       if (display_dialog (GTK_WINDOW (dialog), GTK_MESSAGE_QUESTION, TRUE,
                           opdata->title,
@@ -489,21 +1102,24 @@ progress_dialog_response_handler (GtkDialog *dialog,
                           _("Resume operation"), GTK_RESPONSE_REJECT,
                           _("Cancel operation"), GTK_RESPONSE_ACCEPT,
                           NULL) == GTK_RESPONSE_ACCEPT) {
-        gsd_async_operation_cancel (GSD_ASYNC_OPERATION (opdata->operation));
+        nw_operation_cancel (opdata->operation);
       } else if (! was_paused) {
-        gsd_async_operation_resume (GSD_ASYNC_OPERATION (opdata->operation));
+        nw_operation_resume (opdata->operation);
+        opdata->rate_time = 0;
       }
       break;
     }
 
     case NW_PROGRESS_DIALOG_RESPONSE_PAUSE:
       nw_progress_dialog_set_paused (NW_PROGRESS_DIALOG (dialog),
-                                     gsd_async_operation_pause (GSD_ASYNC_OPERATION (opdata->operation)));
+                                     nw_operation_pause (opdata->operation));
       break;
 
     case NW_PROGRESS_DIALOG_RESPONSE_RESUME:
       nw_progress_dialog_set_paused (NW_PROGRESS_DIALOG (dialog),
-                                     ! gsd_async_operation_resume (GSD_ASYNC_OPERATION (opdata->operation)));
+                                     ! nw_operation_resume (opdata->operation));
+      /* don't count the pause in the throughput */
+      opdata->rate_time = 0;
       break;
 
     default:
@@ -549,11 +1165,97 @@ nw_operation_manager_run (GtkWindow    *parent,
   gboolean                      fast        = FALSE;
   GsdSecureDeleteOperationMode  delete_mode = GSD_SECURE_DELETE_OPERATION_MODE_INSECURE;
   gboolean                      zeroise     = FALSE;
+  NwOperationEngine             engine      = NW_OPERATION_ENGINE_SECURE_DELETE;
+  gboolean                      parallel    = FALSE;
+  gboolean                      discard     = FALSE;
+  gboolean                      direct_io   = FALSE;
+  NwOperationIoClass            io_class    = NW_OPERATION_IO_CLASS_NORMAL;
+  guint64                       bandwidth_limit = 0;
+  gboolean                      idle_only   = FALSE;
+  NwOperationSyncPolicy         sync_policy = NW_OPERATION_SYNC_PER_BATCH;
+  gboolean                      has_engine;
+  gboolean                      has_parallel;
+  gboolean                      has_sync_policy;
+  gboolean                      has_discard;
+  gboolean                      has_direct_io;
+  gboolean                      has_io_class;
+  gboolean                      has_bandwidth_limit;
+  gboolean                      has_idle_only;
+  NwScan                       *scan = NULL;
+  gchar                        *warnings;
+
+  /* the operation knows its targets beforehand so it can tell what it can't
+   * do with them, and adapt */
+  nw_operation_add_files (operation, files);
+  warnings = nw_operation_get_warnings (operation);
+
+  /* operations that count their files before starting are given a head
+   * start: the scan runs while the user reads the confirmation */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                    "scan") != NULL) {
+    scan = nw_scan_new (files, NULL, NULL);
+  }
+
+  /* not all operations have a choice of engine, keep the default for those
+   * which do */
+  has_engine = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                             "engine") != NULL;
+  if (has_engine) {
+    g_object_get (operation, "engine", &engine, NULL);
+  }
+  has_parallel = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                               "parallel") != NULL;
+  if (has_parallel) {
+    g_object_get (operation, "parallel", &parallel, NULL);
+  }
+  has_sync_policy = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                                  "sync-policy") != NULL;
+  if (has_sync_policy) {
+    g_object_get (operation, "sync-policy", &sync_policy, NULL);
+  }
+  /* discarding is only offered when it is useful, and possible: it takes
+   * privileges a desktop session usually doesn't have */
+  has_discard = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                              "discard") != NULL &&
+                nw_device_paths_support_discard (files) &&
+                nw_device_can_trim ();
+  has_direct_io = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                                "direct-io") != NULL;
+  if (has_direct_io) {
+    g_object_get (operation, "direct-io", &direct_io, NULL);
+  }
+  has_io_class = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                               "io-class") != NULL;
+  if (has_io_class) {
+    g_object_get (operation, "io-class", &io_class, NULL);
+  }
+  has_bandwidth_limit = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                                      "bandwidth-limit") != NULL;
+  if (has_bandwidth_limit) {
+    g_object_get (operation, "bandwidth-limit", &bandwidth_limit, NULL);
+  }
+  has_idle_only = g_object_class_find_property (G_OBJECT_GET_CLASS (operation),
+                                                "idle-only") != NULL;
+  if (has_idle_only) {
+    g_object_get (operation, "idle-only", &idle_only, NULL);
+  }
 
   if (! operation_confirm_dialog (parent, title,
                                   confirm_primary_text, confirm_secondary_text,
                                   confirm_button_text, confirm_button_icon,
-                                  &fast, &delete_mode, &zeroise)) {
+                                  &fast, &delete_mode, &zeroise,
+                                  has_engine ? &engine : NULL,
+                                  has_parallel ? &parallel : NULL,
+                                  has_sync_policy ? &sync_policy : NULL,
+                                  has_discard ? &discard : NULL,
+                                  has_direct_io ? &direct_io : NULL,
+                                  has_io_class ? &io_class : NULL,
+                                  has_bandwidth_limit ? &bandwidth_limit : NULL,
+                                  has_idle_only ? &idle_only : NULL,
+                                  scan, warnings)) {
+    if (scan) {
+      nw_scan_free (scan);
+    }
     g_object_unref (operation);
   } else {
     GError                 *err = NULL;
@@ -575,20 +1277,76 @@ nw_operation_manager_run (GtkWindow    *parent,
     opdata->success_primary_text = g_strdup (success_primary_text);
     opdata->success_secondary_text = g_strdup (success_secondary_text);
     opdata->operation = operation;
+    if (scan) {
+      /* the operation takes it over */
+      g_object_set (operation, "scan", scan, NULL);
+    }
+    opdata->rate_time = 0;
+    opdata->rate_bytes = 0;
+    opdata->rate = 0.0;
     g_object_set (operation,
                   "fast", fast,
                   "mode", delete_mode,
                   "zeroise", zeroise,
                   NULL);
+    if (has_engine) {
+      g_object_set (operation, "engine", engine, NULL);
+      /* the secure-delete tools only know the settings they're given */
+      if (engine == NW_OPERATION_ENGINE_SECURE_DELETE) {
+        has_sync_policy = FALSE;
+        has_direct_io = FALSE;
+        has_bandwidth_limit = FALSE;
+      }
+    }
+    if (has_parallel) {
+      g_object_set (operation, "parallel", parallel, NULL);
+    }
+    if (has_sync_policy) {
+      g_object_set (operation, "sync-policy", sync_policy, NULL);
+    }
+    if (has_discard) {
+      g_object_set (operation, "discard", discard, NULL);
+    }
+    if (has_direct_io) {
+      g_object_set (operation, "direct-io", direct_io, NULL);
+    }
+    if (has_io_class) {
+      g_object_set (operation, "io-class", io_class, NULL);
+    }
+    if (has_idle_only) {
+      g_object_set (operation, "idle-only", idle_only, NULL);
+    }
+    if (has_bandwidth_limit) {
+      GtkWidget *content_area;
+      GtkWidget *hbox;
+      GtkWidget *label;
+      GtkWidget *combo;
+
+      g_object_set (operation, "bandwidth-limit", bandwidth_limit, NULL);
+      /* the limit can be changed while running */
+      content_area = gtk_dialog_get_content_area (GTK_DIALOG (opdata->progress_dialog));
+      hbox = gtk_box_new (FALSE, 5);
+      gtk_container_set_border_width (GTK_CONTAINER (hbox), 5);
+      gtk_box_pack_start (GTK_BOX (content_area), hbox, FALSE, TRUE, 0);
+      label = gtk_label_new_with_mnemonic (_("Speed _limit:"));
+      gtk_widget_set_halign (label, 0.0);
+      gtk_widget_set_valign (label, 0.5);
+      gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+      combo = bandwidth_combo_new (bandwidth_limit);
+      gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+      g_signal_connect (combo, "changed",
+                        G_CALLBACK (progress_bandwidth_combo_changed_handler),
+                        operation);
+      gtk_box_pack_start (GTK_BOX (hbox), combo, FALSE, TRUE, 0);
+      gtk_widget_show_all (hbox);
+    }
     g_signal_connect (opdata->operation, "finished",
                       G_CALLBACK (operation_finished_handler), opdata);
     g_signal_connect (opdata->operation, "progress",
                       G_CALLBACK (operation_progress_handler), opdata);
 
-    nw_operation_add_files (opdata->operation, files);
-    if (! gsd_secure_delete_operation_run (GSD_SECURE_DELETE_OPERATION (opdata->operation),
-                                           &err)) {
-      if (err->code == G_SPAWN_ERROR_NOENT) {
+    if (! nw_operation_run (opdata->operation, &err)) {
+      if (err->domain == G_SPAWN_ERROR && err->code == G_SPAWN_ERROR_NOENT) {
         gchar *message;
 
         /* Merge the error message with our. Pretty much a hack, but should be
@@ -612,4 +1370,5 @@ nw_operation_manager_run (GtkWindow    *parent,
       gtk_widget_show (GTK_WIDGET (opdata->progress_dialog));
     }
   }
+  g_free (warnings);
 }
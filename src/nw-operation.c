@@ -27,9 +27,91 @@
 #include <gsecuredelete.h>
 
 
-static void   nw_operation_real_add_files           (NwOperation *self,
-                                                     GList       *files);
-static gchar *nw_operation_real_get_progress_step   (NwOperation *self);
+static void     nw_operation_real_add_files           (NwOperation *self,
+                                                       GList       *files);
+static gchar   *nw_operation_real_get_progress_step   (NwOperation *self);
+static gchar   *nw_operation_real_get_report          (NwOperation *self);
+static gchar   *nw_operation_real_get_warnings        (NwOperation *self);
+static gboolean nw_operation_real_get_byte_progress   (NwOperation *self,
+                                                       guint64     *done,
+                                                       guint64     *total);
+static gboolean nw_operation_real_run                 (NwOperation *self,
+                                                       GError     **error);
+static gboolean nw_operation_real_pause               (NwOperation *self);
+static gboolean nw_operation_real_resume              (NwOperation *self);
+static void     nw_operation_real_cancel              (NwOperation *self);
+
+
+GType
+nw_operation_engine_get_type (void)
+{
+  static volatile gsize type = 0;
+
+  if (g_once_init_enter (&type)) {
+    static const GEnumValue values[] = {
+      { NW_OPERATION_ENGINE_SECURE_DELETE,
+        "NW_OPERATION_ENGINE_SECURE_DELETE", "secure-delete" },
+      { NW_OPERATION_ENGINE_NATIVE,
+        "NW_OPERATION_ENGINE_NATIVE", "native" },
+      { NW_OPERATION_ENGINE_IO_URING,
+        "NW_OPERATION_ENGINE_IO_URING", "io-uring" },
+      { 0, NULL, NULL }
+    };
+    GType t = g_enum_register_static ("NwOperationEngine", values);
+
+    g_once_init_leave (&type, t);
+  }
+
+  return (GType) type;
+}
+
+GType
+nw_operation_sync_policy_get_type (void)
+{
+  static volatile gsize type = 0;
+
+  if (g_once_init_enter (&type)) {
+    static const GEnumValue values[] = {
+      { NW_OPERATION_SYNC_PER_WRITE,
+        "NW_OPERATION_SYNC_PER_WRITE", "per-write" },
+      { NW_OPERATION_SYNC_PER_PASS,
+        "NW_OPERATION_SYNC_PER_PASS", "per-pass" },
+      { NW_OPERATION_SYNC_PER_BATCH,
+        "NW_OPERATION_SYNC_PER_BATCH", "per-batch" },
+      { NW_OPERATION_SYNC_STREAMING,
+        "NW_OPERATION_SYNC_STREAMING", "streaming" },
+      { 0, NULL, NULL }
+    };
+    GType t = g_enum_register_static ("NwOperationSyncPolicy", values);
+
+    g_once_init_leave (&type, t);
+  }
+
+  return (GType) type;
+}
+
+GType
+nw_operation_io_class_get_type (void)
+{
+  static volatile gsize type = 0;
+
+  if (g_once_init_enter (&type)) {
+    static const GEnumValue values[] = {
+      { NW_OPERATION_IO_CLASS_NORMAL,
+        "NW_OPERATION_IO_CLASS_NORMAL", "normal" },
+      { NW_OPERATION_IO_CLASS_LOW,
+        "NW_OPERATION_IO_CLASS_LOW", "low" },
+      { NW_OPERATION_IO_CLASS_IDLE,
+        "NW_OPERATION_IO_CLASS_IDLE", "idle" },
+      { 0, NULL, NULL }
+    };
+    GType t = g_enum_register_static ("NwOperationIoClass", values);
+
+    g_once_init_leave (&type, t);
+  }
+
+  return (GType) type;
+}
 
 
 G_DEFINE_INTERFACE (NwOperation,
@@ -42,6 +124,13 @@ nw_operation_default_init (NwOperationInterface *iface)
 {
   iface->add_files          = nw_operation_real_add_files;
   iface->get_progress_step  = nw_operation_real_get_progress_step;
+  iface->get_report         = nw_operation_real_get_report;
+  iface->get_warnings       = nw_operation_real_get_warnings;
+  iface->get_byte_progress  = nw_operation_real_get_byte_progress;
+  iface->run                = nw_operation_real_run;
+  iface->pause              = nw_operation_real_pause;
+  iface->resume             = nw_operation_real_resume;
+  iface->cancel             = nw_operation_real_cancel;
 }
 
 static void
@@ -61,6 +150,53 @@ nw_operation_real_get_progress_step (NwOperation *self)
   return NULL;
 }
 
+static gchar *
+nw_operation_real_get_report (NwOperation *self)
+{
+  return NULL;
+}
+
+static gchar *
+nw_operation_real_get_warnings (NwOperation *self)
+{
+  return NULL;
+}
+
+static gboolean
+nw_operation_real_get_byte_progress (NwOperation *self,
+                                     guint64     *done,
+                                     guint64     *total)
+{
+  return FALSE;
+}
+
+/* by default, operations are run by libgsecuredelete */
+static gboolean
+nw_operation_real_run (NwOperation *self,
+                       GError     **error)
+{
+  return gsd_secure_delete_operation_run (GSD_SECURE_DELETE_OPERATION (self),
+                                          error);
+}
+
+static gboolean
+nw_operation_real_pause (NwOperation *self)
+{
+  return gsd_async_operation_pause (GSD_ASYNC_OPERATION (self));
+}
+
+static gboolean
+nw_operation_real_resume (NwOperation *self)
+{
+  return gsd_async_operation_resume (GSD_ASYNC_OPERATION (self));
+}
+
+static void
+nw_operation_real_cancel (NwOperation *self)
+{
+  gsd_async_operation_cancel (GSD_ASYNC_OPERATION (self));
+}
+
 void
 nw_operation_add_file (NwOperation *self,
                        const gchar *file)
@@ -80,3 +216,94 @@ nw_operation_get_progress_step (NwOperation *self)
 {
   return NW_OPERATION_GET_INTERFACE (self)->get_progress_step (self);
 }
+
+/*
+ * nw_operation_get_report:
+ * @self: A #NwOperation
+ *
+ * Gets a summary of how the last run of @self went, for the user to know what
+ * actually happened beyond success.
+ *
+ * Returns: A newly allocated string, or %NULL if there is nothing to report.
+ */
+gchar *
+nw_operation_get_report (NwOperation *self)
+{
+  return NW_OPERATION_GET_INTERFACE (self)->get_report (self);
+}
+
+/*
+ * nw_operation_get_warnings:
+ * @self: A #NwOperation
+ *
+ * Gets what the user should know before running @self on the files added so
+ * far, e.g. targets it won't be able to wipe properly, and how it adapted to
+ * them.
+ *
+ * Returns: A newly allocated string, or %NULL if there is nothing to warn
+ *          about.
+ */
+gchar *
+nw_operation_get_warnings (NwOperation *self)
+{
+  return NW_OPERATION_GET_INTERFACE (self)->get_warnings (self);
+}
+
+/*
+ * nw_operation_get_byte_progress:
+ * @self: A #NwOperation
+ * @done: return location for the number of bytes written so far
+ * @total: return location for the number of bytes to write, or 0 if not known
+ *         (yet)
+ *
+ * Gets the progress of a running operation in bytes, all passes included.
+ * Not all operations can tell.
+ *
+ * Returns: %TRUE if @done and @total were set, %FALSE otherwise.
+ */
+gboolean
+nw_operation_get_byte_progress (NwOperation *self,
+                                guint64     *done,
+                                guint64     *total)
+{
+  return NW_OPERATION_GET_INTERFACE (self)->get_byte_progress (self, done,
+                                                               total);
+}
+
+/*
+ * nw_operation_run:
+ * @self: A #NwOperation
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Starts @self asynchronously.  Completion is reported through the
+ * GsdAsyncOperation::finished signal, and progression through
+ * GsdAsyncOperation::progress.
+ *
+ * Returns: %TRUE if the operation was successfully started, %FALSE otherwise.
+ */
+gboolean
+nw_operation_run (NwOperation *self,
+                  GError     **error)
+{
+  return NW_OPERATION_GET_INTERFACE (self)->run (self, error);
+}
+
+/* Returns: whether the operation is now paused */
+gboolean
+nw_operation_pause (NwOperation *self)
+{
+  return NW_OPERATION_GET_INTERFACE (self)->pause (self);
+}
+
+/* Returns: whether the operation was successfully resumed */
+gboolean
+nw_operation_resume (NwOperation *self)
+{
+  return NW_OPERATION_GET_INTERFACE (self)->resume (self);
+}
+
+void
+nw_operation_cancel (NwOperation *self)
+{
+  NW_OPERATION_GET_INTERFACE (self)->cancel (self);
+}
@@ -33,27 +33,114 @@ G_BEGIN_DECLS
 #define NW_IS_OPERATION(o)            (G_TYPE_CHECK_INSTANCE_TYPE ((o), NW_TYPE_OPERATION))
 #define NW_OPERATION_GET_INTERFACE(o) (G_TYPE_INSTANCE_GET_INTERFACE ((o), NW_TYPE_OPERATION, NwOperationInterface))
 
+#define NW_TYPE_OPERATION_ENGINE      (nw_operation_engine_get_type ())
+#define NW_TYPE_OPERATION_SYNC_POLICY (nw_operation_sync_policy_get_type ())
+#define NW_TYPE_OPERATION_IO_CLASS    (nw_operation_io_class_get_type ())
+
 typedef struct _NwOperation           NwOperation;
 typedef struct _NwOperationInterface  NwOperationInterface;
 
+/**
+ * NwOperationEngine:
+ * @NW_OPERATION_ENGINE_SECURE_DELETE: Spawn the secure-delete tools through
+ *                                     libgsecuredelete
+ * @NW_OPERATION_ENGINE_NATIVE: Overwrite the data in-process
+ * @NW_OPERATION_ENGINE_IO_URING: Overwrite the data in-process, keeping several
+ *                                writes in flight through io_uring.  Falls back
+ *                                to %NW_OPERATION_ENGINE_NATIVE if io_uring is
+ *                                not available
+ *
+ * The backend actually performing an operation's work.
+ */
+typedef enum
+{
+  NW_OPERATION_ENGINE_SECURE_DELETE,
+  NW_OPERATION_ENGINE_NATIVE,
+  NW_OPERATION_ENGINE_IO_URING
+} NwOperationEngine;
+
+/**
+ * NwOperationSyncPolicy:
+ * @NW_OPERATION_SYNC_PER_WRITE: Wait for each write to reach the disk, like
+ *                               srm(1) does
+ * @NW_OPERATION_SYNC_PER_PASS: Synchronize each file after each pass
+ * @NW_OPERATION_SYNC_PER_BATCH: Like %NW_OPERATION_SYNC_PER_PASS, but files
+ *                               wiped in batches are synchronized all at once
+ * @NW_OPERATION_SYNC_STREAMING: Like %NW_OPERATION_SYNC_PER_BATCH, but large
+ *                               files are also written back continuously while
+ *                               writing, so that they don't fill the page cache
+ *                               with dirty data
+ *
+ * When the built-in engines make sure the written data reached the disk.  It
+ * has no effect in fast mode, which never waits for the disk.
+ */
+typedef enum
+{
+  NW_OPERATION_SYNC_PER_WRITE,
+  NW_OPERATION_SYNC_PER_PASS,
+  NW_OPERATION_SYNC_PER_BATCH,
+  NW_OPERATION_SYNC_STREAMING
+} NwOperationSyncPolicy;
+
+/**
+ * NwOperationIoClass:
+ * @NW_OPERATION_IO_CLASS_NORMAL: Keep the I/O priority of the process
+ * @NW_OPERATION_IO_CLASS_LOW: Lowest level of the best-effort class, still
+ *                             making progress when the disk is busy
+ * @NW_OPERATION_IO_CLASS_IDLE: Idle class, only served when no other program
+ *                              uses the disk
+ *
+ * The I/O scheduling class an operation's writes are issued with.  It only
+ * matters with I/O schedulers honoring priorities.
+ */
+typedef enum
+{
+  NW_OPERATION_IO_CLASS_NORMAL,
+  NW_OPERATION_IO_CLASS_LOW,
+  NW_OPERATION_IO_CLASS_IDLE
+} NwOperationIoClass;
+
 struct _NwOperationInterface {
   GTypeInterface parent;
   
-  void   (*add_file)            (NwOperation *self,
-                                 const gchar *path);
-  void   (*add_files)           (NwOperation *self,
-                                 GList       *files);
-  gchar *(*get_progress_step)   (NwOperation *self);
+  void      (*add_file)           (NwOperation *self,
+                                   const gchar *path);
+  void      (*add_files)          (NwOperation *self,
+                                   GList       *files);
+  gchar    *(*get_progress_step)  (NwOperation *self);
+  gchar    *(*get_report)         (NwOperation *self);
+  gchar    *(*get_warnings)       (NwOperation *self);
+  gboolean  (*get_byte_progress)  (NwOperation *self,
+                                   guint64     *done,
+                                   guint64     *total);
+  gboolean  (*run)                (NwOperation *self,
+                                   GError     **error);
+  gboolean  (*pause)              (NwOperation *self);
+  gboolean  (*resume)             (NwOperation *self);
+  void      (*cancel)             (NwOperation *self);
 };
 
 
-GType   nw_operation_get_type           (void) G_GNUC_CONST;
+GType     nw_operation_engine_get_type      (void) G_GNUC_CONST;
+GType     nw_operation_sync_policy_get_type (void) G_GNUC_CONST;
+GType     nw_operation_io_class_get_type    (void) G_GNUC_CONST;
+GType     nw_operation_get_type             (void) G_GNUC_CONST;
 
-void    nw_operation_add_file           (NwOperation *self,
-                                         const gchar *path);
-void    nw_operation_add_files          (NwOperation *self,
-                                         GList       *files);
-gchar  *nw_operation_get_progress_step  (NwOperation *self);
+void      nw_operation_add_file             (NwOperation *self,
+                                             const gchar *path);
+void      nw_operation_add_files            (NwOperation *self,
+                                             GList       *files);
+gchar    *nw_operation_get_progress_step    (NwOperation *self);
+gchar    *nw_operation_get_report           (NwOperation *self);
+gchar    *nw_operation_get_warnings         (NwOperation *self);
+gboolean  nw_operation_get_byte_progress    (NwOperation *self,
+                                             guint64     *done,
+                                             guint64     *total);
+gboolean  nw_operation_run                  (NwOperation *self,
+                                             GError     **error);
+gboolean  nw_operation_pause                (NwOperation *self);
+gboolean  nw_operation_resume               (NwOperation *self);
+void      nw_operation_cancel               (NwOperation *self);
 
 
 G_END_DECLS
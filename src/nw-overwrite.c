@@ -0,0 +1,1695 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* In-process implementation of the overwrite passes srm(1) performs */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-overwrite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#ifdef __linux__
+#include <linux/falloc.h>
+#endif
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gsecuredelete.h>
+
+#include "nw-device.h"
+#include "nw-pattern.h"
+#include "nw-random.h"
+#include "nw-uring.h"
+
+
+/* user data of the io_uring pass barrier, write requests use their slot */
+#define URING_BARRIER_ID  G_MAXUINT64
+
+#define ROUND_UP(x, a)    ((((x) + (a) - 1) / (a)) * (a))
+#define ROUND_DOWN(x, a)  (((x) / (a)) * (a))
+
+/* Linux 6.17 mode physically zeroing a range through the device's write zeroes
+ * command.  Older kernels reject it */
+#if defined (__linux__) && ! defined (FALLOC_FL_WRITE_ZEROES)
+#define FALLOC_FL_WRITE_ZEROES 0x80
+#endif
+
+
+typedef enum {
+  PASS_RANDOM,
+  PASS_PATTERN
+} PassType;
+
+/* 1 byte patterns are stored repeated 3 times so all patterns have the same
+ * period */
+typedef struct {
+  PassType  type;
+  guint8    pattern[3];
+} Pass;
+
+/* a range of a file to overwrite */
+typedef struct {
+  guint64   offset;
+  guint64   length;
+} Extent;
+
+#define R           { PASS_RANDOM,  { 0x00, 0x00, 0x00 } }
+#define P1(a)       { PASS_PATTERN, { a, a, a } }
+#define P3(a, b, c) { PASS_PATTERN, { a, b, c } }
+
+/* GSD_SECURE_DELETE_OPERATION_MODE_NORMAL: 1 pass with 0xff, 5 random passes,
+ * the 27 special values defined by Peter Gutmann and 5 random passes, the same
+ * as srm(1) does */
+static const Pass passes_normal[] = {
+  P1 (0xff),
+  R, R, R, R, R,
+  P1 (0x55), P1 (0xaa),
+  P3 (0x92, 0x49, 0x24), P3 (0x49, 0x24, 0x92), P3 (0x24, 0x92, 0x49),
+  P1 (0x00), P1 (0x11), P1 (0x22), P1 (0x33), P1 (0x44), P1 (0x55), P1 (0x66),
+  P1 (0x77), P1 (0x88), P1 (0x99), P1 (0xaa), P1 (0xbb), P1 (0xcc), P1 (0xdd),
+  P1 (0xee), P1 (0xff),
+  P3 (0x92, 0x49, 0x24), P3 (0x49, 0x24, 0x92), P3 (0x24, 0x92, 0x49),
+  P3 (0x6d, 0xb6, 0xdb), P3 (0xb6, 0xdb, 0x6d), P3 (0xdb, 0x6d, 0xb6),
+  R, R, R, R, R
+};
+/* GSD_SECURE_DELETE_OPERATION_MODE_INSECURE: 1 pass with 0xff and a final
+ * random pass */
+static const Pass passes_insecure[] = {
+  P1 (0xff),
+  R
+};
+/* GSD_SECURE_DELETE_OPERATION_MODE_VERY_INSECURE: a single random pass */
+static const Pass passes_very_insecure[] = {
+  R
+};
+/* the zeroise pass, replacing the last random one if requested */
+static const Pass pass_zero = P1 (0x00);
+
+#undef R
+#undef P1
+#undef P3
+
+
+struct _NwOverwriter {
+  Pass                 *passes;
+  guint                 n_passes;
+  gboolean              fast;
+  guint8               *buffer;
+  NwRandom             *random;
+  NwUring              *uring;
+  guint8               *uring_buffers;  /* one buffer per write in flight */
+  /* size and alignment of each write buffer, and size of the random data
+   * writes, which is smaller than the buffers outside direct I/O */
+  gsize                 buffer_size;
+  gsize                 buffer_align;
+  gsize                 chunk_size;
+  NwOverwriteCheckFunc  check_func;
+  gpointer              check_data;
+  NwOperationSyncPolicy sync_policy;
+  /* streaming writeback state of the file being written */
+  gboolean              stream;
+  guint64               stream_pending;
+  /* whether zero_device can zero ranges itself, valid if zero_device_known */
+  dev_t                 zero_device;
+  gboolean              zero_device_known;
+  gboolean              zero_offload;
+  /* bytes of zero passes the devices zeroed, and those written */
+  guint64               zero_offloaded;
+  guint64               zero_written;
+  /* bytes of written data dropped from the page cache */
+  guint64               cache_released;
+  /* direct I/O geometry of direct_device, valid if direct_device_known */
+  gboolean              direct;
+  dev_t                 direct_device;
+  gboolean              direct_device_known;
+  gboolean              direct_usable;
+  gsize                 direct_align;
+  gsize                 direct_chunk;
+  /* whether the last file written went through direct I/O */
+  gboolean              direct_file;
+};
+
+
+/* sets @error from errno value @errsv.  @format gets the display name of
+ * @path and the error message as arguments */
+static void
+set_error_from_errno (GError      **error,
+                      gint          errsv,
+                      const gchar  *format,
+                      const gchar  *path)
+{
+  gchar *display_name = g_filename_display_name (path);
+
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+               format, display_name, g_strerror (errsv));
+  g_free (display_name);
+}
+
+/* (re)allocates the write buffers so they hold @size bytes aligned on @align.
+ * On failure, the current buffers are left untouched */
+static gboolean
+alloc_buffers (NwOverwriter *self,
+               gsize         size,
+               gsize         align)
+{
+  guint8 *buffer;
+  guint8 *uring_buffers = NULL;
+
+  if (posix_memalign ((void **) &buffer, align, size) != 0) {
+    return FALSE;
+  }
+  if (self->uring &&
+      posix_memalign ((void **) &uring_buffers, align,
+                      NW_OVERWRITE_URING_DEPTH * size) != 0) {
+    free (buffer);
+    return FALSE;
+  }
+  free (self->buffer);
+  self->buffer = buffer;
+  if (self->uring) {
+    free (self->uring_buffers);
+    self->uring_buffers = uring_buffers;
+  }
+  self->buffer_size = size;
+  self->buffer_align = align;
+
+  return TRUE;
+}
+
+/* gets the pass set for @mode */
+static const Pass *
+get_passes (GsdSecureDeleteOperationMode  mode,
+            guint                        *n_passes)
+{
+  switch (mode) {
+    case GSD_SECURE_DELETE_OPERATION_MODE_NORMAL:
+      *n_passes = G_N_ELEMENTS (passes_normal);
+      return passes_normal;
+
+    case GSD_SECURE_DELETE_OPERATION_MODE_INSECURE:
+      *n_passes = G_N_ELEMENTS (passes_insecure);
+      return passes_insecure;
+
+    default:
+      *n_passes = G_N_ELEMENTS (passes_very_insecure);
+      return passes_very_insecure;
+  }
+}
+
+/* Returns: The number of passes an overwriter for @mode would write */
+guint
+nw_overwrite_count_passes (GsdSecureDeleteOperationMode mode)
+{
+  guint n_passes;
+
+  get_passes (mode, &n_passes);
+
+  return n_passes;
+}
+
+/*
+ * nw_overwriter_new:
+ * @mode: The pass set to write
+ * @fast: Whether not to synchronize written data.  Unlike srm(1), random
+ *        data comes from the same ChaCha20 generator in both modes, which is
+ *        already faster than the disk
+ * @zeroise: Whether to write zeros instead of random data on the last pass
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Creates a new overwriter.  An overwriter is not thread-safe, but several of
+ * them can run concurrently.
+ *
+ * Returns: A new #NwOverwriter, or %NULL on error.  Free with
+ *          nw_overwriter_free().
+ */
+NwOverwriter *
+nw_overwriter_new (GsdSecureDeleteOperationMode mode,
+                   gboolean                     fast,
+                   gboolean                     zeroise,
+                   GError                     **error)
+{
+  NwOverwriter *self;
+  const Pass   *passes;
+  guint         n_passes;
+
+  passes = get_passes (mode, &n_passes);
+
+  self = g_slice_new0 (NwOverwriter);
+  nw_pattern_cache_ref ();
+  self->passes = g_new (Pass, n_passes);
+  memcpy (self->passes, passes, n_passes * sizeof *passes);
+  self->n_passes = n_passes;
+  self->fast = fast;
+  self->random = NULL;
+  self->uring = NULL;
+  self->uring_buffers = NULL;
+  self->check_func = NULL;
+  self->check_data = NULL;
+  self->sync_policy = NW_OPERATION_SYNC_PER_BATCH;
+  self->stream = FALSE;
+  self->stream_pending = 0;
+  self->zero_device_known = FALSE;
+  self->zero_offloaded = 0;
+  self->zero_written = 0;
+  self->cache_released = 0;
+  self->direct = FALSE;
+  self->direct_device_known = FALSE;
+  self->direct_file = FALSE;
+  self->buffer = NULL;
+  self->chunk_size = NW_OVERWRITE_BUFFER_SIZE;
+  if (zeroise) {
+    self->passes[n_passes - 1] = pass_zero;
+  }
+  alloc_buffers (self, NW_OVERWRITE_BUFFER_SIZE, NW_OVERWRITE_BUFFER_ALIGN);
+  self->random = nw_random_new (error);
+  if (! self->random) {
+    nw_overwriter_free (self);
+    self = NULL;
+  } else {
+    g_debug ("Generating random data with the %s keystream",
+             nw_random_get_impl_name ());
+  }
+  if (self && ! self->buffer) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+                 _("Failed to allocate the write buffer"));
+    nw_overwriter_free (self);
+    self = NULL;
+  }
+
+  return self;
+}
+
+void
+nw_overwriter_free (NwOverwriter *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->random) {
+    nw_random_free (self->random);
+  }
+  nw_pattern_cache_unref ();
+  if (self->uring) {
+    nw_uring_free (self->uring);
+  }
+  free (self->uring_buffers);
+  free (self->buffer);
+  g_free (self->passes);
+  g_slice_free (NwOverwriter, self);
+}
+
+void
+nw_overwriter_set_check_func (NwOverwriter        *self,
+                              NwOverwriteCheckFunc func,
+                              gpointer             data)
+{
+  g_return_if_fail (self != NULL);
+
+  self->check_func = func;
+  self->check_data = data;
+}
+
+guint
+nw_overwriter_get_n_passes (NwOverwriter *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->n_passes;
+}
+
+/*
+ * nw_overwriter_set_sync_policy:
+ * @self: A #NwOverwriter
+ * @policy: When to make sure the data reached the disk
+ *
+ * Sets when @self synchronizes the data it writes.  The default is
+ * %NW_OPERATION_SYNC_PER_BATCH.  This has no effect in fast mode.
+ */
+void
+nw_overwriter_set_sync_policy (NwOverwriter         *self,
+                               NwOperationSyncPolicy policy)
+{
+  g_return_if_fail (self != NULL);
+
+  self->sync_policy = policy;
+}
+
+/*
+ * nw_overwriter_get_zero_stats:
+ * @self: A #NwOverwriter
+ * @offloaded: return location for the number of bytes of zero passes the
+ *             devices zeroed themselves, or %NULL
+ * @written: return location for the number of bytes of zero passes written as
+ *           regular data, or %NULL
+ *
+ * Gets how zero passes were performed so far.  Zero passes are offloaded to
+ * devices advertising support for zeroing ranges, and written otherwise.
+ */
+void
+nw_overwriter_get_zero_stats (NwOverwriter *self,
+                              guint64      *offloaded,
+                              guint64      *written)
+{
+  g_return_if_fail (self != NULL);
+
+  if (offloaded) {
+    *offloaded = self->zero_offloaded;
+  }
+  if (written) {
+    *written = self->zero_written;
+  }
+}
+
+/*
+ * nw_overwriter_get_cache_released:
+ * @self: A #NwOverwriter
+ *
+ * Gets how much written data was dropped from the page cache so far.  Unless in
+ * fast mode, data is dropped once synchronized so that wiping doesn't evict the
+ * data other programs use.
+ *
+ * Returns: A number of bytes.
+ */
+guint64
+nw_overwriter_get_cache_released (NwOverwriter *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->cache_released;
+}
+
+/*
+ * nw_overwriter_set_direct_io:
+ * @self: A #NwOverwriter
+ * @direct: Whether to bypass the page cache
+ *
+ * Sets whether @self writes with direct I/O (O_DIRECT) on devices and file
+ * systems supporting it, which is disabled by default.  Writes are then issued
+ * from buffers aligned on the physical block size of the device and sized after
+ * its optimal I/O size, and the unaligned head and tail of each extent are
+ * written through the page cache.  Data is still synchronized as usual, as
+ * direct I/O doesn't flush the device's own cache.
+ */
+void
+nw_overwriter_set_direct_io (NwOverwriter *self,
+                             gboolean      direct)
+{
+  g_return_if_fail (self != NULL);
+
+  self->direct = direct;
+}
+
+/*
+ * nw_overwriter_enable_uring:
+ * @self: A #NwOverwriter
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Makes @self submit its writes through io_uring, keeping up to
+ * %NW_OVERWRITE_URING_DEPTH writes in flight.  If this fails, @self keeps
+ * using synchronous writes.
+ *
+ * Returns: %TRUE if io_uring is now used, %FALSE otherwise.
+ */
+gboolean
+nw_overwriter_enable_uring (NwOverwriter *self,
+                            GError      **error)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  if (! self->uring) {
+    /* one more entry for the barrier */
+    self->uring = nw_uring_new (NW_OVERWRITE_URING_DEPTH + 1, error);
+    if (self->uring &&
+        posix_memalign ((void **) &self->uring_buffers, self->buffer_align,
+                        NW_OVERWRITE_URING_DEPTH * self->buffer_size) != 0) {
+      self->uring_buffers = NULL;
+      nw_uring_free (self->uring);
+      self->uring = NULL;
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+                   _("Failed to allocate the write buffer"));
+    }
+  }
+
+  return self->uring != NULL;
+}
+
+/* writes the whole @len bytes of @buf at @offset in @fd */
+static gboolean
+write_all (gint           fd,
+           const guint8  *buf,
+           gsize          len,
+           guint64        offset,
+           GError       **error)
+{
+  while (len > 0) {
+    gssize n = pwrite (fd, buf, len, (off_t) offset);
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      gint errsv = n < 0 ? errno : ENOSPC;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   _("Failed to write data: %s"), g_strerror (errsv));
+      return FALSE;
+    }
+    buf += n;
+    len -= (gsize) n;
+    offset += (guint64) n;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+set_sync_error (GError  **error,
+                gint      errsv)
+{
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+               _("Failed to synchronize data: %s"), g_strerror (errsv));
+
+  return FALSE;
+}
+
+/* gets the buffer to write @p from at @offset: the cached pattern buffer, or
+ * %NULL for random passes.  Sets @chunk_size to the largest write to issue */
+static gboolean
+get_pass_data (NwOverwriter  *self,
+               const Pass    *p,
+               guint64        offset,
+               const guint8 **data,
+               gsize         *chunk_size,
+               GError       **error)
+{
+  *data = NULL;
+  *chunk_size = self->chunk_size;
+  if (p->type == PASS_PATTERN) {
+    /* the cached buffer's size is a multiple of the pattern's period, so it
+     * can be written over and over */
+    *data = nw_pattern_cache_get (p->pattern, offset % 3);
+    if (! *data) {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOMEM,
+                   _("Failed to allocate the write buffer"));
+      return FALSE;
+    }
+    *chunk_size = NW_PATTERN_BUFFER_SIZE;
+  }
+
+  return TRUE;
+}
+
+/* in streaming mode, starts the writeback of the data written to @fd every
+ * NW_OVERWRITE_STREAM_WINDOW bytes, after waiting for the previous writeback
+ * to complete.  This keeps the dirty data to about two windows, while the
+ * fdatasync() at the end of the pass still provides the guarantee */
+static gboolean
+stream_writeback (NwOverwriter  *self,
+                  gint           fd,
+                  gsize          written,
+                  GError       **error)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+  if (! self->stream) {
+    return TRUE;
+  }
+  self->stream_pending += written;
+  if (self->stream_pending >= NW_OVERWRITE_STREAM_WINDOW) {
+    self->stream_pending = 0;
+    if (sync_file_range (fd, 0, 0, (SYNC_FILE_RANGE_WAIT_BEFORE |
+                                    SYNC_FILE_RANGE_WRITE)) != 0) {
+      if (errno != EINVAL && errno != ESPIPE && errno != ENOSYS) {
+        return set_sync_error (error, errno);
+      }
+      /* not supported here, only synchronize at the end of the pass */
+      self->stream = FALSE;
+    } else {
+      /* what was written back is clean now, no need to wait for the end of the
+       * pass to drop it */
+      posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+  }
+#endif
+
+  return TRUE;
+}
+
+static gboolean
+check (NwOverwriter  *self,
+       guint          pass,
+       guint64        written,
+       guint64        size,
+       GError       **error)
+{
+  if (self->check_func &&
+      ! self->check_func (pass, written, size, self->check_data)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                 _("Operation canceled"));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* io_uring implementation of write_extents().  Writes are issued from one
+ * buffer per slot (or all from the pattern buffer), and if @sync is set the
+ * pass ends with a data synchronization barrier linked to the last write */
+static gboolean
+write_extents_uring (NwOverwriter  *self,
+                     gint           fd,
+                     guint          pass,
+                     const Extent  *extents,
+                     guint          n_extents,
+                     guint64        size,
+                     gboolean       sync,
+                     GError       **error)
+{
+  const Pass   *p = &self->passes[pass];
+  const guint8 *slot_data[NW_OVERWRITE_URING_DEPTH];
+  guint64       slot_offset[NW_OVERWRITE_URING_DEPTH];
+  gsize         slot_len[NW_OVERWRITE_URING_DEPTH];
+  guint         free_slots[NW_OVERWRITE_URING_DEPTH];
+  guint         n_free = 0;
+  guint         in_flight = 0;
+  gboolean      short_write = FALSE;
+  gboolean      success = TRUE;
+  guint         extent = 0;
+  guint64       offset = 0;
+  guint64       length = 0;
+  const guint8 *pattern_data = NULL;
+  gsize         chunk_size = 0;
+
+  for (n_free = 0; n_free < NW_OVERWRITE_URING_DEPTH; n_free++) {
+    free_slots[n_free] = n_free;
+  }
+  while (success || in_flight > 0) {
+    NwUringCompletion completion;
+
+    /* fill every free slot */
+    while (success && n_free > 0) {
+      guint         slot;
+      gsize         n;
+      gboolean      last;
+      const guint8 *data;
+
+      if (length == 0) {
+        /* move on to the next extent */
+        if (extent >= n_extents) {
+          break;
+        }
+        offset = extents[extent].offset;
+        length = extents[extent].length;
+        extent++;
+        success = get_pass_data (self, p, offset, &pattern_data, &chunk_size,
+                                 error);
+        continue;
+      }
+      slot = free_slots[--n_free];
+      n = (gsize) MIN (length, chunk_size);
+      last = n == length && extent == n_extents;
+      if (! pattern_data) {
+        guint8 *buf = self->uring_buffers + slot * self->buffer_size;
+
+        nw_random_fill (self->random, buf, n);
+        data = buf;
+      } else {
+        data = pattern_data;
+      }
+      slot_data[slot] = data;
+      slot_offset[slot] = offset;
+      slot_len[slot] = n;
+      nw_uring_queue_write (self->uring, fd, data, n, offset, slot,
+                            last && sync);
+      in_flight++;
+      offset += n;
+      length -= n;
+      if (last && sync) {
+        nw_uring_queue_fsync (self->uring, fd, URING_BARRIER_ID);
+        in_flight++;
+      }
+    }
+    if (in_flight == 0) {
+      break;
+    }
+    if (! nw_uring_submit (self->uring, 1, success ? error : NULL)) {
+      success = FALSE;
+      break;
+    }
+    while (nw_uring_pop (self->uring, &completion)) {
+      in_flight--;
+      if (completion.user_data == URING_BARRIER_ID) {
+        /* -ECANCELED means the linked write failed, which we report */
+        if (completion.res < 0 && completion.res != -ECANCELED && success) {
+          success = set_sync_error (error, -completion.res);
+        }
+      } else {
+        guint slot = (guint) completion.user_data;
+
+        if (completion.res < 0) {
+          if (success) {
+            g_set_error (error, G_FILE_ERROR,
+                         g_file_error_from_errno (-completion.res),
+                         _("Failed to write data: %s"),
+                         g_strerror (-completion.res));
+            success = FALSE;
+          }
+        } else if ((gsize) completion.res < slot_len[slot] && success) {
+          /* finish short writes synchronously */
+          short_write = TRUE;
+          success = write_all (fd, slot_data[slot] + completion.res,
+                               slot_len[slot] - (gsize) completion.res,
+                               slot_offset[slot] + (guint64) completion.res,
+                               error);
+        }
+        free_slots[n_free++] = slot;
+        if (success) {
+          success = (stream_writeback (self, fd, slot_len[slot], error) &&
+                     check (self, pass, slot_len[slot], size, error));
+        }
+      }
+    }
+  }
+  /* the kernel may still be writing from our buffers, and would post stale
+   * completions to the next call */
+  if (in_flight > 0 && ! nw_uring_drain (self->uring)) {
+    nw_uring_free (self->uring);
+    self->uring = NULL;
+  }
+  /* data written synchronously was not covered by the barrier */
+  if (success && short_write && sync && fdatasync (fd) != 0) {
+    success = set_sync_error (error, errno);
+  }
+
+  return success;
+}
+
+/* Returns: the total length of the @n_extents @extents */
+static guint64
+get_extents_size (const Extent *extents,
+                  guint         n_extents)
+{
+  guint64 size = 0;
+  guint   i;
+
+  for (i = 0; i < n_extents; i++) {
+    size += extents[i].length;
+  }
+
+  return size;
+}
+
+static gboolean
+is_zero_pass (const Pass *p)
+{
+  return (p->type == PASS_PATTERN &&
+          p->pattern[0] == 0 && p->pattern[1] == 0 && p->pattern[2] == 0);
+}
+
+/* checks whether the device holding @fd advertises support for zeroing ranges
+ * itself.  The answer is kept for the next files, which are likely on the same
+ * device */
+static gboolean
+can_offload_zeros (NwOverwriter *self,
+                   gint          fd)
+{
+  struct stat st;
+
+  if (fstat (fd, &st) != 0) {
+    return FALSE;
+  }
+  if (! self->zero_device_known || self->zero_device != st.st_dev) {
+    self->zero_device = st.st_dev;
+    self->zero_device_known = TRUE;
+    self->zero_offload = nw_device_get_queue_uint64 (st.st_dev,
+                                                     "write_zeroes_max_bytes",
+                                                     0) != 0;
+  }
+
+  return self->zero_offload;
+}
+
+/* has the device zero the @extents of @fd.  Unlike FALLOC_FL_ZERO_RANGE, which
+ * on most file systems only marks the blocks as unwritten and leaves their
+ * data on the disk, FALLOC_FL_WRITE_ZEROES really overwrites them.  @n_done is
+ * set to the number of extents zeroed, which already got reported.
+ * Returns: %TRUE on success.  On failure, @error is only set if the kernel or
+ *          file system supports it, the caller should write the zeros of the
+ *          extents left itself otherwise */
+static gboolean
+write_extents_zeroes (NwOverwriter  *self,
+                      gint           fd,
+                      guint          pass,
+                      const Extent  *extents,
+                      guint          n_extents,
+                      guint64        size,
+                      gboolean       sync,
+                      guint         *n_done,
+                      GError       **error)
+{
+#ifdef __linux__
+  guint i;
+
+  *n_done = 0;
+  for (i = 0; i < n_extents; i++) {
+    if (fallocate (fd, FALLOC_FL_WRITE_ZEROES, (off_t) extents[i].offset,
+                   (off_t) extents[i].length) != 0) {
+      gint errsv = errno;
+
+      if (errsv == EOPNOTSUPP || errsv == EINVAL || errsv == ENOSYS) {
+        /* don't try again on this device */
+        self->zero_offload = FALSE;
+      } else {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                     _("Failed to write data: %s"), g_strerror (errsv));
+      }
+      return FALSE;
+    }
+    self->zero_offloaded += extents[i].length;
+    *n_done = i + 1;
+    if (! check (self, pass, extents[i].length, size, error)) {
+      return FALSE;
+    }
+  }
+  if (sync && fdatasync (fd) != 0) {
+    return set_sync_error (error, errno);
+  }
+
+  return TRUE;
+#else
+  *n_done = 0;
+  self->zero_offload = FALSE;
+  return FALSE;
+#endif
+}
+
+/* checks whether @fd's device can be written with direct I/O, and if so makes
+ * sure the buffers suit it: aligned on its physical block size, and holding a
+ * multiple of its optimal I/O size.  The geometry is kept for the next files,
+ * which are likely on the same device */
+static gboolean
+prepare_direct (NwOverwriter *self,
+                gint          fd)
+{
+  struct stat st;
+
+  if (fstat (fd, &st) != 0) {
+    return FALSE;
+  }
+  if (! self->direct_device_known || self->direct_device != st.st_dev) {
+    guint64 logical;
+    guint64 align;
+    guint64 optimal;
+    guint64 unit;
+
+    logical = nw_device_get_queue_uint64 (st.st_dev, "logical_block_size", 512);
+    align = nw_device_get_queue_uint64 (st.st_dev, "physical_block_size", 512);
+    align = MAX (MAX (align, logical), 512);
+    optimal = nw_device_get_queue_uint64 (st.st_dev, "optimal_io_size", 0);
+    self->direct_device = st.st_dev;
+    self->direct_device_known = TRUE;
+    /* pattern buffers are shared, page-aligned and written whole, so they have
+     * to suit the device as they are */
+    self->direct_usable = (logical <= 4096 && (align & (align - 1)) == 0 &&
+                           NW_PATTERN_BUFFER_SIZE % align == 0);
+    unit = optimal > 0 ? ROUND_UP (optimal, align) : align;
+    if (unit > NW_OVERWRITE_DIRECT_MAX_CHUNK) {
+      unit = align;
+    }
+    self->direct_align = (gsize) align;
+    self->direct_chunk = (gsize) ROUND_UP (NW_OVERWRITE_BUFFER_SIZE, unit);
+  }
+  if (self->direct_usable &&
+      (self->buffer_size < self->direct_chunk ||
+       self->buffer_align < self->direct_align)) {
+    return alloc_buffers (self, self->direct_chunk,
+                          MAX (self->direct_align, NW_OVERWRITE_BUFFER_ALIGN));
+  }
+
+  return self->direct_usable;
+}
+
+/* toggles direct I/O on @fd */
+static gboolean
+set_direct (gint      fd,
+            gboolean  direct)
+{
+#ifdef O_DIRECT
+  gint flags = fcntl (fd, F_GETFL);
+
+  if (flags < 0) {
+    return FALSE;
+  }
+  flags = direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+
+  return fcntl (fd, F_SETFL, flags) == 0;
+#else
+  return FALSE;
+#endif
+}
+
+/* splits the @n_extents @extents into the parts aligned on @align, which can be
+ * written with direct I/O, and the unaligned heads and tails */
+static void
+split_extents (const Extent  *extents,
+               guint          n_extents,
+               guint64        align,
+               GArray        *aligned,
+               GArray        *unaligned)
+{
+  guint i;
+
+  for (i = 0; i < n_extents; i++) {
+    guint64 end = extents[i].offset + extents[i].length;
+    guint64 aligned_start = ROUND_UP (extents[i].offset, align);
+    guint64 aligned_end = ROUND_DOWN (end, align);
+    Extent  extent;
+
+    if (aligned_start >= aligned_end) {
+      g_array_append_val (unaligned, extents[i]);
+      continue;
+    }
+    if (aligned_start > extents[i].offset) {
+      extent.offset = extents[i].offset;
+      extent.length = aligned_start - extents[i].offset;
+      g_array_append_val (unaligned, extent);
+    }
+    extent.offset = aligned_start;
+    extent.length = aligned_end - aligned_start;
+    g_array_append_val (aligned, extent);
+    if (aligned_end < end) {
+      extent.offset = aligned_end;
+      extent.length = end - aligned_end;
+      g_array_append_val (unaligned, extent);
+    }
+  }
+}
+
+/* writes @pass over each of the @n_extents @extents of @fd as is */
+static gboolean
+write_extents_io (NwOverwriter  *self,
+                  gint           fd,
+                  guint          pass,
+                  const Extent  *extents,
+                  guint          n_extents,
+                  guint64        size,
+                  gboolean       sync,
+                  GError       **error)
+{
+  const Pass *p = &self->passes[pass];
+  gboolean    success = TRUE;
+  guint       i;
+
+  if (self->uring) {
+    return write_extents_uring (self, fd, pass, extents, n_extents, size,
+                                sync, error);
+  }
+  for (i = 0; success && i < n_extents; i++) {
+    guint64       offset = extents[i].offset;
+    guint64       length = extents[i].length;
+    const guint8 *pattern_data;
+    gsize         chunk_size;
+
+    success = get_pass_data (self, p, offset, &pattern_data, &chunk_size,
+                             error);
+    while (success && length > 0) {
+      const guint8 *data = pattern_data;
+      gsize         n = (gsize) MIN (length, chunk_size);
+
+      if (! data) {
+        nw_random_fill (self->random, self->buffer, n);
+        data = self->buffer;
+      }
+      success = write_all (fd, data, n, offset, error);
+      if (success) {
+        offset += n;
+        length -= n;
+        success = (stream_writeback (self, fd, n, error) &&
+                   check (self, pass, n, size, error));
+      }
+    }
+  }
+  if (success && sync && fdatasync (fd) != 0) {
+    success = set_sync_error (error, errno);
+  }
+
+  return success;
+}
+
+/* drops the @n_extents @extents of @fd from the page cache.  Their data has to
+ * be on the disk already, as dirty pages are only written back */
+static void
+drop_cache (NwOverwriter *self,
+            gint          fd,
+            const Extent *extents,
+            guint         n_extents)
+{
+  guint i;
+
+  for (i = 0; i < n_extents; i++) {
+    if (posix_fadvise (fd, (off_t) extents[i].offset,
+                       (off_t) extents[i].length, POSIX_FADV_DONTNEED) == 0) {
+      self->cache_released += extents[i].length;
+    }
+  }
+}
+
+/* direct I/O implementation of write_extents_data().  The aligned part of the
+ * extents is written bypassing the page cache, then the unaligned heads and
+ * tails through it.  Sets @done to %FALSE if @fd can't use direct I/O, in which
+ * case nothing was written */
+static gboolean
+write_extents_direct (NwOverwriter  *self,
+                      gint           fd,
+                      guint          pass,
+                      const Extent  *extents,
+                      guint          n_extents,
+                      guint64        size,
+                      gboolean       sync,
+                      gboolean      *done,
+                      GError       **error)
+{
+  GArray   *aligned = g_array_new (FALSE, FALSE, sizeof (Extent));
+  GArray   *unaligned = g_array_new (FALSE, FALSE, sizeof (Extent));
+  gboolean  success = TRUE;
+
+  *done = FALSE;
+  split_extents (extents, n_extents, self->direct_align, aligned, unaligned);
+  if (aligned->len > 0) {
+    if (! set_direct (fd, TRUE)) {
+      /* the file system doesn't support it, don't try again on this device */
+      self->direct_usable = FALSE;
+    } else {
+      *done = TRUE;
+      self->direct_file = TRUE;
+      self->chunk_size = self->direct_chunk;
+      success = write_extents_io (self, fd, pass,
+                                  (const Extent *) aligned->data, aligned->len,
+                                  size, FALSE, error);
+      self->chunk_size = NW_OVERWRITE_BUFFER_SIZE;
+      if (! set_direct (fd, FALSE) && success) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     _("Failed to disable direct I/O: %s"), g_strerror (errno));
+        success = FALSE;
+      }
+      if (success) {
+        success = write_extents_io (self, fd, pass,
+                                    (const Extent *) unaligned->data,
+                                    unaligned->len, size, FALSE, error);
+      }
+      /* direct I/O doesn't flush the device's cache nor the allocation */
+      if (success && sync) {
+        if (fdatasync (fd) != 0) {
+          success = set_sync_error (error, errno);
+        } else {
+          drop_cache (self, fd, (const Extent *) unaligned->data,
+                      unaligned->len);
+        }
+      }
+    }
+  }
+  g_array_free (aligned, TRUE);
+  g_array_free (unaligned, TRUE);
+
+  return success;
+}
+
+/* writes @pass over each of the @n_extents @extents of @fd, then synchronizes
+ * the data if @sync is set.  @size is the total the check function gets.
+ * Zero passes are only offloaded to the device if @offload is set, as a single
+ * request can't tell how much of a range that doesn't exist yet would fit */
+static gboolean
+write_extents_data (NwOverwriter  *self,
+                    gint           fd,
+                    guint          pass,
+                    const Extent  *extents,
+                    guint          n_extents,
+                    guint64        size,
+                    gboolean       sync,
+                    gboolean       offload,
+                    GError       **error)
+{
+  const Pass *p = &self->passes[pass];
+
+  /* only stream the writeback of data that is to be synchronized */
+  self->stream = sync && self->sync_policy == NW_OPERATION_SYNC_STREAMING;
+  self->stream_pending = 0;
+  self->direct_file = FALSE;
+  if (is_zero_pass (p)) {
+    if (offload && can_offload_zeros (self, fd)) {
+      GError *err = NULL;
+      guint   n_done;
+
+      if (write_extents_zeroes (self, fd, pass, extents, n_extents, size, sync,
+                                &n_done, &err)) {
+        return TRUE;
+      } else if (err) {
+        g_propagate_error (error, err);
+        return FALSE;
+      }
+      /* only write what the device didn't zero */
+      extents += n_done;
+      n_extents -= n_done;
+    }
+    self->zero_written += get_extents_size (extents, n_extents);
+  }
+  if (self->direct && prepare_direct (self, fd)) {
+    gboolean done;
+    gboolean success;
+
+    success = write_extents_direct (self, fd, pass, extents, n_extents, size,
+                                    sync, &done, error);
+    if (done) {
+      return success;
+    }
+  }
+
+  return write_extents_io (self, fd, pass, extents, n_extents, size, sync,
+                           error);
+}
+
+/* same as write_extents_data(), but once synchronized the data is dropped from
+ * the page cache as nobody will read it again.  Data written with direct I/O
+ * never was in it */
+static gboolean
+write_extents (NwOverwriter  *self,
+               gint           fd,
+               guint          pass,
+               const Extent  *extents,
+               guint          n_extents,
+               guint64        size,
+               gboolean       sync,
+               GError       **error)
+{
+  if (! write_extents_data (self, fd, pass, extents, n_extents, size, sync,
+                            TRUE, error)) {
+    return FALSE;
+  }
+  if (sync && ! self->direct_file) {
+    drop_cache (self, fd, extents, n_extents);
+  }
+
+  return TRUE;
+}
+
+/*
+ * nw_overwriter_write_pass:
+ * @self: A #NwOverwriter
+ * @fd: A file descriptor open for writing
+ * @pass: The pass to write, lower than nw_overwriter_get_n_passes()
+ * @offset: Where to start writing in @fd
+ * @length: How many bytes to write
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Overwrites a range of @fd with the data of @pass.  Unless the overwriter is
+ * in fast mode, the data is synchronized to the disk before returning.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+nw_overwriter_write_pass (NwOverwriter *self,
+                          gint          fd,
+                          guint         pass,
+                          guint64       offset,
+                          guint64       length,
+                          GError      **error)
+{
+  Extent extent;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (pass < self->n_passes, FALSE);
+
+  extent.offset = offset;
+  extent.length = length;
+
+  return write_extents (self, fd, pass, &extent, length > 0 ? 1 : 0, length,
+                        ! self->fast, error);
+}
+
+/* lists the ranges of @fd holding data, so that holes of sparse files are
+ * neither written nor allocated.  If the file system can't tell, the whole
+ * file is considered as data */
+static GArray *
+get_extents (gint    fd,
+             guint64 size)
+{
+  GArray *extents = g_array_new (FALSE, FALSE, sizeof (Extent));
+  Extent  extent;
+
+  #if defined (SEEK_DATA) && defined (SEEK_HOLE)
+  {
+    off_t data = 0;
+
+    while ((guint64) data < size) {
+      off_t hole;
+
+      data = lseek (fd, data, SEEK_DATA);
+      if (data < 0 && errno == ENXIO) {
+        /* no data past the previous hole */
+        return extents;
+      }
+      hole = data < 0 ? -1 : lseek (fd, data, SEEK_HOLE);
+      if (hole < 0) {
+        /* not supported, fallback on the whole file */
+        g_array_set_size (extents, 0);
+        break;
+      }
+      extent.offset = (guint64) data;
+      extent.length = MIN ((guint64) hole, size) - extent.offset;
+      if (extent.length > 0) {
+        g_array_append_val (extents, extent);
+      }
+      data = hole;
+    }
+    if ((guint64) data >= size) {
+      return extents;
+    }
+  }
+  #endif
+
+  extent.offset = 0;
+  extent.length = size;
+  if (size > 0) {
+    g_array_append_val (extents, extent);
+  }
+
+  return extents;
+}
+
+/* gets the flags to open files to overwrite with.  In per-write sync mode,
+ * writes only return once the data reached the disk */
+static gint
+get_open_flags (NwOverwriter *self)
+{
+  gint flags = O_WRONLY | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC;
+
+  if (! self->fast && self->sync_policy == NW_OPERATION_SYNC_PER_WRITE) {
+    flags |= O_DSYNC;
+  }
+
+  return flags;
+}
+
+/* opens @path for writing without following symbolic links, trying to make
+ * the file writable if it is not */
+static gint
+open_for_writing (NwOverwriter *self,
+                  const gchar  *path)
+{
+  gint flags = get_open_flags (self);
+  gint fd;
+
+  fd = g_open (path, flags, 0);
+  if (fd < 0 && errno == EACCES && g_chmod (path, S_IRUSR | S_IWUSR) == 0) {
+    fd = g_open (path, flags, 0);
+  }
+
+  return fd;
+}
+
+/* adds @path's name in front of @error's message, as write errors don't know
+ * the file name */
+static void
+prefix_error_with_path (GError      **error,
+                        const gchar  *path)
+{
+  if (error && *error && (*error)->domain != G_IO_ERROR) {
+    gchar *display_name = g_filename_display_name (path);
+
+    g_prefix_error (error, "%s: ", display_name);
+    g_free (display_name);
+  }
+}
+
+/*
+ * nw_overwriter_wipe_file:
+ * @self: A #NwOverwriter
+ * @path: Path to a regular file
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Overwrites every pass over the data of @path, truncates it and removes it
+ * with nw_overwrite_remove().  Holes of sparse files are skipped.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+nw_overwriter_wipe_file (NwOverwriter *self,
+                         const gchar  *path,
+                         GError      **error)
+{
+  struct stat st;
+  gboolean    success = TRUE;
+  guint       pass;
+  gint        fd;
+  GArray     *extents = NULL;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  fd = open_for_writing (self, path);
+  if (fd < 0) {
+    set_error_from_errno (error, errno, _("Failed to open \"%s\": %s"), path);
+    return FALSE;
+  }
+  if (fstat (fd, &st) != 0) {
+    set_error_from_errno (error, errno, _("Failed to stat \"%s\": %s"), path);
+    success = FALSE;
+  } else {
+    extents = get_extents (fd, (guint64) st.st_size);
+  }
+  for (pass = 0; success && pass < self->n_passes; pass++) {
+    success = write_extents (self, fd, pass, (const Extent *) extents->data,
+                             extents->len,
+                             get_extents_size ((const Extent *) extents->data,
+                                               extents->len),
+                             ! self->fast, error);
+  }
+  if (extents) {
+    g_array_free (extents, TRUE);
+  }
+  if (success && (ftruncate (fd, 0) != 0 ||
+                  (! self->fast && fsync (fd) != 0))) {
+    set_error_from_errno (error, errno, _("Failed to truncate \"%s\": %s"),
+                          path);
+    success = FALSE;
+  }
+  if (close (fd) != 0 && success) {
+    set_error_from_errno (error, errno, _("Failed to close \"%s\": %s"), path);
+    success = FALSE;
+  }
+  if (! success) {
+    prefix_error_with_path (error, path);
+  } else {
+    success = nw_overwrite_remove (path, error);
+  }
+
+  return success;
+}
+
+/* a file of a batch given to nw_overwriter_wipe_files() */
+typedef struct {
+  const gchar  *path;
+  gint          fd;
+  dev_t         device;
+  GArray       *extents;
+  gboolean      direct;   /* whether written with direct I/O */
+} BatchFile;
+
+/* closes the file of @file and appends @error's message to @messages.  The
+ * file is then left alone for the rest of the batch */
+static void
+batch_file_fail (BatchFile  *file,
+                 GString   **messages,
+                 GError    **error)
+{
+  if (file->fd >= 0) {
+    close (file->fd);
+    file->fd = -1;
+  }
+  if (! *messages) {
+    *messages = g_string_new (NULL);
+  } else {
+    g_string_append_c (*messages, '\n');
+  }
+  g_string_append (*messages, (*error)->message);
+  g_clear_error (error);
+}
+
+/* synchronizes the data of the files of @files still open.  When syncfs() is
+ * available and the sync policy allows it, it is called once per file system,
+ * which flushes everything the batch wrote with a single device cache flush;
+ * fdatasync() is called on each file otherwise */
+static gboolean
+sync_batch (NwOverwriter  *self,
+            BatchFile     *files,
+            guint          n_files,
+            GError       **error)
+{
+#ifdef HAVE_SYNCFS
+  gboolean  per_file = (self->sync_policy == NW_OPERATION_SYNC_PER_WRITE ||
+                        self->sync_policy == NW_OPERATION_SYNC_PER_PASS);
+#endif
+  guint     i;
+
+  for (i = 0; i < n_files; i++) {
+    if (files[i].fd < 0) {
+      continue;
+    }
+#ifdef HAVE_SYNCFS
+    if (! per_file) {
+      guint j;
+
+      for (j = 0; j < i; j++) {
+        if (files[j].fd >= 0 && files[j].device == files[i].device) {
+          break;
+        }
+      }
+      if (j == i && syncfs (files[i].fd) != 0) {
+        return set_sync_error (error, errno);
+      }
+      /* otherwise the file system was already synchronized */
+      continue;
+    }
+#endif
+    if (fdatasync (files[i].fd) != 0) {
+      return set_sync_error (error, errno);
+    }
+  }
+
+  return TRUE;
+}
+
+/* fails all the files of @files still open with @error, as a failed sweep
+ * can't tell which file's data didn't make it to the disk */
+static void
+batch_fail_open (BatchFile  *files,
+                 guint       n_files,
+                 GString   **messages,
+                 GError    **error)
+{
+  guint i;
+
+  for (i = 0; i < n_files; i++) {
+    if (files[i].fd >= 0) {
+      GError *file_error = g_error_copy (*error);
+
+      prefix_error_with_path (&file_error, files[i].path);
+      batch_file_fail (&files[i], messages, &file_error);
+    }
+  }
+  g_clear_error (error);
+}
+
+/*
+ * nw_overwriter_wipe_files:
+ * @self: A #NwOverwriter
+ * @paths: Paths to regular files
+ * @n_paths: Number of elements in @paths
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Same as calling nw_overwriter_wipe_file() on each of @paths, but each pass
+ * is written over all the files before synchronizing them all at once.  This
+ * is meant for small files, for which waiting for the disk after each write
+ * takes a lot longer than the writes themselves.  The data reaches the disk
+ * after each pass just the same.
+ *
+ * A file failing doesn't stop the others from being wiped.  The check function
+ * gets the size of the whole batch.
+ *
+ * Returns: %TRUE on success, %FALSE if any of the files failed or if the
+ *          operation was canceled.
+ */
+gboolean
+nw_overwriter_wipe_files (NwOverwriter       *self,
+                          const gchar *const *paths,
+                          guint               n_paths,
+                          GError            **error)
+{
+  BatchFile  *files;
+  GString    *messages = NULL;
+  GError     *err = NULL;
+  guint64     size = 0;
+  guint       pass;
+  guint       i;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (paths != NULL || n_paths == 0, FALSE);
+
+  files = g_new0 (BatchFile, n_paths);
+  for (i = 0; i < n_paths; i++) {
+    struct stat st;
+
+    files[i].path = paths[i];
+    files[i].fd = open_for_writing (self, paths[i]);
+    if (files[i].fd < 0) {
+      set_error_from_errno (&err, errno, _("Failed to open \"%s\": %s"),
+                            paths[i]);
+    } else if (fstat (files[i].fd, &st) != 0) {
+      set_error_from_errno (&err, errno, _("Failed to stat \"%s\": %s"),
+                            paths[i]);
+    } else {
+      files[i].device = st.st_dev;
+      files[i].extents = get_extents (files[i].fd, (guint64) st.st_size);
+      size += get_extents_size ((const Extent *) files[i].extents->data,
+                                files[i].extents->len);
+    }
+    if (err) {
+      batch_file_fail (&files[i], &messages, &err);
+    }
+  }
+
+  for (pass = 0; ! err && pass < self->n_passes; pass++) {
+    for (i = 0; ! err && i < n_paths; i++) {
+      if (files[i].fd < 0) {
+        continue;
+      }
+      if (! write_extents (self, files[i].fd, pass,
+                           (const Extent *) files[i].extents->data,
+                           files[i].extents->len, size, FALSE, &err) &&
+          ! g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        prefix_error_with_path (&err, files[i].path);
+        batch_file_fail (&files[i], &messages, &err);
+      }
+      files[i].direct = self->direct_file;
+    }
+    if (! err && ! self->fast) {
+      if (! sync_batch (self, files, n_paths, &err)) {
+        batch_fail_open (files, n_paths, &messages, &err);
+      } else {
+        for (i = 0; i < n_paths; i++) {
+          if (files[i].fd >= 0 && ! files[i].direct) {
+            drop_cache (self, files[i].fd,
+                        (const Extent *) files[i].extents->data,
+                        files[i].extents->len);
+          }
+        }
+      }
+    }
+  }
+
+  if (! err) {
+    for (i = 0; i < n_paths; i++) {
+      if (files[i].fd >= 0 && ftruncate (files[i].fd, 0) != 0) {
+        set_error_from_errno (&err, errno, _("Failed to truncate \"%s\": %s"),
+                              files[i].path);
+        batch_file_fail (&files[i], &messages, &err);
+      }
+    }
+    if (! self->fast && ! sync_batch (self, files, n_paths, &err)) {
+      batch_fail_open (files, n_paths, &messages, &err);
+    }
+  }
+
+  for (i = 0; i < n_paths; i++) {
+    if (files[i].fd >= 0) {
+      gint fd = files[i].fd;
+
+      files[i].fd = -1;
+      if (close (fd) != 0 && ! err) {
+        set_error_from_errno (&err, errno, _("Failed to close \"%s\": %s"),
+                              files[i].path);
+        batch_file_fail (&files[i], &messages, &err);
+      } else if (! err && ! nw_overwrite_remove (files[i].path, &err)) {
+        batch_file_fail (&files[i], &messages, &err);
+      }
+    }
+    if (files[i].extents) {
+      g_array_free (files[i].extents, TRUE);
+    }
+  }
+  g_free (files);
+
+  if (err) {
+    /* canceled */
+    g_propagate_error (error, err);
+    if (messages) {
+      g_string_free (messages, TRUE);
+    }
+    return FALSE;
+  } else if (messages) {
+    g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                         messages->str);
+    g_string_free (messages, TRUE);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * nw_overwriter_fill:
+ * @self: A #NwOverwriter
+ * @directory: A directory on the file system to fill
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Overwrites the available space of the file system holding @directory.  A file
+ * is created in @directory and grown with the first pass until the file system
+ * is full, then the other passes are written over it before removing it.
+ * Unlike sfill(1), the space reserved to the administrator and the unused
+ * inodes are not wiped.
+ *
+ * As the space that can actually be filled is only known at the end of the
+ * first pass, the size the check function gets for it is an estimate.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+nw_overwriter_fill (NwOverwriter *self,
+                    const gchar  *directory,
+                    GError      **error)
+{
+  struct statvfs  vfs;
+  struct stat     st;
+  gchar          *path;
+  gint            fd;
+  guint64         available = 0;
+  guint64         size = 0;
+  gboolean        success = TRUE;
+  GArray         *extents = NULL;
+  guint           pass;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (directory != NULL, FALSE);
+
+  path = g_build_filename (directory, "nemo-wipe-XXXXXX", NULL);
+  fd = g_mkstemp_full (path, get_open_flags (self), S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    set_error_from_errno (error, errno,
+                          _("Failed to create a file in \"%s\": %s"),
+                          directory);
+    g_free (path);
+    return FALSE;
+  }
+  if (fstatvfs (fd, &vfs) == 0) {
+    available = (guint64) vfs.f_bavail * vfs.f_frsize;
+  }
+
+  /* grow the file with the first pass until there's no space left, continuing
+   * past the estimate if needed */
+  while (success) {
+    GError *err = NULL;
+    Extent  extent;
+
+    extent.offset = size;
+    extent.length = MAX (available > size ? available - size : 0,
+                         NW_OVERWRITE_BUFFER_SIZE);
+    if (write_extents_data (self, fd, 0, &extent, 1, MAX (available, 1),
+                            ! self->fast, FALSE, &err)) {
+      size += extent.length;
+    } else if (g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOSPC)) {
+      /* full, what was written still has to be synchronized */
+      g_error_free (err);
+      break;
+    } else {
+      g_propagate_error (error, err);
+      success = FALSE;
+    }
+  }
+  if (success && fstat (fd, &st) != 0) {
+    set_error_from_errno (error, errno, _("Failed to stat \"%s\": %s"), path);
+    success = FALSE;
+  } else if (success) {
+    extents = get_extents (fd, (guint64) st.st_size);
+    if (! self->fast) {
+      if (fdatasync (fd) != 0) {
+        success = set_sync_error (error, errno);
+      } else if (! self->direct_file) {
+        drop_cache (self, fd, (const Extent *) extents->data, extents->len);
+      }
+    }
+  }
+  for (pass = 1; success && pass < self->n_passes; pass++) {
+    success = write_extents (self, fd, pass, (const Extent *) extents->data,
+                             extents->len,
+                             get_extents_size ((const Extent *) extents->data,
+                                               extents->len),
+                             ! self->fast, error);
+  }
+  if (extents) {
+    g_array_free (extents, TRUE);
+  }
+  close (fd);
+  /* whatever happened, give the space back */
+  if (g_unlink (path) != 0 && success) {
+    set_error_from_errno (error, errno, _("Failed to remove \"%s\": %s"),
+                          path);
+    success = FALSE;
+  }
+  g_free (path);
+
+  return success;
+}
+
+/*
+ * nw_overwrite_remove:
+ * @path: Path to a file or an empty directory
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Removes @path, after renaming it to a random name of the same length not to
+ * leave the original name in the directory's data.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+nw_overwrite_remove (const gchar *path,
+                     GError     **error)
+{
+  static const gchar  chars[] = "abcdefghijklmnopqrstuvwxyz"
+                                "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "0123456789";
+  gchar              *dirname;
+  gchar              *name;
+  gchar              *new_path;
+  struct stat         st;
+  gsize               i;
+  gboolean            success = TRUE;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  dirname = g_path_get_dirname (path);
+  name = g_path_get_basename (path);
+  for (i = 0; name[i]; i++) {
+    name[i] = chars[g_random_int_range (0, sizeof chars - 1)];
+  }
+  new_path = g_build_filename (dirname, name, NULL);
+  /* don't clobber anything: if the name is taken or the rename fails, simply
+   * remove the file under its original name */
+  if (g_lstat (new_path, &st) == 0 || g_rename (path, new_path) != 0) {
+    g_free (new_path);
+    new_path = g_strdup (path);
+  }
+  if (g_remove (new_path) != 0) {
+    set_error_from_errno (error, errno, _("Failed to remove \"%s\": %s"), path);
+    success = FALSE;
+  }
+  g_free (new_path);
+  g_free (name);
+  g_free (dirname);
+
+  return success;
+}
@@ -0,0 +1,110 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_OVERWRITE_H
+#define NW_OVERWRITE_H
+
+#include <glib.h>
+#include <gsecuredelete.h>
+
+#include "nw-operation.h"
+
+G_BEGIN_DECLS
+
+
+/* size of the buffer each write is issued from */
+#define NW_OVERWRITE_BUFFER_SIZE  (1024 * 1024)
+/* alignment of the write buffer, suitable for any page size we care about */
+#define NW_OVERWRITE_BUFFER_ALIGN 4096
+/* number of writes kept in flight when using io_uring */
+#define NW_OVERWRITE_URING_DEPTH  8
+/* amount of data written between writebacks in streaming sync mode */
+#define NW_OVERWRITE_STREAM_WINDOW  (8 * 1024 * 1024)
+/* largest write issued in direct I/O mode, whatever the device's optimal I/O
+ * size */
+#define NW_OVERWRITE_DIRECT_MAX_CHUNK (16 * 1024 * 1024)
+
+typedef struct _NwOverwriter NwOverwriter;
+
+/**
+ * NwOverwriteCheckFunc:
+ * @pass: The pass currently being written (starting at 0)
+ * @written: Number of bytes written since the last call
+ * @size: Number of bytes the pass writes in total.  For whole files, this is
+ *        the allocated size rather than the apparent one
+ * @data: User data
+ *
+ * Called between each write to report progress and to give the caller a chance
+ * to pause (by blocking) or cancel (by returning %FALSE) the work.  It is
+ * called from the thread running the overwriter.
+ *
+ * Returns: %FALSE to abort the operation, %TRUE to continue.
+ */
+typedef gboolean  (*NwOverwriteCheckFunc)   (guint    pass,
+                                             guint64  written,
+                                             guint64  size,
+                                             gpointer data);
+
+
+guint           nw_overwrite_count_passes        (GsdSecureDeleteOperationMode mode);
+
+NwOverwriter   *nw_overwriter_new                (GsdSecureDeleteOperationMode mode,
+                                                  gboolean                     fast,
+                                                  gboolean                     zeroise,
+                                                  GError                     **error);
+void            nw_overwriter_free               (NwOverwriter        *self);
+void            nw_overwriter_set_check_func     (NwOverwriter        *self,
+                                                  NwOverwriteCheckFunc func,
+                                                  gpointer             data);
+guint           nw_overwriter_get_n_passes       (NwOverwriter        *self);
+void            nw_overwriter_set_sync_policy    (NwOverwriter        *self,
+                                                  NwOperationSyncPolicy policy);
+void            nw_overwriter_get_zero_stats     (NwOverwriter        *self,
+                                                  guint64             *offloaded,
+                                                  guint64             *written);
+guint64         nw_overwriter_get_cache_released (NwOverwriter        *self);
+void            nw_overwriter_set_direct_io      (NwOverwriter        *self,
+                                                  gboolean             direct);
+gboolean        nw_overwriter_enable_uring       (NwOverwriter        *self,
+                                                  GError             **error);
+gboolean        nw_overwriter_write_pass         (NwOverwriter        *self,
+                                                  gint                 fd,
+                                                  guint                pass,
+                                                  guint64              offset,
+                                                  guint64              length,
+                                                  GError             **error);
+gboolean        nw_overwriter_wipe_file          (NwOverwriter        *self,
+                                                  const gchar         *path,
+                                                  GError             **error);
+gboolean        nw_overwriter_wipe_files         (NwOverwriter        *self,
+                                                  const gchar *const  *paths,
+                                                  guint                n_paths,
+                                                  GError             **error);
+gboolean        nw_overwriter_fill               (NwOverwriter        *self,
+                                                  const gchar         *directory,
+                                                  GError             **error);
+gboolean        nw_overwrite_remove              (const gchar         *path,
+                                                  GError             **error);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -25,6 +25,7 @@
 
 #include "nw-path-list.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <glib.h>
 #include "nw-api-impl.h"
@@ -168,3 +169,126 @@ nw_path_list_new_from_nfi_list (GList *nfis)
 
   return paths;
 }
+
+/* gets the canonical form of @path, with its parent's symbolic links, "." and
+ * ".." resolved.  The last component is kept as is, for a link to be wiped
+ * rather than what it points to */
+static gchar *
+canonicalize_path (const gchar *path)
+{
+  gchar  *dirname = g_path_get_dirname (path);
+  gchar  *basename = g_path_get_basename (path);
+  gchar  *parent = realpath (dirname, NULL);
+  gchar  *canonical;
+
+  if (! parent || strcmp (basename, ".") == 0 ||
+      strcmp (basename, "..") == 0 || strcmp (basename, G_DIR_SEPARATOR_S) == 0) {
+    canonical = g_strdup (path);
+  } else {
+    canonical = g_build_filename (parent, basename, NULL);
+  }
+  free (parent);
+  g_free (dirname);
+  g_free (basename);
+
+  return canonical;
+}
+
+/* compares paths component by component, so that a path sorts right before
+ * its descendants ("/a", "/a/b", "/a-b" rather than "/a", "/a-b", "/a/b") */
+static gint
+compare_paths (gconstpointer a,
+               gconstpointer b)
+{
+  const guchar *pa = *(const guchar *const *) a;
+  const guchar *pb = *(const guchar *const *) b;
+
+  while (*pa && *pa == *pb) {
+    pa++;
+    pb++;
+  }
+  if (*pa == *pb) {
+    return 0;
+  } else if (*pa == G_DIR_SEPARATOR || ! *pb) {
+    return *pb ? -1 : 1;
+  } else if (*pb == G_DIR_SEPARATOR || ! *pa) {
+    return *pa ? 1 : -1;
+  }
+
+  return *pa < *pb ? -1 : 1;
+}
+
+/* checks whether @path is @ancestor or is inside it */
+static gboolean
+path_has_prefix (const gchar *path,
+                 const gchar *ancestor)
+{
+  gsize len = strlen (ancestor);
+
+  return strncmp (path, ancestor, len) == 0 &&
+         (path[len] == 0 || path[len] == G_DIR_SEPARATOR ||
+          (len > 0 && ancestor[len - 1] == G_DIR_SEPARATOR));
+}
+
+/*
+ * nw_path_list_normalize:
+ * @paths: A list of paths
+ * @n_dropped: (out) (allow-none): return location for the number of paths
+ *             left out, or %NULL
+ *
+ * Canonicalizes @paths and leaves out those selected twice or inside another
+ * one, which would be wiped with it anyway.  The others keep their order.
+ * Free the returned list with nw_path_list_free().
+ *
+ * Returns: The normalized list of paths.
+ */
+GList *
+nw_path_list_normalize (GList *paths,
+                        guint *n_dropped)
+{
+  GPtrArray    *canonical;
+  GPtrArray    *sorted;
+  GHashTable   *dropped;
+  GList        *normalized = NULL;
+  const gchar  *kept = NULL;
+  guint         i;
+
+  canonical = g_ptr_array_new ();
+  sorted = g_ptr_array_new ();
+  for (; paths; paths = paths->next) {
+    gchar *path = canonicalize_path (paths->data);
+
+    g_ptr_array_add (canonical, path);
+    g_ptr_array_add (sorted, path);
+  }
+  /* once sorted, whatever a path covers directly follows it */
+  g_ptr_array_sort (sorted, compare_paths);
+  dropped = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (i = 0; i < sorted->len; i++) {
+    const gchar *path = g_ptr_array_index (sorted, i);
+
+    if (kept && path_has_prefix (path, kept)) {
+      g_hash_table_insert (dropped, (gpointer) path, (gpointer) path);
+    } else {
+      kept = path;
+    }
+  }
+  if (n_dropped) {
+    *n_dropped = g_hash_table_size (dropped);
+  }
+  /* the sort only served finding them, keep the selection's order */
+  for (i = canonical->len; i > 0; i--) {
+    gchar *path = g_ptr_array_index (canonical, i - 1);
+
+    if (g_hash_table_lookup (dropped, path)) {
+      g_free (path);
+    } else {
+      normalized = g_list_prepend (normalized, path);
+    }
+  }
+  g_hash_table_destroy (dropped);
+  g_ptr_array_free (sorted, TRUE);
+  g_ptr_array_free (canonical, TRUE);
+
+  return normalized;
+}
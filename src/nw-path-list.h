@@ -33,6 +33,8 @@ gchar  *nw_path_from_nfi                (NemoFileInfo *nfi);
 GList  *nw_path_list_new_from_nfi_list  (GList *nfis);
 void    nw_path_list_free               (GList *paths);
 GList  *nw_path_list_copy               (GList *src);
+GList  *nw_path_list_normalize          (GList *paths,
+                                         guint *n_dropped);
 
 
 G_END_DECLS
@@ -0,0 +1,194 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Process-wide cache of the buffers periodic overwrite patterns are written
+ * from.  Each pattern is built once and shared by every file, pass and
+ * overwriter for as long as one of them is alive. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-pattern.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define NW_PATTERN_X86 1
+#include <immintrin.h>
+#endif
+
+
+/* the length of a template, multiple of 3 and of the widest vector */
+#define TEMPLATE_SIZE 96
+
+
+static GMutex       cache_mutex;
+static GHashTable  *cache = NULL;
+static guint        cache_users = 0;
+
+
+#ifdef NW_PATTERN_X86
+
+__attribute__ ((target ("avx2")))
+static void
+fill_avx2 (guint8       *buf,
+           gsize         size,
+           const guint8 *template)
+{
+  const __m256i v0 = _mm256_loadu_si256 ((const __m256i *) template);
+  const __m256i v1 = _mm256_loadu_si256 ((const __m256i *) (template + 32));
+  const __m256i v2 = _mm256_loadu_si256 ((const __m256i *) (template + 64));
+  gsize         i;
+
+  for (i = 0; i < size; i += TEMPLATE_SIZE) {
+    _mm256_store_si256 ((__m256i *) (buf + i), v0);
+    _mm256_store_si256 ((__m256i *) (buf + i + 32), v1);
+    _mm256_store_si256 ((__m256i *) (buf + i + 64), v2);
+  }
+}
+
+__attribute__ ((target ("sse2")))
+static void
+fill_sse2 (guint8       *buf,
+           gsize         size,
+           const guint8 *template)
+{
+  const __m128i v0 = _mm_loadu_si128 ((const __m128i *) template);
+  const __m128i v1 = _mm_loadu_si128 ((const __m128i *) (template + 16));
+  const __m128i v2 = _mm_loadu_si128 ((const __m128i *) (template + 32));
+  gsize         i;
+
+  /* 48 bytes is enough to repeat 3 bytes patterns */
+  for (i = 0; i < size; i += 48) {
+    _mm_store_si128 ((__m128i *) (buf + i), v0);
+    _mm_store_si128 ((__m128i *) (buf + i + 16), v1);
+    _mm_store_si128 ((__m128i *) (buf + i + 32), v2);
+  }
+}
+
+#endif /* NW_PATTERN_X86 */
+
+/* fills the aligned @buf of @size bytes (multiple of TEMPLATE_SIZE) with
+ * copies of @template */
+static void
+fill_pattern (guint8       *buf,
+              gsize         size,
+              const guint8 *template)
+{
+  gsize done;
+
+  #ifdef NW_PATTERN_X86
+  if (__builtin_cpu_supports ("avx2")) {
+    fill_avx2 (buf, size, template);
+    return;
+  } else if (__builtin_cpu_supports ("sse2")) {
+    fill_sse2 (buf, size, template);
+    return;
+  }
+  #endif
+  /* copy what is already filled, doubling each time */
+  memcpy (buf, template, TEMPLATE_SIZE);
+  for (done = TEMPLATE_SIZE; done < size; done *= 2) {
+    memcpy (buf + done, buf, MIN (done, size - done));
+  }
+}
+
+/*
+ * nw_pattern_cache_ref:
+ * 
+ * Marks the cache as used.  Buffers are kept until the last user calls
+ * nw_pattern_cache_unref().
+ */
+void
+nw_pattern_cache_ref (void)
+{
+  g_mutex_lock (&cache_mutex);
+  if (cache_users++ == 0) {
+    cache = g_hash_table_new_full (NULL, NULL, NULL, free);
+  }
+  g_mutex_unlock (&cache_mutex);
+}
+
+void
+nw_pattern_cache_unref (void)
+{
+  g_mutex_lock (&cache_mutex);
+  g_warn_if_fail (cache_users > 0);
+  if (--cache_users == 0) {
+    g_hash_table_destroy (cache);
+    cache = NULL;
+  }
+  g_mutex_unlock (&cache_mutex);
+}
+
+/*
+ * nw_pattern_cache_get:
+ * @pattern: The 3 bytes of the pattern.  1 byte patterns repeat it 3 times
+ * @phase: Index in @pattern of the first byte to write
+ * 
+ * Gets a buffer filled with @pattern, starting at @phase.  The caller must
+ * hold a reference on the cache.
+ * 
+ * Returns: A page-aligned buffer of %NW_PATTERN_BUFFER_SIZE bytes, or %NULL if
+ *          it couldn't be allocated.  It is owned by the cache, and must not
+ *          be modified.
+ */
+const guint8 *
+nw_pattern_cache_get (const guint8 pattern[3],
+                      guint        phase)
+{
+  guint8    rotated[3];
+  gpointer  key;
+  guint8   *buf;
+
+  rotated[0] = pattern[phase % 3];
+  rotated[1] = pattern[(phase + 1) % 3];
+  rotated[2] = pattern[(phase + 2) % 3];
+  key = GUINT_TO_POINTER (rotated[0] | (rotated[1] << 8) | (rotated[2] << 16));
+
+  g_mutex_lock (&cache_mutex);
+  if (G_UNLIKELY (! cache)) {
+    g_mutex_unlock (&cache_mutex);
+    g_critical ("%s: the pattern cache is not referenced", G_STRFUNC);
+    return NULL;
+  }
+  buf = g_hash_table_lookup (cache, key);
+  if (! buf) {
+    if (posix_memalign ((void **) &buf, 4096, NW_PATTERN_BUFFER_SIZE) != 0) {
+      buf = NULL;
+    } else {
+      guint8 template[TEMPLATE_SIZE];
+      guint  i;
+
+      for (i = 0; i < TEMPLATE_SIZE; i++) {
+        template[i] = rotated[i % 3];
+      }
+      fill_pattern (buf, NW_PATTERN_BUFFER_SIZE, template);
+      g_hash_table_insert (cache, key, buf);
+    }
+  }
+  g_mutex_unlock (&cache_mutex);
+
+  return buf;
+}
@@ -0,0 +1,43 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_PATTERN_H
+#define NW_PATTERN_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+/* size of a cached pattern buffer.  It is a multiple of the page size, and of
+ * 3 so that 1 and 3 bytes patterns tile across consecutive writes */
+#define NW_PATTERN_BUFFER_SIZE  (3 * 4096 * 32)
+
+
+void          nw_pattern_cache_ref    (void);
+void          nw_pattern_cache_unref  (void);
+const guint8 *nw_pattern_cache_get    (const guint8 pattern[3],
+                                       guint        phase);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,475 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* ChaCha20 keystream generator used for the random passes.
+ * 
+ * It is seeded once from the kernel and then runs entirely in user space,
+ * which is a lot faster than reading /dev/urandom.  Several blocks are computed
+ * at once with SSE2 or AVX2 when the CPU supports it. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-random.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define NW_RANDOM_X86 1
+#include <immintrin.h>
+#endif
+
+
+#define CHACHA_BLOCK_SIZE 64
+
+typedef void  (*BlocksFunc)  (const guint32 *state,
+                              guint8        *out,
+                              gsize          n_blocks);
+
+struct _NwRandom {
+  /* constants, key, 64 bit block counter and 64 bit nonce, as in the original
+   * ChaCha design */
+  guint32 state[16];
+};
+
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d)                                              \
+  G_STMT_START {                                                               \
+    a += b; d ^= a; d = ROTL32 (d, 16);                                        \
+    c += d; b ^= c; b = ROTL32 (b, 12);                                        \
+    a += b; d ^= a; d = ROTL32 (d, 8);                                         \
+    c += d; b ^= c; b = ROTL32 (b, 7);                                         \
+  } G_STMT_END
+
+/* the 10 double rounds, on anything supporting +, ^ and the ROTL macro */
+#define DOUBLE_ROUNDS(x, ROTL)                                                 \
+  G_STMT_START {                                                               \
+    gint r_;                                                                   \
+                                                                               \
+    for (r_ = 0; r_ < 10; r_++) {                                              \
+      QR (x[0], x[4], x[8],  x[12], ROTL);                                     \
+      QR (x[1], x[5], x[9],  x[13], ROTL);                                     \
+      QR (x[2], x[6], x[10], x[14], ROTL);                                     \
+      QR (x[3], x[7], x[11], x[15], ROTL);                                     \
+      QR (x[0], x[5], x[10], x[15], ROTL);                                     \
+      QR (x[1], x[6], x[11], x[12], ROTL);                                     \
+      QR (x[2], x[7], x[8],  x[13], ROTL);                                     \
+      QR (x[3], x[4], x[9],  x[14], ROTL);                                     \
+    }                                                                          \
+  } G_STMT_END
+
+static void
+chacha_blocks_scalar (const guint32 *state,
+                      guint8        *out,
+                      gsize          n_blocks)
+{
+  guint64 counter = state[12] | ((guint64) state[13] << 32);
+
+  for (; n_blocks > 0; n_blocks--, counter++, out += CHACHA_BLOCK_SIZE) {
+    guint32 x[16];
+    guint32 in[16];
+    gint    i;
+
+    memcpy (in, state, sizeof in);
+    in[12] = (guint32) counter;
+    in[13] = (guint32) (counter >> 32);
+    memcpy (x, in, sizeof x);
+    for (i = 0; i < 10; i++) {
+      QUARTER_ROUND (x[0], x[4], x[8],  x[12]);
+      QUARTER_ROUND (x[1], x[5], x[9],  x[13]);
+      QUARTER_ROUND (x[2], x[6], x[10], x[14]);
+      QUARTER_ROUND (x[3], x[7], x[11], x[15]);
+      QUARTER_ROUND (x[0], x[5], x[10], x[15]);
+      QUARTER_ROUND (x[1], x[6], x[11], x[12]);
+      QUARTER_ROUND (x[2], x[7], x[8],  x[13]);
+      QUARTER_ROUND (x[3], x[4], x[9],  x[14]);
+    }
+    for (i = 0; i < 16; i++) {
+      guint32 v = GUINT32_TO_LE (x[i] + in[i]);
+
+      memcpy (out + i * 4, &v, 4);
+    }
+  }
+}
+
+#ifdef NW_RANDOM_X86
+
+/* vectorized quarter round, each lane computing a different block */
+#define QR(a, b, c, d, ROTL)                                                   \
+  G_STMT_START {                                                               \
+    a = ADD (a, b); d = XOR (d, a); d = ROTL (d, 16);                          \
+    c = ADD (c, d); b = XOR (b, c); b = ROTL (b, 12);                          \
+    a = ADD (a, b); d = XOR (d, a); d = ROTL (d, 8);                           \
+    c = ADD (c, d); b = XOR (b, c); b = ROTL (b, 7);                           \
+  } G_STMT_END
+
+#define ADD(a, b)   _mm_add_epi32 (a, b)
+#define XOR(a, b)   _mm_xor_si128 (a, b)
+#define ROTL_SSE2(v, n) \
+  _mm_or_si128 (_mm_slli_epi32 (v, n), _mm_srli_epi32 (v, 32 - (n)))
+
+/* computes 4 blocks at a time, word i of block j being in lane j of x[i] */
+__attribute__ ((target ("sse2")))
+static void
+chacha_blocks_sse2 (const guint32 *state,
+                    guint8        *out,
+                    gsize          n_blocks)
+{
+  guint64 counter = state[12] | ((guint64) state[13] << 32);
+
+  for (; n_blocks >= 4; n_blocks -= 4, counter += 4, out += 4 * CHACHA_BLOCK_SIZE) {
+    __m128i in[16];
+    __m128i x[16];
+    gint    i;
+
+    for (i = 0; i < 16; i++) {
+      in[i] = _mm_set1_epi32 ((gint) state[i]);
+    }
+    in[12] = _mm_set_epi32 ((gint) (counter + 3), (gint) (counter + 2),
+                            (gint) (counter + 1), (gint) counter);
+    in[13] = _mm_set_epi32 ((gint) ((counter + 3) >> 32),
+                            (gint) ((counter + 2) >> 32),
+                            (gint) ((counter + 1) >> 32),
+                            (gint) (counter >> 32));
+    memcpy (x, in, sizeof x);
+    DOUBLE_ROUNDS (x, ROTL_SSE2);
+    for (i = 0; i < 16; i++) {
+      x[i] = ADD (x[i], in[i]);
+    }
+    /* transpose each 4x4 group of words back to block order */
+    for (i = 0; i < 16; i += 4) {
+      __m128i t0 = _mm_unpacklo_epi32 (x[i],     x[i + 1]);
+      __m128i t1 = _mm_unpacklo_epi32 (x[i + 2], x[i + 3]);
+      __m128i t2 = _mm_unpackhi_epi32 (x[i],     x[i + 1]);
+      __m128i t3 = _mm_unpackhi_epi32 (x[i + 2], x[i + 3]);
+
+      _mm_storeu_si128 ((__m128i *) (out + 0 * CHACHA_BLOCK_SIZE + i * 4),
+                        _mm_unpacklo_epi64 (t0, t1));
+      _mm_storeu_si128 ((__m128i *) (out + 1 * CHACHA_BLOCK_SIZE + i * 4),
+                        _mm_unpackhi_epi64 (t0, t1));
+      _mm_storeu_si128 ((__m128i *) (out + 2 * CHACHA_BLOCK_SIZE + i * 4),
+                        _mm_unpacklo_epi64 (t2, t3));
+      _mm_storeu_si128 ((__m128i *) (out + 3 * CHACHA_BLOCK_SIZE + i * 4),
+                        _mm_unpackhi_epi64 (t2, t3));
+    }
+  }
+  if (n_blocks > 0) {
+    guint32 tail[16];
+
+    memcpy (tail, state, sizeof tail);
+    tail[12] = (guint32) counter;
+    tail[13] = (guint32) (counter >> 32);
+    chacha_blocks_scalar (tail, out, n_blocks);
+  }
+}
+
+#undef ADD
+#undef XOR
+
+#define ADD(a, b)   _mm256_add_epi32 (a, b)
+#define XOR(a, b)   _mm256_xor_si256 (a, b)
+/* rotations by whole bytes are a single shuffle */
+#define ROTL_AVX2(v, n)                                                        \
+  ((n) == 16 ? _mm256_shuffle_epi8 (v, rot16) :                                \
+   (n) == 8  ? _mm256_shuffle_epi8 (v, rot8) :                                 \
+   _mm256_or_si256 (_mm256_slli_epi32 (v, n), _mm256_srli_epi32 (v, 32 - (n))))
+
+/* computes 8 blocks at a time, word i of block j being in lane j of x[i] */
+__attribute__ ((target ("avx2")))
+static void
+chacha_blocks_avx2 (const guint32 *state,
+                    guint8        *out,
+                    gsize          n_blocks)
+{
+  guint64 counter = state[12] | ((guint64) state[13] << 32);
+  const __m256i rot16 = _mm256_set_epi8 (13, 12, 15, 14, 9, 8, 11, 10,
+                                         5, 4, 7, 6, 1, 0, 3, 2,
+                                         13, 12, 15, 14, 9, 8, 11, 10,
+                                         5, 4, 7, 6, 1, 0, 3, 2);
+  const __m256i rot8  = _mm256_set_epi8 (14, 13, 12, 15, 10, 9, 8, 11,
+                                         6, 5, 4, 7, 2, 1, 0, 3,
+                                         14, 13, 12, 15, 10, 9, 8, 11,
+                                         6, 5, 4, 7, 2, 1, 0, 3);
+
+  for (; n_blocks >= 8; n_blocks -= 8, counter += 8, out += 8 * CHACHA_BLOCK_SIZE) {
+    __m256i in[16];
+    __m256i x[16];
+    gint    i;
+
+    for (i = 0; i < 16; i++) {
+      in[i] = _mm256_set1_epi32 ((gint) state[i]);
+    }
+    in[12] = _mm256_set_epi32 ((gint) (counter + 7), (gint) (counter + 6),
+                               (gint) (counter + 5), (gint) (counter + 4),
+                               (gint) (counter + 3), (gint) (counter + 2),
+                               (gint) (counter + 1), (gint) counter);
+    in[13] = _mm256_set_epi32 ((gint) ((counter + 7) >> 32),
+                               (gint) ((counter + 6) >> 32),
+                               (gint) ((counter + 5) >> 32),
+                               (gint) ((counter + 4) >> 32),
+                               (gint) ((counter + 3) >> 32),
+                               (gint) ((counter + 2) >> 32),
+                               (gint) ((counter + 1) >> 32),
+                               (gint) (counter >> 32));
+    memcpy (x, in, sizeof x);
+    DOUBLE_ROUNDS (x, ROTL_AVX2);
+    for (i = 0; i < 16; i++) {
+      x[i] = ADD (x[i], in[i]);
+    }
+    /* transpose each 8x8 group of words back to block order */
+    for (i = 0; i < 16; i += 8) {
+      __m256i t0 = _mm256_unpacklo_epi32 (x[i],     x[i + 1]);
+      __m256i t1 = _mm256_unpackhi_epi32 (x[i],     x[i + 1]);
+      __m256i t2 = _mm256_unpacklo_epi32 (x[i + 2], x[i + 3]);
+      __m256i t3 = _mm256_unpackhi_epi32 (x[i + 2], x[i + 3]);
+      __m256i t4 = _mm256_unpacklo_epi32 (x[i + 4], x[i + 5]);
+      __m256i t5 = _mm256_unpackhi_epi32 (x[i + 4], x[i + 5]);
+      __m256i t6 = _mm256_unpacklo_epi32 (x[i + 6], x[i + 7]);
+      __m256i t7 = _mm256_unpackhi_epi32 (x[i + 6], x[i + 7]);
+      __m256i u[8];
+      gint    j;
+
+      /* u[j] holds blocks j and j + 4, words i to i + 3 and i + 4 to i + 7 */
+      u[0] = _mm256_unpacklo_epi64 (t0, t2);
+      u[1] = _mm256_unpackhi_epi64 (t0, t2);
+      u[2] = _mm256_unpacklo_epi64 (t1, t3);
+      u[3] = _mm256_unpackhi_epi64 (t1, t3);
+      u[4] = _mm256_unpacklo_epi64 (t4, t6);
+      u[5] = _mm256_unpackhi_epi64 (t4, t6);
+      u[6] = _mm256_unpacklo_epi64 (t5, t7);
+      u[7] = _mm256_unpackhi_epi64 (t5, t7);
+      for (j = 0; j < 4; j++) {
+        _mm256_storeu_si256 ((__m256i *) (out + j * CHACHA_BLOCK_SIZE + i * 4),
+                             _mm256_permute2x128_si256 (u[j], u[j + 4], 0x20));
+        _mm256_storeu_si256 ((__m256i *) (out + (j + 4) * CHACHA_BLOCK_SIZE + i * 4),
+                             _mm256_permute2x128_si256 (u[j], u[j + 4], 0x31));
+      }
+    }
+  }
+  if (n_blocks > 0) {
+    guint32 tail[16];
+
+    memcpy (tail, state, sizeof tail);
+    tail[12] = (guint32) counter;
+    tail[13] = (guint32) (counter >> 32);
+    chacha_blocks_sse2 (tail, out, n_blocks);
+  }
+}
+
+#undef ADD
+#undef XOR
+#undef QR
+
+#endif /* NW_RANDOM_X86 */
+
+
+typedef struct {
+  const gchar  *name;
+  BlocksFunc    func;
+} Impl;
+
+/* picks the fastest implementation the CPU supports */
+static const Impl *
+get_impl (void)
+{
+  static const Impl  *impl = NULL;
+  static const Impl   impls[] = {
+    { "scalar", chacha_blocks_scalar },
+    #ifdef NW_RANDOM_X86
+    { "sse2",   chacha_blocks_sse2 },
+    { "avx2",   chacha_blocks_avx2 }
+    #endif
+  };
+
+  if (g_once_init_enter (&impl)) {
+    const Impl *best = &impls[0];
+
+    #ifdef NW_RANDOM_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+      best = &impls[2];
+    } else if (__builtin_cpu_supports ("sse2")) {
+      best = &impls[1];
+    }
+    #endif
+    g_once_init_leave (&impl, best);
+  }
+
+  return impl;
+}
+
+/* Returns: The name of the keystream implementation in use, for debugging */
+const gchar *
+nw_random_get_impl_name (void)
+{
+  return get_impl ()->name;
+}
+
+/* reads @len bytes of seed from the kernel */
+static gboolean
+read_seed (guint8  *buf,
+           gsize    len,
+           GError **error)
+{
+  gint fd;
+
+  #ifdef HAVE_GETRANDOM
+  while (len > 0) {
+    gssize n = getrandom (buf, len, 0);
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0) {
+      /* e.g. ENOSYS on old kernels, try the device */
+      break;
+    }
+    buf += n;
+    len -= (gsize) n;
+  }
+  if (len == 0) {
+    return TRUE;
+  }
+  #endif
+
+  fd = g_open ("/dev/urandom", O_RDONLY | O_CLOEXEC, 0);
+  while (fd >= 0 && len > 0) {
+    gssize n = read (fd, buf, len);
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      errno = n < 0 ? errno : EIO;
+      break;
+    }
+    buf += n;
+    len -= (gsize) n;
+  }
+  if (len > 0) {
+    gint errsv = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                 _("Failed to read \"%s\": %s"), "/dev/urandom",
+                 g_strerror (errsv));
+  }
+  if (fd >= 0) {
+    close (fd);
+  }
+
+  return len == 0;
+}
+
+/*
+ * nw_random_new:
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Creates a new random generator, seeded with a random key and nonce.  A
+ * generator is not thread-safe, each thread should use its own.
+ *
+ * Returns: A new #NwRandom, or %NULL if it couldn't be seeded.  Free with
+ *          nw_random_free().
+ */
+NwRandom *
+nw_random_new (GError **error)
+{
+  NwRandom *self = g_slice_new (NwRandom);
+  guint32   seed[10];
+  gint      i;
+
+  if (! read_seed ((guint8 *) seed, sizeof seed, error)) {
+    g_slice_free (NwRandom, self);
+    return NULL;
+  }
+  /* "expand 32-byte k" */
+  self->state[0] = 0x61707865;
+  self->state[1] = 0x3320646e;
+  self->state[2] = 0x79622d32;
+  self->state[3] = 0x6b206574;
+  for (i = 0; i < 8; i++) {
+    self->state[4 + i] = GUINT32_FROM_LE (seed[i]);
+  }
+  self->state[12] = 0;
+  self->state[13] = 0;
+  self->state[14] = GUINT32_FROM_LE (seed[8]);
+  self->state[15] = GUINT32_FROM_LE (seed[9]);
+  memset (seed, 0, sizeof seed);
+
+  return self;
+}
+
+void
+nw_random_free (NwRandom *self)
+{
+  g_return_if_fail (self != NULL);
+
+  memset (self->state, 0, sizeof self->state);
+  g_slice_free (NwRandom, self);
+}
+
+/*
+ * nw_random_fill:
+ * @self: A #NwRandom
+ * @buf: buffer to fill
+ * @len: number of bytes to write to @buf
+ *
+ * Fills @buf with the next @len bytes of keystream.
+ */
+void
+nw_random_fill (NwRandom *self,
+                guint8   *buf,
+                gsize     len)
+{
+  const Impl *impl = get_impl ();
+  gsize       n_blocks = len / CHACHA_BLOCK_SIZE;
+  guint64     counter;
+
+  g_return_if_fail (self != NULL);
+
+  counter = self->state[12] | ((guint64) self->state[13] << 32);
+  if (n_blocks > 0) {
+    impl->func (self->state, buf, n_blocks);
+    counter += n_blocks;
+    self->state[12] = (guint32) counter;
+    self->state[13] = (guint32) (counter >> 32);
+  }
+  if (len % CHACHA_BLOCK_SIZE) {
+    guint8 block[CHACHA_BLOCK_SIZE];
+
+    /* the rest of this block is dropped, the next fill starts a new one */
+    chacha_blocks_scalar (self->state, block, 1);
+    memcpy (buf + n_blocks * CHACHA_BLOCK_SIZE, block, len % CHACHA_BLOCK_SIZE);
+    memset (block, 0, sizeof block);
+    counter ++;
+    self->state[12] = (guint32) counter;
+    self->state[13] = (guint32) (counter >> 32);
+  }
+}
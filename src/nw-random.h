@@ -0,0 +1,43 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_RANDOM_H
+#define NW_RANDOM_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _NwRandom NwRandom;
+
+
+NwRandom   *nw_random_new             (GError  **error);
+void        nw_random_free            (NwRandom *self);
+void        nw_random_fill            (NwRandom *self,
+                                       guint8   *buf,
+                                       gsize     len);
+const gchar *nw_random_get_impl_name  (void);
+
+
+G_END_DECLS
+
+#endif /* guard */
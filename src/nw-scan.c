@@ -0,0 +1,458 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Counting of what a selection holds before wiping it: a thread groups the
+ * selection by device, then walks it, directories included, and publishes the
+ * number of files and the amount of data found so far.  The walk only keeps a
+ * directory handle per level and publishes its totals in chunks, so it stays
+ * cheap on large trees.  It can be started before the operation exists, e.g.
+ * while the user confirms, which then takes over its results. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-scan.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "nw-device.h"
+#include "nw-path-list.h"
+#include "nw-walk.h"
+
+
+/* entries walked between two publications of the totals */
+#define NW_SCAN_PUBLISH_ENTRIES 1024
+/* minimal delay between two notifications, in microseconds */
+#define NW_SCAN_NOTIFY_INTERVAL (G_USEC_PER_SEC / 10)
+/* copy-on-write files whose path is kept to tell the user */
+#define NW_SCAN_MAX_COW_PATHS 5
+
+
+struct _NwScan {
+  GList        *paths;
+  NwScanFunc    func;
+  gpointer      data;
+  GThread      *thread;
+  volatile gint canceled;
+
+  GMutex        mutex;
+  /* protected by the mutex */
+  guint         n_files;
+  guint64       n_bytes;
+  gboolean      done;
+  GList        *groups;
+  guint         cow_files;
+  guint64       cow_bytes;
+  GPtrArray    *cow_paths;
+  guint         notify_source;
+  gint64        last_notify;
+
+  /* walker's own counts, not published yet */
+  guint         pending_files;
+  guint64       pending_bytes;
+  guint         pending_entries;
+  guint         pending_cow_files;
+  guint64       pending_cow_bytes;
+  /* inodes with several links already counted */
+  GHashTable   *links;
+  /* path of the entry being walked */
+  GString      *path;
+};
+
+
+static gboolean
+notify_idle (gpointer data)
+{
+  NwScan     *self = data;
+  NwScanFunc  func;
+  gpointer    func_data;
+
+  g_mutex_lock (&self->mutex);
+  self->notify_source = 0;
+  func = self->func;
+  func_data = self->data;
+  g_mutex_unlock (&self->mutex);
+  if (func) {
+    func (self, func_data);
+  }
+
+  return FALSE;
+}
+
+/* publishes the walker's counts, and asks for a notification if the last one
+ * is old enough or if @done */
+static void
+publish (NwScan   *self,
+         gboolean  done)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&self->mutex);
+  self->n_files += self->pending_files;
+  self->n_bytes += self->pending_bytes;
+  self->cow_files += self->pending_cow_files;
+  self->cow_bytes += self->pending_cow_bytes;
+  self->done = done;
+  if (self->func && self->notify_source == 0 &&
+      (done || now - self->last_notify >= NW_SCAN_NOTIFY_INTERVAL)) {
+    self->last_notify = now;
+    self->notify_source = g_idle_add (notify_idle, self);
+  }
+  g_mutex_unlock (&self->mutex);
+  self->pending_files = 0;
+  self->pending_bytes = 0;
+  self->pending_entries = 0;
+  self->pending_cow_files = 0;
+  self->pending_cow_bytes = 0;
+}
+
+/* checks whether @st is a hard link to a file already counted, whose data is
+ * only wiped once */
+static gboolean
+is_known_link (NwScan            *self,
+               const struct stat *st)
+{
+  NwWalkEntry entry;
+
+  if (st->st_nlink <= 1) {
+    return FALSE;
+  }
+  entry.device = st->st_dev;
+  entry.inode = (guint64) st->st_ino;
+
+  return ! nw_walk_inode_set_add (self->links, &entry);
+}
+
+/* counts @bytes of the copy-on-write file being walked, whose path is kept
+ * if among the first ones */
+static void
+add_cow_file (NwScan  *self,
+              guint64  bytes)
+{
+  self->pending_cow_files ++;
+  self->pending_cow_bytes += bytes;
+  g_mutex_lock (&self->mutex);
+  if (self->cow_paths->len < NW_SCAN_MAX_COW_PATHS) {
+    g_ptr_array_add (self->cow_paths, g_strdup (self->path->str));
+  }
+  g_mutex_unlock (&self->mutex);
+}
+
+/* counts the entry @name of @dir_fd, recursing in directories.  Entries that
+ * can't be read are skipped, the wipe will report them anyway.  @may_cow
+ * tells whether @dir_fd's file system may copy data on write, or is -1 if
+ * unknown */
+static void
+scan_at (NwScan      *self,
+         gint         dir_fd,
+         const gchar *name,
+         gint         may_cow)
+{
+  struct stat st;
+  gsize       path_len = self->path->len;
+
+  if (g_atomic_int_get (&self->canceled) ||
+      fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return;
+  }
+  if (path_len > 0 && self->path->str[path_len - 1] != G_DIR_SEPARATOR) {
+    g_string_append_c (self->path, G_DIR_SEPARATOR);
+  }
+  g_string_append (self->path, name);
+  if (may_cow < 0 || S_ISDIR (st.st_mode)) {
+    /* the file system may change at any directory, being a mount point */
+    may_cow = nw_device_may_copy_on_write (dir_fd, name);
+  }
+  if (S_ISDIR (st.st_mode)) {
+    gint  fd;
+    DIR  *dir = NULL;
+
+    fd = openat (dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0 && ! (dir = fdopendir (fd))) {
+      close (fd);
+    }
+    if (dir) {
+      struct dirent *entry;
+
+      while ((entry = readdir (dir))) {
+        if (strcmp (entry->d_name, ".") != 0 &&
+            strcmp (entry->d_name, "..") != 0) {
+          scan_at (self, dirfd (dir), entry->d_name, may_cow);
+        }
+      }
+      closedir (dir);
+    }
+  } else {
+    self->pending_files ++;
+    if (S_ISREG (st.st_mode) && ! is_known_link (self, &st)) {
+      /* sparse files only have their allocated data written */
+      guint64 bytes = MIN ((guint64) st.st_size, (guint64) st.st_blocks * 512);
+
+      self->pending_bytes += bytes;
+      if (may_cow && bytes > 0 &&
+          nw_device_file_is_copy_on_write (dir_fd, name)) {
+        add_cow_file (self, bytes);
+      }
+    }
+  }
+  g_string_truncate (self->path, path_len);
+  if (++ self->pending_entries >= NW_SCAN_PUBLISH_ENTRIES) {
+    publish (self, FALSE);
+  }
+}
+
+static gpointer
+scan_thread (gpointer data)
+{
+  NwScan *self = data;
+  GList  *groups;
+  GList  *item;
+
+  groups = nw_device_group_paths (self->paths);
+  g_mutex_lock (&self->mutex);
+  self->groups = groups;
+  g_mutex_unlock (&self->mutex);
+  self->links = nw_walk_inode_set_new ();
+  self->path = g_string_new (NULL);
+  for (item = self->paths; item; item = item->next) {
+    scan_at (self, AT_FDCWD, item->data, -1);
+  }
+  g_hash_table_destroy (self->links);
+  self->links = NULL;
+  g_string_free (self->path, TRUE);
+  self->path = NULL;
+  publish (self, TRUE);
+
+  return NULL;
+}
+
+/*
+ * nw_scan_new:
+ * @paths: The paths to count
+ * @func: Function called as the totals grow, or %NULL
+ * @data: User data for @func
+ *
+ * Starts counting the files and data held by @paths, recursing in
+ * directories.  Symbolic links are not followed.  The totals can be read at
+ * any time with nw_scan_get_totals().
+ *
+ * Returns: A new #NwScan, to be freed with nw_scan_free().
+ */
+NwScan *
+nw_scan_new (GList       *paths,
+             NwScanFunc   func,
+             gpointer     data)
+{
+  NwScan *self = g_slice_new (NwScan);
+
+  self->paths = nw_path_list_copy (paths);
+  self->func = func;
+  self->data = data;
+  self->canceled = 0;
+  g_mutex_init (&self->mutex);
+  self->n_files = 0;
+  self->n_bytes = 0;
+  self->done = FALSE;
+  self->groups = NULL;
+  self->notify_source = 0;
+  self->last_notify = 0;
+  self->pending_files = 0;
+  self->pending_bytes = 0;
+  self->pending_entries = 0;
+  self->links = NULL;
+  self->path = NULL;
+  self->cow_files = 0;
+  self->cow_bytes = 0;
+  self->cow_paths = g_ptr_array_new_with_free_func (g_free);
+  self->pending_cow_files = 0;
+  self->pending_cow_bytes = 0;
+  self->thread = g_thread_try_new ("nw-scan", scan_thread, self, NULL);
+  if (! self->thread) {
+    /* not knowing the totals is not an error, it only makes for a less
+     * accurate progress */
+    publish (self, TRUE);
+  }
+
+  return self;
+}
+
+/*
+ * nw_scan_get_totals:
+ * @scan: A #NwScan
+ * @n_files: return location for the number of files found, or %NULL
+ * @n_bytes: return location for the amount of data found, or %NULL
+ *
+ * Gets what @scan found so far, which is the totals once nw_scan_is_done().
+ * Directories themselves are not counted.
+ */
+void
+nw_scan_get_totals (NwScan  *self,
+                    guint   *n_files,
+                    guint64 *n_bytes)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  if (n_files) {
+    *n_files = self->n_files;
+  }
+  if (n_bytes) {
+    *n_bytes = self->n_bytes;
+  }
+  g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * nw_scan_get_copy_on_write:
+ * @scan: A #NwScan
+ * @n_files: return location for the number of copy-on-write files found, or
+ *           %NULL
+ * @n_bytes: return location for the amount of data they hold, or %NULL
+ *
+ * Gets what @scan found so far of the files overwriting would not reach, see
+ * nw_device_file_is_copy_on_write().
+ *
+ * Returns: A newly allocated %NULL-terminated array of the paths of the first
+ *          of these files, to free with g_strfreev().
+ */
+gchar **
+nw_scan_get_copy_on_write (NwScan  *self,
+                           guint   *n_files,
+                           guint64 *n_bytes)
+{
+  gchar **paths;
+  guint   i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+  if (n_files) {
+    *n_files = self->cow_files;
+  }
+  if (n_bytes) {
+    *n_bytes = self->cow_bytes;
+  }
+  paths = g_new (gchar *, self->cow_paths->len + 1);
+  for (i = 0; i < self->cow_paths->len; i++) {
+    paths[i] = g_strdup (g_ptr_array_index (self->cow_paths, i));
+  }
+  paths[i] = NULL;
+  g_mutex_unlock (&self->mutex);
+
+  return paths;
+}
+
+gboolean
+nw_scan_is_done (NwScan *self)
+{
+  gboolean done;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  g_mutex_lock (&self->mutex);
+  done = self->done;
+  g_mutex_unlock (&self->mutex);
+
+  return done;
+}
+
+/*
+ * nw_scan_set_func:
+ * @scan: A #NwScan
+ * @func: Function called as the totals grow, or %NULL
+ * @data: User data for @func
+ *
+ * Changes the function notified of the progress of @scan, e.g. when the
+ * operation takes over a scan started for the confirmation dialog.  Must be
+ * called from the main thread.
+ */
+void
+nw_scan_set_func (NwScan     *self,
+                  NwScanFunc  func,
+                  gpointer    data)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->func = func;
+  self->data = data;
+  g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * nw_scan_steal_device_groups:
+ * @scan: A #NwScan
+ *
+ * Takes the paths of @scan grouped by device, as nw_device_group_paths()
+ * does.  They are computed first, so they are generally ready long before the
+ * totals.
+ *
+ * Returns: A list of #NwDeviceGroup to be freed with
+ *          nw_device_group_list_free(), or %NULL if not computed yet or
+ *          already taken.
+ */
+GList *
+nw_scan_steal_device_groups (NwScan *self)
+{
+  GList *groups;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+  groups = self->groups;
+  self->groups = NULL;
+  g_mutex_unlock (&self->mutex);
+
+  return groups;
+}
+
+/*
+ * nw_scan_free:
+ * @scan: A #NwScan
+ *
+ * Stops @scan if still running and frees it.  Its function won't be called
+ * anymore.  Must be called from the main thread.
+ */
+void
+nw_scan_free (NwScan *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_atomic_int_set (&self->canceled, 1);
+  if (self->thread) {
+    g_thread_join (self->thread);
+  }
+  if (self->notify_source) {
+    g_source_remove (self->notify_source);
+  }
+  g_mutex_clear (&self->mutex);
+  nw_device_group_list_free (self->groups);
+  nw_path_list_free (self->paths);
+  g_ptr_array_free (self->cow_paths, TRUE);
+  g_slice_free (NwScan, self);
+}
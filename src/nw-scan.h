@@ -0,0 +1,65 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_SCAN_H
+#define NW_SCAN_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _NwScan NwScan;
+
+/**
+ * NwScanFunc:
+ * @scan: The #NwScan
+ * @data: User data
+ *
+ * Called in the main thread as the totals of @scan grow, at most a few times
+ * per second, and once more when the scan is done.
+ */
+typedef void  (*NwScanFunc)   (NwScan  *scan,
+                               gpointer data);
+
+
+NwScan   *nw_scan_new         (GList       *paths,
+                               NwScanFunc   func,
+                               gpointer     data);
+void      nw_scan_get_totals  (NwScan      *scan,
+                               guint       *n_files,
+                               guint64     *n_bytes);
+gchar   **nw_scan_get_copy_on_write
+                              (NwScan      *scan,
+                               guint       *n_files,
+                               guint64     *n_bytes);
+gboolean  nw_scan_is_done     (NwScan      *scan);
+void      nw_scan_set_func    (NwScan      *scan,
+                               NwScanFunc   func,
+                               gpointer     data);
+GList    *nw_scan_steal_device_groups
+                              (NwScan      *scan);
+void      nw_scan_free        (NwScan      *scan);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,281 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Limits on how much of the disk the built-in engines use: a token bucket
+ * capping the write bandwidth, shared by all the threads of an operation and
+ * adjustable while running, and the I/O scheduling class of their threads. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-throttle.h"
+
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <glib.h>
+
+#include "nw-operation.h"
+
+
+/* from linux/ioprio.h, which is not always installed */
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_CLASS_BE     2
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_BE_LOWEST    7
+
+
+struct _NwThrottle {
+  GMutex    mutex;
+  GCond     cond;
+  guint64   rate;     /* bytes per second, 0 for no limit */
+  gdouble   tokens;   /* bytes that can be written right away, negative when
+                       * more was written */
+  gint64    last;     /* monotonic time tokens were last added */
+  gboolean  canceled;
+};
+
+
+/*
+ * nw_throttle_new:
+ * @rate: The bandwidth to allow in bytes per second, or 0 for no limit
+ *
+ * Creates a new throttle.  A throttle is thread-safe, its limit applying to
+ * all the threads consuming from it together.
+ *
+ * Returns: A new #NwThrottle.  Free with nw_throttle_free().
+ */
+NwThrottle *
+nw_throttle_new (guint64 rate)
+{
+  NwThrottle *self = g_slice_new (NwThrottle);
+
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->cond);
+  self->rate = rate;
+  self->tokens = 0;
+  self->last = g_get_monotonic_time ();
+  self->canceled = FALSE;
+
+  return self;
+}
+
+void
+nw_throttle_free (NwThrottle *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_clear (&self->mutex);
+  g_cond_clear (&self->cond);
+  g_slice_free (NwThrottle, self);
+}
+
+/* adds the tokens earned since the last call.  Must be called with the mutex
+ * held */
+static void
+refill (NwThrottle *self)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (self->rate == 0) {
+    self->tokens = 0;
+  } else {
+    gdouble burst = (gdouble) self->rate * NW_THROTTLE_BURST_TIME /
+                    G_USEC_PER_SEC;
+
+    self->tokens += (gdouble) self->rate * (now - self->last) / G_USEC_PER_SEC;
+    self->tokens = MIN (self->tokens, burst);
+  }
+  self->last = now;
+}
+
+/*
+ * nw_throttle_set_rate:
+ * @self: A #NwThrottle
+ * @rate: The bandwidth to allow in bytes per second, or 0 for no limit
+ *
+ * Changes the limit of @self.  Threads waiting in nw_throttle_consume() are
+ * released according to the new limit right away.
+ */
+void
+nw_throttle_set_rate (NwThrottle *self,
+                      guint64     rate)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  refill (self);
+  self->rate = rate;
+  refill (self);
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->mutex);
+}
+
+guint64
+nw_throttle_get_rate (NwThrottle *self)
+{
+  guint64 rate;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  g_mutex_lock (&self->mutex);
+  rate = self->rate;
+  g_mutex_unlock (&self->mutex);
+
+  return rate;
+}
+
+/*
+ * nw_throttle_consume:
+ * @self: A #NwThrottle
+ * @bytes: Number of bytes just written
+ *
+ * Accounts for @bytes written, blocking as long as needed for the writes to
+ * stay within the limit.  Writes are accounted once done, so that a single
+ * write larger than what the limit allows in a while doesn't stall.
+ *
+ * Returns: %FALSE if @self got canceled, %TRUE otherwise.
+ */
+gboolean
+nw_throttle_consume (NwThrottle *self,
+                     guint64     bytes)
+{
+  gboolean canceled;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  g_mutex_lock (&self->mutex);
+  refill (self);
+  if (self->rate > 0) {
+    self->tokens -= (gdouble) bytes;
+  }
+  while (! self->canceled && self->rate > 0 && self->tokens < 0) {
+    gint64 end_time = self->last + (gint64) (-self->tokens * G_USEC_PER_SEC /
+                                             self->rate);
+
+    g_cond_wait_until (&self->cond, &self->mutex, end_time);
+    refill (self);
+  }
+  canceled = self->canceled;
+  g_mutex_unlock (&self->mutex);
+
+  return ! canceled;
+}
+
+/*
+ * nw_throttle_cancel:
+ * @self: A #NwThrottle
+ *
+ * Releases the threads waiting in nw_throttle_consume(), and makes it return
+ * %FALSE right away until nw_throttle_reset() is called.
+ */
+void
+nw_throttle_cancel (NwThrottle *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->canceled = TRUE;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * nw_throttle_reset:
+ * @self: A #NwThrottle
+ *
+ * Makes @self ready for a new run, forgetting what was written and whether it
+ * was canceled.
+ */
+void
+nw_throttle_reset (NwThrottle *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->canceled = FALSE;
+  self->tokens = 0;
+  self->last = g_get_monotonic_time ();
+  g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * nw_throttle_apply_io_class:
+ * @io_class: The I/O class to use
+ *
+ * Sets the I/O priority of the calling thread according to @io_class.  On
+ * Linux, processes spawned afterwards by the thread inherit it.
+ *
+ * Returns: The previous priority to give to nw_throttle_restore_io_priority(),
+ *          or -1 if it was left unchanged.
+ */
+gint
+nw_throttle_apply_io_class (NwOperationIoClass io_class)
+{
+#if defined (__linux__) && defined (SYS_ioprio_set) && defined (SYS_ioprio_get)
+  gint priority;
+  gint previous;
+
+  switch (io_class) {
+    case NW_OPERATION_IO_CLASS_LOW:
+      priority = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | IOPRIO_BE_LOWEST;
+      break;
+
+    case NW_OPERATION_IO_CLASS_IDLE:
+      priority = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+      break;
+
+    default:
+      return -1;
+  }
+  /* the calling thread, not the whole process */
+  previous = (gint) syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+  if (previous < 0 ||
+      syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority) != 0) {
+    g_debug ("Failed to set the I/O priority: %s", g_strerror (errno));
+    return -1;
+  }
+
+  return previous;
+#else
+  return -1;
+#endif
+}
+
+/*
+ * nw_throttle_restore_io_priority:
+ * @priority: A priority returned by nw_throttle_apply_io_class()
+ *
+ * Gives the calling thread its I/O priority back.
+ */
+void
+nw_throttle_restore_io_priority (gint priority)
+{
+#if defined (__linux__) && defined (SYS_ioprio_set)
+  if (priority >= 0) {
+    syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority);
+  }
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_THROTTLE_H
+#define NW_THROTTLE_H
+
+#include <glib.h>
+
+#include "nw-operation.h"
+
+G_BEGIN_DECLS
+
+
+/* how long a throttle can save up for when writes pause, in microseconds */
+#define NW_THROTTLE_BURST_TIME  (G_USEC_PER_SEC / 4)
+
+typedef struct _NwThrottle NwThrottle;
+
+
+NwThrottle *nw_throttle_new                 (guint64             rate);
+void        nw_throttle_free                (NwThrottle         *self);
+void        nw_throttle_set_rate            (NwThrottle         *self,
+                                             guint64             rate);
+guint64     nw_throttle_get_rate            (NwThrottle         *self);
+gboolean    nw_throttle_consume             (NwThrottle         *self,
+                                             guint64             bytes);
+void        nw_throttle_cancel              (NwThrottle         *self);
+void        nw_throttle_reset               (NwThrottle         *self);
+
+gint        nw_throttle_apply_io_class      (NwOperationIoClass  io_class);
+void        nw_throttle_restore_io_priority (gint                priority);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,582 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Minimal io_uring submission/completion ring, using the raw system calls so
+ * we don't need liburing */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-uring.h"
+
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+#include <gio/gio.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+struct _NwUring {
+  gint                  fd;
+  guint                 n_queued;     /* queued but not yet submitted */
+  guint                 n_in_flight;  /* submitted but not yet popped */
+  guint                 entries;
+
+  /* completions reaped from the ring while it was busy, not yet popped */
+  GArray               *reaped;
+  guint                 reaped_head;
+
+  /* submission ring */
+  gpointer              sq_ptr;
+  gsize                 sq_len;
+  guint                *sq_head;
+  guint                *sq_tail;
+  guint                *sq_mask;
+  guint                *sq_array;
+  struct io_uring_sqe  *sqes;
+  gsize                 sqes_len;
+
+  /* completion ring */
+  gpointer              cq_ptr;
+  gsize                 cq_len;
+  guint                *cq_head;
+  guint                *cq_tail;
+  guint                *cq_mask;
+  struct io_uring_cqe  *cqes;
+};
+
+
+static gint
+sys_io_uring_setup (guint                   entries,
+                    struct io_uring_params *params)
+{
+  return (gint) syscall (__NR_io_uring_setup, entries, params);
+}
+
+static gint
+sys_io_uring_enter (gint  fd,
+                    guint to_submit,
+                    guint min_complete,
+                    guint flags)
+{
+  return (gint) syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static gint
+sys_io_uring_register (gint      fd,
+                       guint     opcode,
+                       gpointer  arg,
+                       guint     nr_args)
+{
+  return (gint) syscall (__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* checks whether the kernel supports the requests we issue.  Older kernels
+ * don't support probing, but neither do they support IORING_OP_WRITE */
+static gboolean
+check_supported_ops (gint fd)
+{
+  static const guint8     ops[] = { IORING_OP_WRITE, IORING_OP_FSYNC };
+  struct io_uring_probe  *probe;
+  gboolean                supported;
+  gsize                   i;
+
+  probe = g_malloc0 (sizeof *probe + 256 * sizeof (struct io_uring_probe_op));
+  supported = sys_io_uring_register (fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+  for (i = 0; supported && i < G_N_ELEMENTS (ops); i++) {
+    supported = (ops[i] <= probe->last_op &&
+                 (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED));
+  }
+  g_free (probe);
+
+  return supported;
+}
+
+/*
+ * nw_uring_new:
+ * @entries: The number of requests the ring can hold
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Sets up a new ring.  This fails if the kernel doesn't support io_uring or if
+ * its use is forbidden.
+ *
+ * Returns: A new #NwUring, or %NULL on error.  Free with nw_uring_free().
+ */
+NwUring *
+nw_uring_new (guint     entries,
+              GError  **error)
+{
+  struct io_uring_params  params;
+  NwUring                *self;
+
+  self = g_slice_new0 (NwUring);
+  self->reaped = g_array_new (FALSE, FALSE, sizeof (NwUringCompletion));
+  self->sq_ptr = MAP_FAILED;
+  self->cq_ptr = MAP_FAILED;
+  self->sqes = MAP_FAILED;
+
+  memset (&params, 0, sizeof params);
+  self->fd = sys_io_uring_setup (entries, &params);
+  if (self->fd < 0) {
+    gint errsv = errno;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 _("Failed to set up asynchronous I/O: %s"), g_strerror (errsv));
+    g_array_free (self->reaped, TRUE);
+    g_slice_free (NwUring, self);
+    return NULL;
+  }
+  self->entries = params.sq_entries;
+  if (! check_supported_ops (self->fd)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 _("Asynchronous I/O is not supported"));
+    nw_uring_free (self);
+    return NULL;
+  }
+
+  self->sq_len = params.sq_off.array + params.sq_entries * sizeof (guint);
+  self->cq_len = params.cq_off.cqes +
+                 params.cq_entries * sizeof (struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    self->sq_len = MAX (self->sq_len, self->cq_len);
+    self->cq_len = self->sq_len;
+  }
+  self->sq_ptr = mmap (NULL, self->sq_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQ_RING);
+  if (self->sq_ptr != MAP_FAILED) {
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      self->cq_ptr = self->sq_ptr;
+    } else {
+      self->cq_ptr = mmap (NULL, self->cq_len, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, self->fd,
+                           IORING_OFF_CQ_RING);
+    }
+  }
+  if (self->cq_ptr != MAP_FAILED) {
+    self->sqes_len = params.sq_entries * sizeof (struct io_uring_sqe);
+    self->sqes = mmap (NULL, self->sqes_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQES);
+  }
+  if (self->sqes == MAP_FAILED) {
+    gint errsv = errno;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 _("Failed to set up asynchronous I/O: %s"), g_strerror (errsv));
+    nw_uring_free (self);
+    return NULL;
+  }
+
+  self->sq_head  = (guint *) ((guint8 *) self->sq_ptr + params.sq_off.head);
+  self->sq_tail  = (guint *) ((guint8 *) self->sq_ptr + params.sq_off.tail);
+  self->sq_mask  = (guint *) ((guint8 *) self->sq_ptr + params.sq_off.ring_mask);
+  self->sq_array = (guint *) ((guint8 *) self->sq_ptr + params.sq_off.array);
+  self->cq_head  = (guint *) ((guint8 *) self->cq_ptr + params.cq_off.head);
+  self->cq_tail  = (guint *) ((guint8 *) self->cq_ptr + params.cq_off.tail);
+  self->cq_mask  = (guint *) ((guint8 *) self->cq_ptr + params.cq_off.ring_mask);
+  self->cqes     = (struct io_uring_cqe *) ((guint8 *) self->cq_ptr +
+                                            params.cq_off.cqes);
+
+  return self;
+}
+
+void
+nw_uring_free (NwUring *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (self->sqes != MAP_FAILED) {
+    munmap (self->sqes, self->sqes_len);
+  }
+  if (self->cq_ptr != MAP_FAILED && self->cq_ptr != self->sq_ptr) {
+    munmap (self->cq_ptr, self->cq_len);
+  }
+  if (self->sq_ptr != MAP_FAILED) {
+    munmap (self->sq_ptr, self->sq_len);
+  }
+  if (self->fd >= 0) {
+    close (self->fd);
+  }
+  g_array_free (self->reaped, TRUE);
+  g_slice_free (NwUring, self);
+}
+
+/* Returns: how many more requests can be queued without overflowing the
+ *          completion ring */
+guint
+nw_uring_get_n_free (NwUring *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->entries - self->n_queued - self->n_in_flight;
+}
+
+/* gets the next free submission entry, or %NULL if the ring is full.  It must
+ * be filled, then handed over with put_sqe() */
+static struct io_uring_sqe *
+get_sqe (NwUring *self)
+{
+  struct io_uring_sqe  *sqe;
+  guint                 index;
+
+  if (nw_uring_get_n_free (self) == 0) {
+    return NULL;
+  }
+  index = *self->sq_tail & *self->sq_mask;
+  sqe = &self->sqes[index];
+  memset (sqe, 0, sizeof *sqe);
+  self->sq_array[index] = index;
+
+  return sqe;
+}
+
+/* hands the entry filled after get_sqe() over to the kernel, which only sees it
+ * once the tail is released */
+static void
+put_sqe (NwUring *self)
+{
+  __atomic_store_n (self->sq_tail, *self->sq_tail + 1, __ATOMIC_RELEASE);
+  self->n_queued++;
+}
+
+/*
+ * nw_uring_queue_write:
+ * @self: A #NwUring
+ * @fd: The file descriptor to write to
+ * @buf: The data to write, which must stay valid until completion
+ * @len: Length of @buf
+ * @offset: Where to write in @fd
+ * @user_data: Data to identify the request on completion
+ * @link: Whether the next queued request should only start after this one
+ *        completed successfully
+ *
+ * Queues a write.  It is only started by the next call to nw_uring_submit().
+ *
+ * Returns: %TRUE if the request was queued, %FALSE if the ring is full.
+ */
+gboolean
+nw_uring_queue_write (NwUring      *self,
+                      gint          fd,
+                      gconstpointer buf,
+                      gsize         len,
+                      guint64       offset,
+                      guint64       user_data,
+                      gboolean      link)
+{
+  struct io_uring_sqe *sqe;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  sqe = get_sqe (self);
+  if (sqe) {
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (guint64) (guintptr) buf;
+    sqe->len = (guint32) len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    put_sqe (self);
+  }
+
+  return sqe != NULL;
+}
+
+/*
+ * nw_uring_queue_fsync:
+ * @self: A #NwUring
+ * @fd: The file descriptor to synchronize
+ * @user_data: Data to identify the request on completion
+ *
+ * Queues a data synchronization of @fd that acts as a barrier: it only starts
+ * once every previously submitted request completed.
+ *
+ * Returns: %TRUE if the request was queued, %FALSE if the ring is full.
+ */
+gboolean
+nw_uring_queue_fsync (NwUring  *self,
+                      gint      fd,
+                      guint64   user_data)
+{
+  struct io_uring_sqe *sqe;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  sqe = get_sqe (self);
+  if (sqe) {
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = user_data;
+    sqe->flags = IOSQE_IO_DRAIN;
+    put_sqe (self);
+  }
+
+  return sqe != NULL;
+}
+
+/* gets the number of completions reaped but not yet popped */
+static guint
+get_n_reaped (NwUring *self)
+{
+  return self->reaped->len - self->reaped_head;
+}
+
+/* moves the completions available in the ring to self->reaped, so the kernel
+ * has room to post more.
+ * Returns: the number of completions reaped */
+static guint
+reap_completions (NwUring *self)
+{
+  guint head = *self->cq_head;
+  guint tail = __atomic_load_n (self->cq_tail, __ATOMIC_ACQUIRE);
+  guint n = tail - head;
+
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe = &self->cqes[head & *self->cq_mask];
+    NwUringCompletion    completion;
+
+    completion.user_data = cqe->user_data;
+    completion.res = cqe->res;
+    g_array_append_val (self->reaped, completion);
+  }
+  __atomic_store_n (self->cq_head, head, __ATOMIC_RELEASE);
+
+  return n;
+}
+
+static gboolean
+set_submit_error (GError  **error,
+                  gint      errnum)
+{
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errnum),
+               _("Failed to submit asynchronous I/O: %s"),
+               g_strerror (errnum));
+
+  return FALSE;
+}
+
+/*
+ * nw_uring_submit:
+ * @self: A #NwUring
+ * @wait_nr: Minimum number of completions to wait for
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Submits all queued requests to the kernel, and waits for at least @wait_nr
+ * of the submitted requests to complete.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+nw_uring_submit (NwUring  *self,
+                 guint     wait_nr,
+                 GError  **error)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  /* completions already reaped count towards the wait */
+  wait_nr = wait_nr > get_n_reaped (self) ? wait_nr - get_n_reaped (self) : 0;
+  wait_nr = MIN (wait_nr, self->n_queued + self->n_in_flight -
+                          get_n_reaped (self));
+  while (self->n_queued > 0 || wait_nr > 0) {
+    gint ret;
+
+    ret = sys_io_uring_enter (self->fd, self->n_queued, wait_nr,
+                              wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (ret < 0) {
+      gint errsv = errno;
+
+      if (errsv == EINTR) {
+        continue;
+      } else if (errsv == EBUSY || errsv == EAGAIN) {
+        /* the kernel is short on room for completions: make some by reaping
+         * them, or wait for one if none is there yet */
+        guint n_reaped = reap_completions (self);
+
+        if (n_reaped > 0) {
+          wait_nr -= MIN (wait_nr, n_reaped);
+          continue;
+        } else if (self->n_in_flight > get_n_reaped (self) &&
+                   sys_io_uring_enter (self->fd, 0, 1,
+                                       IORING_ENTER_GETEVENTS) >= 0) {
+          continue;
+        }
+      }
+      return set_submit_error (error, errsv);
+    } else if (ret == 0 && self->n_queued > 0) {
+      /* nothing could be submitted, trying again wouldn't do any better */
+      return set_submit_error (error, EIO);
+    }
+    self->n_queued -= (guint) ret;
+    self->n_in_flight += (guint) ret;
+    /* the wait was satisfied, or will be next time for what's left */
+    wait_nr = self->n_queued > 0 ? wait_nr : 0;
+  }
+
+  return TRUE;
+}
+
+/*
+ * nw_uring_pop:
+ * @self: A #NwUring
+ * @completion: return location for the completion
+ *
+ * Gets the next completed request, if any.  This never blocks.
+ *
+ * Returns: %TRUE if a completion was returned, %FALSE otherwise.
+ */
+gboolean
+nw_uring_pop (NwUring           *self,
+              NwUringCompletion *completion)
+{
+  guint head;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  if (get_n_reaped (self) > 0) {
+    *completion = g_array_index (self->reaped, NwUringCompletion,
+                                 self->reaped_head++);
+    if (self->reaped_head == self->reaped->len) {
+      g_array_set_size (self->reaped, 0);
+      self->reaped_head = 0;
+    }
+    self->n_in_flight--;
+    return TRUE;
+  }
+
+  head = *self->cq_head;
+  if (head == __atomic_load_n (self->cq_tail, __ATOMIC_ACQUIRE)) {
+    return FALSE;
+  } else {
+    struct io_uring_cqe *cqe = &self->cqes[head & *self->cq_mask];
+
+    completion->user_data = cqe->user_data;
+    completion->res = cqe->res;
+    __atomic_store_n (self->cq_head, head + 1, __ATOMIC_RELEASE);
+    self->n_in_flight--;
+    return TRUE;
+  }
+}
+
+/*
+ * nw_uring_drain:
+ * @self: A #NwUring
+ *
+ * Drops the requests not submitted yet, and waits for all the submitted ones to
+ * complete, discarding their completions.  Afterwards, the kernel doesn't use
+ * any buffer given to @self anymore, and @self is empty.
+ *
+ * Returns: %TRUE on success, %FALSE if waiting failed, in which case @self
+ *          must not be used anymore.
+ */
+gboolean
+nw_uring_drain (NwUring *self)
+{
+  NwUringCompletion completion;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  /* the kernel only reads entries past the head when we enter it */
+  __atomic_store_n (self->sq_tail, *self->sq_head, __ATOMIC_RELEASE);
+  self->n_queued = 0;
+  while (self->n_in_flight > 0) {
+    if (! nw_uring_pop (self, &completion) &&
+        sys_io_uring_enter (self->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+        errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+#else /* HAVE_LINUX_IO_URING_H */
+
+NwUring *
+nw_uring_new (guint     entries,
+              GError  **error)
+{
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+               _("Asynchronous I/O is not supported"));
+
+  return NULL;
+}
+
+void
+nw_uring_free (NwUring *self)
+{
+}
+
+guint
+nw_uring_get_n_free (NwUring *self)
+{
+  return 0;
+}
+
+gboolean
+nw_uring_queue_write (NwUring      *self,
+                      gint          fd,
+                      gconstpointer buf,
+                      gsize         len,
+                      guint64       offset,
+                      guint64       user_data,
+                      gboolean      link)
+{
+  return FALSE;
+}
+
+gboolean
+nw_uring_queue_fsync (NwUring  *self,
+                      gint      fd,
+                      guint64   user_data)
+{
+  return FALSE;
+}
+
+gboolean
+nw_uring_submit (NwUring  *self,
+                 guint     wait_nr,
+                 GError  **error)
+{
+  return FALSE;
+}
+
+gboolean
+nw_uring_pop (NwUring           *self,
+              NwUringCompletion *completion)
+{
+  return FALSE;
+}
+
+gboolean
+nw_uring_drain (NwUring *self)
+{
+  return TRUE;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
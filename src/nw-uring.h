@@ -0,0 +1,70 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_URING_H
+#define NW_URING_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _NwUring NwUring;
+
+/**
+ * NwUringCompletion:
+ * @user_data: The user data given when queuing the request
+ * @res: The result of the request, as the corresponding system call would
+ *       return it, or a negated errno value on failure
+ *
+ * A completed request.
+ */
+typedef struct {
+  guint64 user_data;
+  gint    res;
+} NwUringCompletion;
+
+
+NwUring    *nw_uring_new           (guint        entries,
+                                    GError     **error);
+void        nw_uring_free          (NwUring     *self);
+guint       nw_uring_get_n_free    (NwUring     *self);
+gboolean    nw_uring_queue_write   (NwUring     *self,
+                                    gint         fd,
+                                    gconstpointer buf,
+                                    gsize        len,
+                                    guint64      offset,
+                                    guint64      user_data,
+                                    gboolean     link);
+gboolean    nw_uring_queue_fsync   (NwUring     *self,
+                                    gint         fd,
+                                    guint64      user_data);
+gboolean    nw_uring_submit        (NwUring     *self,
+                                    guint        wait_nr,
+                                    GError     **error);
+gboolean    nw_uring_pop           (NwUring            *self,
+                                    NwUringCompletion  *completion);
+gboolean    nw_uring_drain         (NwUring            *self);
+
+
+G_END_DECLS
+
+#endif /* guard */
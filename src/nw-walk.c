@@ -0,0 +1,294 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Directory listing for the built-in engines: entries are read in large
+ * chunks with getdents64(2) and stated relative to their directory with
+ * statx(2), asking only for the fields we use, so that listing huge trees
+ * costs as few system calls and path lookups as possible. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nw-walk.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#else
+#include <dirent.h>
+#endif
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+
+
+/* size of the buffer directory entries are read in */
+#define NW_WALK_BUFFER_SIZE (64 * 1024)
+
+#ifdef __linux__
+/* from the getdents64(2) manual, glibc only got a wrapper in 2.30 */
+struct linux_dirent64 {
+  guint64         d_ino;
+  gint64          d_off;
+  unsigned short  d_reclen;
+  unsigned char   d_type;
+  char            d_name[];
+};
+#endif
+
+
+/*
+ * nw_walk_stat:
+ * @dir_fd: A directory file descriptor, or AT_FDCWD
+ * @name: Name of the entry to stat, relative to @dir_fd
+ * @entry: return location for the entry's information
+ *
+ * Gets the information of an entry without following symbolic links.  Only
+ * the fields in #NwWalkEntry are queried, and @entry's name is left alone.
+ *
+ * Returns: %TRUE on success, %FALSE with errno set otherwise, in which case
+ *          @entry's mode is set to 0.
+ */
+gboolean
+nw_walk_stat (gint          dir_fd,
+              const gchar  *name,
+              NwWalkEntry  *entry)
+{
+  struct stat st;
+#if HAVE_STATX
+  static volatile gint  statx_missing = 0;
+
+  if (! g_atomic_int_get (&statx_missing)) {
+    struct statx stx;
+
+    if (statx (dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+               STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_SIZE |
+               STATX_BLOCKS | STATX_INO,
+               &stx) == 0) {
+      entry->mode = stx.stx_mode;
+      entry->size = stx.stx_size;
+      entry->allocated = stx.stx_blocks * 512;
+      entry->device = makedev (stx.stx_dev_major, stx.stx_dev_minor);
+      entry->inode = stx.stx_ino;
+      entry->n_links = stx.stx_nlink;
+      return TRUE;
+    } else if (errno != ENOSYS) {
+      entry->mode = 0;
+      return FALSE;
+    }
+    /* the kernel predates statx(2) */
+    g_atomic_int_set (&statx_missing, 1);
+  }
+#endif
+  if (fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    entry->mode = 0;
+    return FALSE;
+  }
+  entry->mode = st.st_mode;
+  entry->size = (guint64) st.st_size;
+  entry->allocated = (guint64) st.st_blocks * 512;
+  entry->device = st.st_dev;
+  entry->inode = (guint64) st.st_ino;
+  entry->n_links = (guint32) st.st_nlink;
+
+  return TRUE;
+}
+
+/* stats @name and passes it to @func.  Entries removed in the meantime are
+ * skipped, other failures are passed with a 0 mode for the caller to report
+ * them when it gets to the entry */
+static gboolean
+list_entry (gint          dir_fd,
+            const gchar  *name,
+            NwWalkFunc    func,
+            gpointer      data)
+{
+  NwWalkEntry entry;
+
+  if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0) {
+    return TRUE;
+  }
+  entry.name = name;
+  if (! nw_walk_stat (dir_fd, name, &entry) && errno == ENOENT) {
+    return TRUE;
+  }
+
+  return func (&entry, data);
+}
+
+/*
+ * nw_walk_directory:
+ * @path: Path to a directory
+ * @func: Function called for each entry of @path
+ * @data: User data for @func
+ * @error: return location for errors, or %NULL to ignore them
+ *
+ * Lists the entries of @path, without recursing.  Callers renaming or removing
+ * entries should wait for the listing to be over, as the directory may
+ * otherwise list them again.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise.
+ */
+gboolean
+nw_walk_directory (const gchar  *path,
+                   NwWalkFunc    func,
+                   gpointer      data,
+                   GError      **error)
+{
+  gboolean  keep_going = TRUE;
+  gint      errsv = 0;
+  gint      fd;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    errsv = errno;
+  } else {
+#ifdef __linux__
+    gchar  *buffer = g_malloc (NW_WALK_BUFFER_SIZE);
+    glong   n = 0;
+
+    while (keep_going &&
+           (n = syscall (SYS_getdents64, fd, buffer, NW_WALK_BUFFER_SIZE)) > 0) {
+      glong offset;
+
+      for (offset = 0; keep_going && offset < n; ) {
+        struct linux_dirent64 *dirent = (gpointer) (buffer + offset);
+
+        keep_going = list_entry (fd, dirent->d_name, func, data);
+        offset += dirent->d_reclen;
+      }
+    }
+    if (n < 0) {
+      errsv = errno;
+    }
+    g_free (buffer);
+    close (fd);
+#else
+    DIR            *dir = fdopendir (fd);
+    struct dirent  *dirent;
+
+    if (! dir) {
+      errsv = errno;
+      close (fd);
+    } else {
+      errno = 0;
+      while (keep_going && (dirent = readdir (dir))) {
+        keep_going = list_entry (dirfd (dir), dirent->d_name, func, data);
+        errno = 0;
+      }
+      if (keep_going) {
+        errsv = errno;
+      }
+      closedir (dir);
+    }
+#endif
+  }
+  if (errsv != 0) {
+    gchar *display_name = g_filename_display_name (path);
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                 _("Failed to read directory \"%s\": %s"),
+                 display_name, g_strerror (errsv));
+    g_free (display_name);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* an inode, as a key of the sets from nw_walk_inode_set_new() */
+typedef struct {
+  dev_t   device;
+  guint64 inode;
+} InodeKey;
+
+static guint
+inode_key_hash (gconstpointer key)
+{
+  const InodeKey *k = key;
+
+  return (guint) (k->inode ^ (k->inode >> 32)) ^ ((guint) k->device * 31);
+}
+
+static gboolean
+inode_key_equal (gconstpointer a,
+                 gconstpointer b)
+{
+  const InodeKey *ka = a;
+  const InodeKey *kb = b;
+
+  return ka->inode == kb->inode && ka->device == kb->device;
+}
+
+static void
+inode_key_free (gpointer key)
+{
+  g_slice_free (InodeKey, key);
+}
+
+/*
+ * nw_walk_inode_set_new:
+ *
+ * Creates a set of inodes, to find the entries that are links to an inode
+ * already seen.  See nw_walk_inode_set_add().
+ *
+ * Returns: A new set, free with g_hash_table_destroy()
+ */
+GHashTable *
+nw_walk_inode_set_new (void)
+{
+  return g_hash_table_new_full (inode_key_hash, inode_key_equal,
+                                inode_key_free, NULL);
+}
+
+/*
+ * nw_walk_inode_set_add:
+ * @set: A set from nw_walk_inode_set_new()
+ * @entry: An entry whose information was read
+ *
+ * Adds the inode of @entry to @set.
+ *
+ * Returns: %TRUE if the inode was added, %FALSE if it already was in @set.
+ */
+gboolean
+nw_walk_inode_set_add (GHashTable        *set,
+                       const NwWalkEntry *entry)
+{
+  InodeKey key;
+
+  key.device = entry->device;
+  key.inode = entry->inode;
+  if (g_hash_table_lookup_extended (set, &key, NULL, NULL)) {
+    return FALSE;
+  }
+  g_hash_table_insert (set, g_slice_dup (InodeKey, &key), NULL);
+
+  return TRUE;
+}
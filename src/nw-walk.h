@@ -0,0 +1,83 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2012 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef NW_WALK_H
+#define NW_WALK_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+
+typedef struct _NwWalkEntry NwWalkEntry;
+
+/**
+ * NwWalkEntry:
+ * @name: The entry's name in its directory
+ * @mode: The entry's type and permissions, as #stat's st_mode, or 0 if it
+ *        couldn't be read
+ * @size: The entry's apparent size
+ * @allocated: The size of the data actually allocated to the entry
+ * @device: The device the entry is stored on
+ * @inode: The entry's inode number
+ * @n_links: The number of hard links to the entry's inode
+ *
+ * An entry of a directory, as listed by nw_walk_directory().
+ */
+struct _NwWalkEntry {
+  const gchar  *name;
+  guint32       mode;
+  guint64       size;
+  guint64       allocated;
+  dev_t         device;
+  guint64       inode;
+  guint32       n_links;
+};
+
+/**
+ * NwWalkFunc:
+ * @entry: The entry found, only valid during the call
+ * @data: User data
+ *
+ * Called for each entry of a directory.
+ *
+ * Returns: %TRUE to go on, %FALSE to stop listing.
+ */
+typedef gboolean  (*NwWalkFunc)   (const NwWalkEntry *entry,
+                                   gpointer           data);
+
+
+gboolean    nw_walk_stat            (gint               dir_fd,
+                                     const gchar       *name,
+                                     NwWalkEntry       *entry);
+gboolean    nw_walk_directory       (const gchar       *path,
+                                     NwWalkFunc         func,
+                                     gpointer           data,
+                                     GError           **error);
+GHashTable *nw_walk_inode_set_new   (void);
+gboolean    nw_walk_inode_set_add   (GHashTable        *set,
+                                     const NwWalkEntry *entry);
+
+
+G_END_DECLS
+
+#endif /* guard */
@@ -0,0 +1,230 @@
+/*
+ *  nemo-wipe - a nemo extension to wipe file(s)
+ *
+ *  Copyright (C) 2009-2011 Colomban Wendling <ban@herbesfolles.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this library; if not, write to the Free
+ *  Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/* Checks that sequential fills chain their sub-operations from their
+ * completion, without the main loop ever waking up on a timer in between.
+ * sfill(1) is replaced by a script that only records the directory it was
+ * given */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "nw-fill-operation.h"
+#include "nw-operation.h"
+
+
+/* number of directories, and thus of sub-operations, to chain */
+#define N_DIRECTORIES   4
+/* how long to wait for the whole chain before giving up, in seconds */
+#define CHAIN_TIMEOUT   30
+
+static const gchar *mock_sfill = "#!/bin/sh\n"
+                                 "for last; do :; done\n"
+                                 "echo \"$last\" >> \"$NW_TEST_FILL_LOG\"\n";
+
+static const gchar *base_directory;
+static GPollFunc    real_poll;
+static guint        n_timer_wakeups;
+
+/* counts the times the main loop slept and was woken up by a timer rather
+ * than by an event.  Polls that don't sleep, for idle sources, don't count */
+static gint
+counting_poll (GPollFD *fds,
+               guint    n_fds,
+               gint     timeout)
+{
+  gint n_ready = real_poll (fds, n_fds, timeout);
+
+  if (n_ready == 0 && timeout != 0) {
+    n_timer_wakeups ++;
+  }
+
+  return n_ready;
+}
+
+static void
+finished_handler (NwOperation *operation,
+                  gboolean     success,
+                  const gchar *message,
+                  gpointer     data)
+{
+  gboolean *succeeded = data;
+
+  *succeeded = success;
+  g_main_loop_quit (g_object_get_data (G_OBJECT (operation), "loop"));
+}
+
+static gboolean
+chain_timeout (gpointer data)
+{
+  g_main_loop_quit (data);
+
+  return FALSE;
+}
+
+/* removes @path and everything under it */
+static void
+remove_tree (const gchar *path)
+{
+  GDir        *dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  while (dir && (name = g_dir_read_name (dir))) {
+    gchar *child = g_build_filename (path, name, NULL);
+
+    if (g_file_test (child, G_FILE_TEST_IS_DIR)) {
+      remove_tree (child);
+    } else {
+      g_unlink (child);
+    }
+    g_free (child);
+  }
+  if (dir) {
+    g_dir_close (dir);
+  }
+  g_rmdir (path);
+}
+
+static void
+test_fill_chain_no_wakeups (void)
+{
+  NwOperation  *operation;
+  GMainLoop    *loop;
+  GError       *err = NULL;
+  gboolean      succeeded = FALSE;
+  gchar        *template;
+  gchar        *root;
+  gchar        *bin;
+  gchar        *sfill;
+  gchar        *found;
+  gchar        *log;
+  gchar        *path;
+  gchar        *contents = NULL;
+  gchar        *skip_reason = NULL;
+  gchar       **lines;
+  GPtrArray    *directories;
+  guint         timeout;
+  guint         i;
+
+  template = g_build_filename (base_directory, "fill-chain-XXXXXX", NULL);
+  root = g_mkdtemp (template);
+  g_assert (root != NULL);
+
+  /* the mock sfill, found first in the PATH */
+  bin = g_build_filename (root, "bin", NULL);
+  g_assert_cmpint (g_mkdir (bin, 0755), ==, 0);
+  sfill = g_build_filename (bin, "sfill", NULL);
+  g_assert (g_file_set_contents (sfill, mock_sfill, -1, NULL));
+  g_assert_cmpint (g_chmod (sfill, 0755), ==, 0);
+  path = g_strconcat (bin, G_SEARCHPATH_SEPARATOR_S, g_getenv ("PATH"), NULL);
+  g_setenv ("PATH", path, TRUE);
+  g_free (path);
+  found = g_find_program_in_path ("sfill");
+  g_assert_cmpstr (found, ==, sfill);
+  g_free (found);
+  log = g_build_filename (root, "log", NULL);
+  g_setenv ("NW_TEST_FILL_LOG", log, TRUE);
+
+  operation = nw_fill_operation_new ();
+  g_object_set (operation, "parallel", FALSE, NULL);
+  directories = g_ptr_array_new_with_free_func (g_free);
+  for (i = 0; i < N_DIRECTORIES; i++) {
+    gchar *name = g_strdup_printf ("dir%u", i);
+
+    path = g_build_filename (root, name, NULL);
+    g_assert_cmpint (g_mkdir (path, 0700), ==, 0);
+    nw_operation_add_file (operation, path);
+    g_ptr_array_add (directories, path);
+    g_free (name);
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_object_set_data (G_OBJECT (operation), "loop", loop);
+  g_signal_connect (operation, "finished",
+                    G_CALLBACK (finished_handler), &succeeded);
+  if (! nw_operation_run (operation, &err)) {
+    /* the build directory is on a mount that is never filled */
+    skip_reason = g_strdup (err->message);
+    g_error_free (err);
+  } else {
+    real_poll = g_main_context_get_poll_func (NULL);
+    g_main_context_set_poll_func (NULL, counting_poll);
+    timeout = g_timeout_add_seconds (CHAIN_TIMEOUT, chain_timeout, loop);
+    n_timer_wakeups = 0;
+    g_main_loop_run (loop);
+    g_main_context_set_poll_func (NULL, real_poll);
+    g_assert_cmpuint (n_timer_wakeups, ==, 0);
+    g_source_remove (timeout);
+    g_assert (succeeded);
+
+    /* each directory got its own sub-operation, in order */
+    g_assert (g_file_get_contents (log, &contents, NULL, NULL));
+    lines = g_strsplit (contents, "\n", -1);
+    g_assert_cmpuint (g_strv_length (lines), ==, N_DIRECTORIES + 1);
+    for (i = 0; i < N_DIRECTORIES; i++) {
+      g_assert_cmpstr (lines[i], ==, g_ptr_array_index (directories, i));
+    }
+    g_strfreev (lines);
+    g_free (contents);
+  }
+
+  /* let the last sub-operation go */
+  while (g_main_context_iteration (NULL, FALSE));
+  g_object_unref (operation);
+  g_main_loop_unref (loop);
+  g_ptr_array_free (directories, TRUE);
+  remove_tree (root);
+  g_free (log);
+  g_free (sfill);
+  g_free (bin);
+  g_free (root);
+
+  if (skip_reason) {
+#if GLIB_CHECK_VERSION (2, 38, 0)
+    g_test_skip (skip_reason);
+    g_free (skip_reason);
+#else
+    /* what meson and automake take as a skipped test */
+    g_printerr ("Skipped: %s\n", skip_reason);
+    g_free (skip_reason);
+    exit (77);
+#endif
+  }
+}
+
+int
+main (int     argc,
+      char  **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  base_directory = argc > 1 ? argv[1] : ".";
+
+  g_test_add_func ("/fill-operation/chain-no-wakeups",
+                   test_fill_chain_no_wakeups);
+
+  return g_test_run ();
+}